@@ -0,0 +1,174 @@
+/**
+ * @file    fusion_test.c
+ * @brief   Integer angles of FixMath.c and Fusion.c against libm
+ * @details fix_atan2_mdeg is compared with atan2 on a sweep of directions and lengths, fix_isqrt is checked to round
+ *          down on random 64 bit values. Fusion.c is compiled in, so its accelerometer correction and compass work on
+ *          synthetic gravity and magnetic field vectors of a robot with known roll, pitch and yaw, and the angles they
+ *          give are compared with the ones the vectors were made from.<br>
+ *          Build and run: make check (see Makefile)<br>
+ *          The exit status is 1 if an angle is off by more than MAX_ATAN2_MDEG or MAX_ANGLE_MDEG or a square root is
+ *          wrong.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "Fusion.c"
+
+#define MAX_ATAN2_MDEG      230         // the polynomial's own error
+#define MAX_ANGLE_MDEG      300         // atan2 plus the rounding of the horizontal field counts
+#define G_COUNTS            16384       // accelerometer counts of 1 g at +-2 g
+#define FIELD_COUNTS        3000        // magnetometer counts of the earth's field
+#define DIP_DEG             72.0        // inclination of the field, down in the north
+#define ACCEL_STEPS         2000        // accelerometer corrections until roll and pitch have settled
+
+static uint64 rng = 1;
+
+
+static uint64 random_u64(void)
+{
+    rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+    return rng;
+}
+
+
+static int32 mdeg(double rad)
+{
+    return (int32)lround(rad * 180000.0 / M_PI);
+}
+
+
+/**
+* @brief    Difference of two angles
+* @details  the shorter way around, in millidegrees
+*/
+static int32 angle_diff(int32 a, int32 b)
+{
+    int32 d = a - b;
+
+    while(d > 180000) {
+        d -= 360000;
+    }
+    while(d < -180000) {
+        d += 360000;
+    }
+    return abs(d);
+}
+
+
+/**
+* @brief    fix_atan2_mdeg against atan2
+* @details  returns the largest error in millidegrees
+*/
+static int32 atan2_error(void)
+{
+    static const double length[] = { 20.0, 1000.0, 32767.0, 1e6, 1e12 };
+    int32 worst = 0, d;
+    unsigned l;
+    int i;
+
+    for(l = 0; l < sizeof(length) / sizeof(length[0]); l++) {
+        for(i = 0; i < 36000; i++) {
+            double a = (i - 18000) * M_PI / 18000.0;
+            int64 y = llround(length[l] * sin(a));
+            int64 x = llround(length[l] * cos(a));
+
+            d = angle_diff(fix_atan2_mdeg(y, x), mdeg(atan2((double)y, (double)x)));
+            worst = d > worst ? d : worst;
+        }
+    }
+    return worst;
+}
+
+
+/**
+* @brief    fix_isqrt rounding down
+* @details  returns the number of wrong roots
+*/
+static int isqrt_errors(void)
+{
+    int errors = 0, i;
+
+    for(i = 0; i < 200000; i++) {
+        uint64 n = random_u64() >> (i % 64);
+        uint64 r = fix_isqrt(n);
+
+        if(r * r > n || n - r * r > 2 * r) {
+            errors++;
+        }
+    }
+    return errors;
+}
+
+
+/**
+* @brief    Roll, pitch and compass yaw of a rotated robot
+* @details  The body is rotated by yaw around z, then pitch around y and roll around x. The accelerometer sees up
+*           (0, 0, 1 g) and the magnetometer the field pointing north and down, both turned into body axes. Returns
+*           the largest error of the three angles in millidegrees.
+*/
+static int32 attitude_error(double roll, double pitch, double yaw)
+{
+    double cr = cos(roll), sr = sin(roll), cp = cos(pitch), sp = sin(pitch), cy = cos(yaw), sy = sin(yaw);
+    double dip = DIP_DEG * M_PI / 180.0;
+    double n = cos(dip), down = sin(dip);
+    /* world field (n, 0, -down) into body axes, R^T = Rx(-roll) Ry(-pitch) Rz(-yaw) */
+    double x1 = n * cy, y1 = -n * sy, z1 = -down;
+    double x2 = x1 * cp - z1 * sp, z2 = x1 * sp + z1 * cp;
+    struct imu_axes_ a;
+    int32 compass, worst, d, i;
+
+    a.x = (int16)lround(-sp * G_COUNTS);
+    a.y = (int16)lround(cp * sr * G_COUNTS);
+    a.z = (int16)lround(cp * cr * G_COUNTS);
+    mag.x = (int16)lround(x2 * FIELD_COUNTS);
+    mag.y = (int16)lround((y1 * cr + z2 * sr) * FIELD_COUNTS);
+    mag.z = (int16)lround((-y1 * sr + z2 * cr) * FIELD_COUNTS);
+
+    angle.roll = 0;
+    angle.pitch = 0;
+    for(i = 0; i < ACCEL_STEPS; i++) {
+        add_accel(&a);
+    }
+    if(!compass_mdeg(&compass)) {
+        return 360000;
+    }
+    worst = angle_diff(angle.roll >> ANGLE_SHIFT, mdeg(roll));
+    d = angle_diff(angle.pitch >> ANGLE_SHIFT, mdeg(pitch));
+    worst = d > worst ? d : worst;
+    d = angle_diff(compass, mdeg(yaw));
+    return d > worst ? d : worst;
+}
+
+
+int main(void)
+{
+    int32 atan2_worst = atan2_error(), attitude_worst = 0, d;
+    int sqrt_wrong = isqrt_errors();
+    int failed = 0, r, p, y;
+
+    /* roll and pitch up to 40 degrees, the robot doesn't get more tilted than that on its wheels */
+    for(r = -40; r <= 40; r += 10) {
+        for(p = -40; p <= 40; p += 10) {
+            for(y = -180; y < 180; y += 15) {
+                d = attitude_error(r * M_PI / 180.0, p * M_PI / 180.0, y * M_PI / 180.0);
+                if(d > MAX_ANGLE_MDEG) {
+                    printf("roll %d pitch %d yaw %d: off by %ld mdeg\n", r, p, y, (long)d);
+                    failed = 1;
+                }
+                attitude_worst = d > attitude_worst ? d : attitude_worst;
+            }
+        }
+    }
+    if(atan2_worst > MAX_ATAN2_MDEG) {
+        printf("fix_atan2_mdeg off by %ld mdeg\n", (long)atan2_worst);
+        failed = 1;
+    }
+    if(sqrt_wrong) {
+        printf("fix_isqrt wrong %d times\n", sqrt_wrong);
+        failed = 1;
+    }
+    printf("fusion_test: atan2 error %ld mdeg, roll/pitch/compass error %ld mdeg, %d wrong square roots: %s\n",
+           (long)atan2_worst, (long)attitude_worst, sqrt_wrong, failed ? "FAILED" : "ok");
+    return failed;
+}
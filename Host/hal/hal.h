@@ -0,0 +1,52 @@
+/**
+ * @file    hal.h
+ * @brief   Host simulation internals shared by the hal_*.c files
+ * @details Not for the firmware or host programs, they use project.h and sim.h.
+*/
+#ifndef HAL_H_
+#define HAL_H_
+#include <project.h>
+#include "sim.h"
+
+#define HAL_NEVER           UINT64_MAX
+
+/* NVIC numbers, the ones PSoC Creator has placed match cyfitter.h */
+#define HAL_IRQ_SENSOR      1u
+#define HAL_IRQ_ULTRA       2u
+#define HAL_IRQ_I2C         15u
+#define HAL_NVIC_LINES      32u
+#define HAL_IRQ_SYSTICK     32u     // not an NVIC line, kept after them in the same table
+#define HAL_IRQS            33u
+
+/**
+* @brief    Scheduled event
+* @details  fires once at the given bus clock cycle, or every period cycles when period is not 0
+*/
+struct hal_event_ {
+    uint64 at;
+    uint64 period;
+    sim_event_t fn;
+    void *arg;
+    uint8 active;
+    uint8 linked;
+    uint8 owned;                    // allocated by sim_after/sim_every, freed when done
+    struct hal_event_ *next;
+};
+
+extern uint64 hal_time;
+
+void hal_enter(void);
+void hal_wait_until(uint64 at);
+void hal_wait_event(void);
+void hal_schedule(struct hal_event_ *ev, uint64 at);
+void hal_cancel(struct hal_event_ *ev);
+
+void hal_irq_raise(uint8 irq);
+void hal_irq_clear(uint8 irq);
+void hal_irq_level(uint8 irq, uint8 level);
+void hal_irq_vector(uint8 irq, cyisraddress handler);
+void hal_irq_enable(uint8 irq, uint8 enable);
+
+void hal_uart_flush(void);
+
+#endif
@@ -0,0 +1,804 @@
+/**
+ * @file    hal_core.c
+ * @brief   Virtual time, interrupts and the Cy library calls of the host simulation. For more details, please refer to
+ *          sim.h file.
+ * @details Time is a 64 bit count of bus clock cycles. Components schedule events on it; an event changes the
+ *          component state and may raise an interrupt. Interrupts are taken in NVIC priority order whenever they are
+ *          unmasked: after every event and at the start of every component call, which is where a real interrupt
+ *          would land as far as the firmware can tell.<br>
+ *          A firmware loop that waits on a variable without calling any component makes no time pass by itself.
+ *          During sim_run a SIGALRM handler notices when the firmware has used IDLE_CPU_NS of CPU time without a
+ *          component call, and runs time forward to the next interrupt from the signal handler, which then preempts
+ *          the loop just like the real interrupt would. Such waits cost one signal per interrupt, host programs that
+ *          need speed wait with sim_advance instead.
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "hal.h"
+
+#define THREAD_PRIORITY     8u          // below every NVIC priority
+#define DEFAULT_PRIORITY    7u          // PSoC Creator default for isr components
+#define SYSTICK_PRIORITY    0u
+#define SIGNAL_INTERVAL_US  50
+#define IDLE_CPU_NS         200000      // far longer than any stretch of firmware code between component calls
+
+struct irq_ {
+    cyisraddress handler;
+    uint8 enabled;
+    uint8 pending;
+    uint8 priority;
+};
+
+uint64 hal_time = 0;
+reg32 hal_nvic_pending = 0;
+struct hal_scb_ hal_scb = { 0 };
+struct hal_dwt_ hal_dwt = { 0 };
+struct hal_core_debug_ hal_core_debug = { 0 };
+
+static struct irq_ irqs[HAL_IRQS];
+static uint64 irq_ready = 0;            // pending and enabled
+static uint8 irq_masked = 1;            // PRIMASK, interrupts are off after reset
+static uint8 current_priority = THREAD_PRIORITY;
+static uint32 dispatched = 0;
+
+static struct hal_event_ *events = NULL;
+static struct hal_event_ *next_event = NULL;
+static uint64 next_at = HAL_NEVER;
+static uint32 call_cost = 24;           // 1 us per component call
+
+static volatile sig_atomic_t in_hal = 0;
+static volatile uint32 calls = 0;
+static uint32 seen_calls = 0;
+static int64 seen_cpu = 0;
+static uint8 running = 0;
+static uint8 stop_requested = 0;
+static uint64 end_at = HAL_NEVER;
+static sigjmp_buf run_env;
+
+static struct {
+    uint8 enabled;
+    uint8 interrupt;
+    uint8 count_flag;
+    uint32 reload;
+    uint32 next_reload;
+    uint64 t0;                          // time the counter was last loaded from reload
+    cySysTickCallback callbacks[CY_SYS_SYST_NUM_OF_CALLBACKS];
+    struct hal_event_ wrap;
+} systick;
+
+
+/**
+* @brief    Finding the earliest active event
+* @details
+*/
+static void find_next(void)
+{
+    struct hal_event_ *ev;
+
+    next_event = NULL;
+    next_at = HAL_NEVER;
+    for(ev = events; ev != NULL; ev = ev->next) {
+        if(ev->active && ev->at < next_at) {
+            next_at = ev->at;
+            next_event = ev;
+        }
+    }
+}
+
+
+/**
+* @brief    Removing an allocated event
+* @details
+*/
+static void unlink_event(struct hal_event_ *ev)
+{
+    struct hal_event_ **p;
+
+    for(p = &events; *p != NULL; p = &(*p)->next) {
+        if(*p == ev) {
+            *p = ev->next;
+            break;
+        }
+    }
+    free(ev);
+}
+
+
+/**
+* @brief    Ending sim_run
+* @details  jumps out of the firmware, which may be deep in interrupt handlers or in the signal handler
+*/
+static void end_run(void)
+{
+    if(running) {
+        siglongjmp(run_env, 1);
+    }
+}
+
+
+/**
+* @brief    Taking pending interrupts
+* @details  highest priority first, only ones above the code that is running now. A handler may take more interrupts
+*           of higher priority through its own component calls.
+*/
+static void dispatch(void)
+{
+    while(!irq_masked && irq_ready) {
+        uint8 best = HAL_IRQS, i;
+        uint8 saved;
+
+        for(i = 0; i < HAL_IRQS; i++) {
+            if((irq_ready & ((uint64)1 << i)) && irqs[i].priority < current_priority &&
+               (best == HAL_IRQS || irqs[i].priority < irqs[best].priority)) {
+                best = i;
+            }
+        }
+        if(best == HAL_IRQS) {
+            return;
+        }
+
+        hal_irq_clear(best);
+        saved = current_priority;
+        current_priority = irqs[best].priority;
+        dispatched++;
+        in_hal++;
+        irqs[best].handler();
+        in_hal--;
+        current_priority = saved;
+    }
+}
+
+
+/**
+* @brief    Updating DWT->CYCCNT
+* @details  the low 32 bits of virtual time, like the real counter that is never written
+*/
+static void sync_cycle_counter(void)
+{
+    if((hal_core_debug.DEMCR & CoreDebug_DEMCR_TRCENA_Msk) && (hal_dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+        hal_dwt.CYCCNT = (uint32)hal_time;
+    }
+}
+
+
+/**
+* @brief    Running time forward
+* @details  fires the events up to the given time in order, taking interrupts after each one
+* @param    uint64 target : bus clock cycle to stop at
+*/
+static void advance(uint64 target)
+{
+    while(next_at <= target && next_at < end_at && !stop_requested) {
+        struct hal_event_ *ev = next_event;
+
+        if(ev->at > hal_time) {
+            hal_time = ev->at;
+        }
+        sync_cycle_counter();
+        if(ev->period) {
+            ev->at += ev->period;
+        }
+        else {
+            ev->active = 0;
+        }
+        find_next();
+        ev->fn(ev->arg);
+        if(!ev->active && ev->owned) {
+            unlink_event(ev);
+            find_next();
+        }
+        dispatch();
+    }
+    if(target > hal_time) {
+        hal_time = target < end_at ? target : end_at;
+    }
+    sync_cycle_counter();
+    if(hal_time >= end_at) {
+        end_run();
+    }
+}
+
+
+void hal_enter(void)
+{
+    in_hal++;
+    calls++;
+    advance(hal_time + call_cost);
+    dispatch();
+    in_hal--;
+}
+
+
+void hal_wait_until(uint64 at)
+{
+    in_hal++;
+    dispatch();
+    advance(at);
+    in_hal--;
+}
+
+
+void hal_wait_event(void)
+{
+    if(next_at == HAL_NEVER) {
+        fprintf(stderr, "sim: waiting for a component that has nothing scheduled\n");
+        end_run();
+        return;
+    }
+    hal_wait_until(next_at);
+}
+
+
+void hal_schedule(struct hal_event_ *ev, uint64 at)
+{
+    if(!ev->linked) {
+        ev->linked = 1;
+        ev->next = events;
+        events = ev;
+    }
+    ev->at = at;
+    ev->active = 1;
+    if(at < next_at) {
+        next_at = at;
+        next_event = ev;
+    }
+    else if(ev == next_event) {
+        find_next();
+    }
+}
+
+
+void hal_cancel(struct hal_event_ *ev)
+{
+    ev->active = 0;
+    if(ev == next_event) {
+        find_next();
+    }
+}
+
+
+/**
+* @brief    Keeping the pending registers the firmware reads in step
+* @details
+*/
+static void sync_pending(void)
+{
+    uint32_t pending = 0;
+    uint8 i;
+
+    irq_ready = 0;
+    for(i = 0; i < HAL_IRQS; i++) {
+        if(irqs[i].pending) {
+            if(i < HAL_NVIC_LINES) {
+                pending |= (uint32_t)1 << i;
+            }
+            if(irqs[i].enabled && irqs[i].handler != NULL) {
+                irq_ready |= (uint64)1 << i;
+            }
+        }
+    }
+    hal_nvic_pending = pending;
+    if(irqs[HAL_IRQ_SYSTICK].pending) {
+        hal_scb.ICSR |= SCB_ICSR_PENDSTSET_Msk;
+    }
+    else {
+        hal_scb.ICSR &= ~SCB_ICSR_PENDSTSET_Msk;
+    }
+}
+
+
+void hal_irq_raise(uint8 irq)
+{
+    irqs[irq].pending = 1;
+    sync_pending();
+}
+
+
+void hal_irq_clear(uint8 irq)
+{
+    irqs[irq].pending = 0;
+    sync_pending();
+}
+
+
+void hal_irq_level(uint8 irq, uint8 level)
+{
+    if(level) {
+        hal_irq_raise(irq);
+    }
+    else if(irqs[irq].pending) {
+        hal_irq_clear(irq);
+    }
+}
+
+
+void hal_irq_vector(uint8 irq, cyisraddress handler)
+{
+    irqs[irq].handler = handler;
+    sync_pending();
+}
+
+
+void hal_irq_enable(uint8 irq, uint8 enable)
+{
+    irqs[irq].enabled = enable;
+    sync_pending();
+    if(enable) {
+        dispatch();
+    }
+}
+
+
+/**
+* @brief    Priorities after reset
+* @details
+*/
+__attribute__((constructor)) static void hal_reset(void)
+{
+    uint8 i;
+
+    for(i = 0; i < HAL_IRQS; i++) {
+        irqs[i].priority = DEFAULT_PRIORITY;
+    }
+    irqs[HAL_IRQ_SYSTICK].priority = SYSTICK_PRIORITY;
+    systick.reload = 0x00FFFFFFu;
+    systick.next_reload = systick.reload;
+}
+
+
+/* isr components */
+#define HAL_ISR(n, irq) \
+    void n##_Start(void) { n##_StartEx(NULL); } \
+    void n##_StartEx(cyisraddress address) { hal_enter(); hal_irq_enable(irq, 0u); hal_irq_vector(irq, address); \
+                                              irqs[irq].priority = DEFAULT_PRIORITY; hal_irq_enable(irq, 1u); } \
+    void n##_Stop(void) { hal_enter(); hal_irq_enable(irq, 0u); hal_irq_vector(irq, NULL); } \
+    void n##_Enable(void) { hal_enter(); hal_irq_enable(irq, 1u); } \
+    void n##_Disable(void) { hal_enter(); hal_irq_enable(irq, 0u); } \
+    void n##_SetPriority(uint8 priority) { hal_enter(); irqs[irq].priority = priority & 7u; } \
+    uint8 n##_GetPriority(void) { hal_enter(); return irqs[irq].priority; } \
+    void n##_SetPending(void) { hal_enter(); hal_irq_raise(irq); dispatch(); } \
+    void n##_ClearPending(void) { hal_enter(); hal_irq_clear(irq); }
+
+HAL_ISR(sensor_isr, HAL_IRQ_SENSOR)
+HAL_ISR(ultra_isr, HAL_IRQ_ULTRA)
+
+
+/* CyLib NVIC lines */
+cyisraddress CyIntSetVector(uint8 number, cyisraddress address)
+{
+    cyisraddress old;
+
+    hal_enter();
+    old = irqs[number & 31u].handler;
+    hal_irq_vector(number & 31u, address);
+    return old;
+}
+
+
+cyisraddress CyIntGetVector(uint8 number)
+{
+    hal_enter();
+    return irqs[number & 31u].handler;
+}
+
+
+void CyIntSetPriority(uint8 number, uint8 priority)
+{
+    hal_enter();
+    irqs[number & 31u].priority = priority & 7u;
+}
+
+
+uint8 CyIntGetPriority(uint8 number)
+{
+    hal_enter();
+    return irqs[number & 31u].priority;
+}
+
+
+void CyIntEnable(uint8 number)
+{
+    hal_enter();
+    hal_irq_enable(number & 31u, 1u);
+}
+
+
+void CyIntDisable(uint8 number)
+{
+    hal_enter();
+    hal_irq_enable(number & 31u, 0u);
+}
+
+
+void CyIntSetPending(uint8 number)
+{
+    hal_enter();
+    hal_irq_raise(number & 31u);
+    dispatch();
+}
+
+
+void CyIntClearPending(uint8 number)
+{
+    hal_enter();
+    hal_irq_clear(number & 31u);
+}
+
+
+/* CyLib */
+void hal_global_int(uint8 enable)
+{
+    hal_enter();
+    irq_masked = !enable;
+    in_hal++;
+    dispatch();
+    in_hal--;
+}
+
+
+uint8 CyEnterCriticalSection(void)
+{
+    uint8 was_masked;
+
+    hal_enter();
+    was_masked = irq_masked;
+    irq_masked = 1;
+    return was_masked;
+}
+
+
+void CyExitCriticalSection(uint8 savedIntrStatus)
+{
+    hal_enter();
+    irq_masked = savedIntrStatus;
+    in_hal++;
+    dispatch();
+    in_hal--;
+}
+
+
+void CyDelay(uint32 milliseconds)
+{
+    hal_enter();
+    hal_wait_until(hal_time + SIM_MS(milliseconds));
+}
+
+
+void CyDelayUs(uint16 microseconds)
+{
+    hal_enter();
+    hal_wait_until(hal_time + SIM_US(microseconds));
+}
+
+
+/* SysTick */
+static void systick_isr(void)
+{
+    uint32 i;
+
+    for(i = 0; i < CY_SYS_SYST_NUM_OF_CALLBACKS; i++) {
+        if(systick.callbacks[i] != NULL) {
+            systick.callbacks[i]();
+        }
+    }
+}
+
+
+static void systick_wrap(void *arg)
+{
+    (void)arg;
+    systick.t0 = hal_time;
+    systick.reload = systick.next_reload;
+    systick.count_flag = 1;
+    hal_schedule(&systick.wrap, hal_time + systick.reload + 1u);
+    if(systick.interrupt) {
+        hal_irq_raise(HAL_IRQ_SYSTICK);
+    }
+}
+
+
+void CySysTickInit(void)
+{
+    hal_enter();
+    memset(systick.callbacks, 0, sizeof(systick.callbacks));
+    systick.wrap.fn = systick_wrap;
+    hal_irq_vector(HAL_IRQ_SYSTICK, systick_isr);
+    hal_irq_enable(HAL_IRQ_SYSTICK, 1u);
+}
+
+
+void CySysTickEnable(void)
+{
+    hal_enter();
+    systick.interrupt = 1;
+    if(!systick.enabled) {
+        systick.enabled = 1;
+        systick.t0 = hal_time;
+        hal_schedule(&systick.wrap, hal_time + systick.reload + 1u);
+    }
+}
+
+
+void CySysTickStart(void)
+{
+    static uint8 initialized = 0;
+
+    if(!initialized) {
+        CySysTickInit();
+        initialized = 1;
+    }
+    CySysTickEnable();
+}
+
+
+void CySysTickStop(void)
+{
+    hal_enter();
+    systick.enabled = 0;
+    systick.interrupt = 0;
+    hal_cancel(&systick.wrap);
+}
+
+
+void CySysTickEnableInterrupt(void)
+{
+    hal_enter();
+    systick.interrupt = 1;
+}
+
+
+void CySysTickDisableInterrupt(void)
+{
+    hal_enter();
+    systick.interrupt = 0;
+}
+
+
+void CySysTickSetReload(uint32 value)
+{
+    hal_enter();
+    systick.next_reload = value & 0x00FFFFFFu;
+}
+
+
+uint32 CySysTickGetReload(void)
+{
+    hal_enter();
+    return systick.next_reload;
+}
+
+
+uint32 CySysTickGetValue(void)
+{
+    hal_enter();
+    if(!systick.enabled) {
+        return 0;
+    }
+    return systick.reload - (uint32)((hal_time - systick.t0) % (systick.reload + 1u));
+}
+
+
+cySysTickCallback CySysTickSetCallback(uint32 number, cySysTickCallback function)
+{
+    cySysTickCallback old;
+
+    hal_enter();
+    old = systick.callbacks[number];
+    systick.callbacks[number] = function;
+    return old;
+}
+
+
+cySysTickCallback CySysTickGetCallback(uint32 number)
+{
+    hal_enter();
+    return systick.callbacks[number];
+}
+
+
+void CySysTickSetClockSource(uint32 clockSource)
+{
+    (void)clockSource;
+    hal_enter();
+}
+
+
+uint32 CySysTickGetCountFlag(void)
+{
+    uint32 flag;
+
+    hal_enter();
+    flag = systick.count_flag;
+    systick.count_flag = 0;
+    return flag;
+}
+
+
+void CySysTickClear(void)
+{
+    hal_enter();
+    systick.reload = systick.next_reload;
+    if(systick.enabled) {
+        systick.t0 = hal_time;
+        hal_schedule(&systick.wrap, hal_time + systick.reload + 1u);
+    }
+}
+
+
+/* running */
+
+/**
+* @brief    Noticing a firmware busy-wait
+* @details  runs every SIGNAL_INTERVAL_US of wall time. The firmware is waiting when it has used IDLE_CPU_NS of CPU
+*           time since a component call was last seen; time is then run forward until an interrupt has been taken.
+*           CPU time rather than wall time keeps host scheduling out of the result.
+*/
+static void idle_signal(int sig)
+{
+    struct timespec ts;
+    int64 cpu;
+    uint32 before;
+
+    (void)sig;
+    if(!running || in_hal || irq_masked) {
+        return;
+    }
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    cpu = (int64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    if(calls != seen_calls) {
+        seen_calls = calls;
+        seen_cpu = cpu;
+        return;
+    }
+    if(cpu - seen_cpu < IDLE_CPU_NS) {
+        return;
+    }
+
+    in_hal++;
+    before = dispatched;
+    while(dispatched == before) {
+        hal_wait_event();
+    }
+    in_hal--;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    seen_calls = calls;
+    seen_cpu = (int64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+* @brief    Starting or stopping the busy-wait signal
+* @details
+*/
+static void idle_timer(uint8 on)
+{
+    struct sigaction sa;
+    struct itimerval it;
+
+    memset(&it, 0, sizeof(it));
+    if(on) {
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = idle_signal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGALRM, &sa, NULL);
+        it.it_interval.tv_usec = SIGNAL_INTERVAL_US;
+        it.it_value.tv_usec = SIGNAL_INTERVAL_US;
+    }
+    setitimer(ITIMER_REAL, &it, NULL);
+}
+
+
+/**
+* @brief    Running firmware
+* @details  Calls entry, normally the firmware main renamed with -Dmain=..., until it returns, sim_stop is called or
+*           limit cycles of virtual time have passed. The firmware state is left as it was when the run ended.
+* @param    sim_entry_t entry : firmware entry point
+* @param    uint64 limit : longest run in bus clock cycles, 0 for no limit
+* @return   int
+*   - returns 1 if entry returned, 0 if the run was stopped
+*/
+int sim_run(sim_entry_t entry, uint64 limit)
+{
+    volatile int returned = 0;
+
+    end_at = limit ? hal_time + limit : HAL_NEVER;
+    stop_requested = 0;
+    if(sigsetjmp(run_env, 1) == 0) {
+        running = 1;
+        idle_timer(1);
+        entry();
+        returned = 1;
+    }
+    idle_timer(0);
+    running = 0;
+    in_hal = 0;
+    current_priority = THREAD_PRIORITY;
+    end_at = HAL_NEVER;
+    hal_uart_flush();
+
+    return returned;
+}
+
+
+/**
+* @brief    Ending the run
+* @details  from an event or model during sim_run; otherwise makes the current sim_advance return
+*/
+void sim_stop(void)
+{
+    stop_requested = 1;
+    end_run();
+}
+
+
+/**
+* @brief    Running time forward from a host program
+* @details  takes interrupts on the way, like a firmware CyDelay. Interrupts must have been enabled.
+* @param    uint64 cycles : bus clock cycles to run
+* @return   int
+*   - returns 0 if sim_stop was called on the way, otherwise 1
+*/
+int sim_advance(uint64 cycles)
+{
+    stop_requested = 0;
+    hal_wait_until(hal_time + cycles);
+    hal_uart_flush();
+
+    return !stop_requested;
+}
+
+
+uint64 sim_now(void)
+{
+    return hal_time;
+}
+
+
+uint64 sim_now_us(void)
+{
+    return hal_time / (SIM_CLOCK_HZ / 1000000u);
+}
+
+
+void sim_set_call_cost(uint32 cycles)
+{
+    call_cost = cycles;
+}
+
+
+uint32 sim_interrupts(void)
+{
+    return dispatched;
+}
+
+
+void sim_after(uint64 cycles, sim_event_t fn, void *arg)
+{
+    struct hal_event_ *ev = calloc(1, sizeof(*ev));
+
+    ev->fn = fn;
+    ev->arg = arg;
+    ev->owned = 1;
+    hal_schedule(ev, hal_time + cycles);
+}
+
+
+void sim_every(uint64 period, sim_event_t fn, void *arg)
+{
+    struct hal_event_ *ev = calloc(1, sizeof(*ev));
+
+    ev->fn = fn;
+    ev->arg = arg;
+    ev->owned = 1;
+    ev->period = period;
+    hal_schedule(ev, hal_time + period);
+}
@@ -0,0 +1,220 @@
+/**
+ * @file    hal_i2c.c
+ * @brief   Simulated I2C master and slave devices. For more details, please refer to sim.h file.
+ * @details A transfer takes as long as its bytes do at 100 kHz, address byte and start/stop included. When it ends the
+ *          slave gets or gives all the bytes at once, the master status is set like the generated component sets it
+ *          and the I2C interrupt runs I2C_ISR_ExitCallback. Addresses no device is attached to are NAKed.
+*/
+#include <string.h>
+
+#include "hal.h"
+
+#define I2C_BIT_CYCLES      (SIM_CLOCK_HZ / 100000u)
+
+static struct {
+    struct sim_i2c_device_ *devices;
+    uint8 status;
+    uint8 busy;                     // transfer on the bus
+    uint8 halted;                   // last transfer ended without a stop
+    uint8 addr;
+    uint8 *data;
+    uint8 len;
+    uint8 read;
+    uint8 mode;
+    struct hal_event_ done;
+} i2c;
+
+
+__attribute__((weak)) void I2C_ISR_ExitCallback(void)
+{
+}
+
+
+static CY_ISR(i2c_isr)
+{
+    I2C_ISR_ExitCallback();
+}
+
+
+static struct sim_i2c_device_ *find_device(uint8 addr)
+{
+    struct sim_i2c_device_ *dev;
+
+    for(dev = i2c.devices; dev != NULL; dev = dev->next) {
+        if(dev->addr == addr) {
+            return dev;
+        }
+    }
+    return NULL;
+}
+
+
+static void xfer_done(void *arg)
+{
+    struct sim_i2c_device_ *dev = find_device(i2c.addr);
+    int ack = 0;
+
+    (void)arg;
+    if(dev != NULL) {
+        if(i2c.read) {
+            ack = dev->read != NULL && dev->read(dev, i2c.data, i2c.len);
+        }
+        else {
+            ack = dev->write != NULL && dev->write(dev, i2c.data, i2c.len);
+        }
+    }
+
+    i2c.busy = 0;
+    i2c.status &= ~I2C_MSTAT_XFER_INP;
+    i2c.status |= i2c.read ? I2C_MSTAT_RD_CMPLT : I2C_MSTAT_WR_CMPLT;
+    if(!ack) {
+        i2c.status |= I2C_MSTAT_ERR_ADDR_NAK | I2C_MSTAT_ERR_XFER;
+        i2c.halted = 0;
+    }
+    else {
+        i2c.halted = i2c.mode == I2C_MODE_NO_STOP;
+        if(i2c.halted) {
+            i2c.status |= I2C_MSTAT_XFER_HALT;
+        }
+    }
+    hal_irq_raise(HAL_IRQ_I2C);
+}
+
+
+static uint8 start_xfer(uint8 addr, uint8 *data, uint8 cnt, uint8 mode, uint8 read)
+{
+    hal_enter();
+    if(i2c.busy) {
+        return I2C_MSTR_NOT_READY;
+    }
+    if(i2c.halted != (mode == I2C_MODE_REPEAT_START)) {
+        return I2C_MSTR_BUS_BUSY;
+    }
+
+    i2c.addr = addr;
+    i2c.data = data;
+    i2c.len = cnt;
+    i2c.read = read;
+    i2c.mode = mode;
+    i2c.busy = 1;
+    i2c.halted = 0;
+    i2c.status = (i2c.status & ~I2C_MSTAT_XFER_HALT) | I2C_MSTAT_XFER_INP;
+    hal_schedule(&i2c.done, hal_time + (uint64)(9u * (cnt + 1u) + 2u) * I2C_BIT_CYCLES);
+    return I2C_MSTR_NO_ERROR;
+}
+
+
+void I2C_Start(void)
+{
+    hal_enter();
+    i2c.done.fn = xfer_done;
+    hal_irq_vector(HAL_IRQ_I2C, i2c_isr);
+    hal_irq_enable(HAL_IRQ_I2C, 1u);
+}
+
+
+void I2C_Stop(void)
+{
+    hal_enter();
+    hal_irq_enable(HAL_IRQ_I2C, 0u);
+    hal_cancel(&i2c.done);
+    i2c.busy = 0;
+    i2c.halted = 0;
+}
+
+
+uint8 I2C_MasterStatus(void)
+{
+    hal_enter();
+    return i2c.status;
+}
+
+
+uint8 I2C_MasterClearStatus(void)
+{
+    uint8 status;
+
+    hal_enter();
+    status = i2c.status;
+    i2c.status &= I2C_MSTAT_XFER_INP;
+    return status;
+}
+
+
+uint8 I2C_MasterWriteBuf(uint8 slaveAddress, uint8 *wrData, uint8 cnt, uint8 mode)
+{
+    return start_xfer(slaveAddress, wrData, cnt, mode, 0u);
+}
+
+
+uint8 I2C_MasterReadBuf(uint8 slaveAddress, uint8 *rdData, uint8 cnt, uint8 mode)
+{
+    return start_xfer(slaveAddress, rdData, cnt, mode, 1u);
+}
+
+
+uint8 I2C_MasterSendStop(void)
+{
+    hal_enter();
+    if(!i2c.halted) {
+        return I2C_MSTR_NOT_READY;
+    }
+    i2c.halted = 0;
+    return I2C_MSTR_NO_ERROR;
+}
+
+
+void sim_i2c_attach(struct sim_i2c_device_ *dev)
+{
+    dev->next = i2c.devices;
+    i2c.devices = dev;
+}
+
+
+/* register file slave */
+static int regs_write(struct sim_i2c_device_ *dev, const uint8 *data, uint32 len)
+{
+    struct sim_i2c_regs_ *r = dev->ctx;
+
+    if(len == 0) {
+        return 1;
+    }
+    r->reg = data[0] & (r->auto_increment ? (uint8)~r->auto_increment : 0xFFu);
+    r->increment = !r->auto_increment || (data[0] & r->auto_increment);
+    for(data++, len--; len > 0; data++, len--) {
+        r->regs[r->reg] = *data;
+        if(r->after_write != NULL) {
+            r->after_write(r, r->reg);
+        }
+        r->reg += r->increment;
+    }
+    return 1;
+}
+
+
+static int regs_read(struct sim_i2c_device_ *dev, uint8 *data, uint32 len)
+{
+    struct sim_i2c_regs_ *r = dev->ctx;
+
+    for(; len > 0; data++, len--) {
+        if(r->before_read != NULL) {
+            r->before_read(r, r->reg);
+        }
+        *data = r->regs[r->reg];
+        r->reg += r->increment;
+    }
+    return 1;
+}
+
+
+void sim_i2c_regs_init(struct sim_i2c_regs_ *regs, uint8 addr, uint8 auto_increment)
+{
+    memset(regs, 0, sizeof(*regs));
+    regs->dev.addr = addr;
+    regs->dev.write = regs_write;
+    regs->dev.read = regs_read;
+    regs->dev.ctx = regs;
+    regs->auto_increment = auto_increment;
+    regs->increment = 1;
+    sim_i2c_attach(&regs->dev);
+}
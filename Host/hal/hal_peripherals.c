@@ -0,0 +1,863 @@
+/**
+ * @file    hal_peripherals.c
+ * @brief   Simulated pins, timers, PWMs, UART, ADC and EEPROM. For more details, please refer to sim.h file.
+ * @details The components behave as the firmware uses them in TopDesign:<br>
+ *          - the sensor timers count the bus clock from the period sensor_isr writes, Timer_R1's terminal count runs
+ *            sensor_isr and each timer captures when its reflectance pin has discharged, sim_reflectance_set cycles
+ *            after it was released<br>
+ *          - a falling edge on Trig starts an HC-SR04 measurement, Timer captures both Echo edges at 800 kHz and
+ *            ultra_isr runs on the falling one<br>
+ *          - IR_receiver follows the NEC frames queued with sim_ir_nec and sim_ir_repeat<br>
+ *          - UART_1 sends at 115200 baud from a 4 byte FIFO, it has no TX interrupt<br>
+ *          Timers count down and load the period on terminal count like the UDB implementation. Only the timers with
+ *          an interrupt or a model attached schedule events, the others are computed when read.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hal.h"
+
+#define NO_SENSOR           0xFFu
+#define NO_IRQ              0xFFu
+#define CAPTURE_FIFO        4u
+#define UART_BYTE_CYCLES    (SIM_CLOCK_HZ * 10u / 115200u)
+#define UART_OUT_BUFFER     4096u
+#define UART_IN_BUFFER      256u
+#define ADC_CONVERSION      SIM_US(100)
+#define EEPROM_ROW_WRITE    SIM_MS(2)
+#define ECHO_DELAY          SIM_US(420)     // burst after the trigger's falling edge, before Echo goes high
+#define ECHO_TIMEOUT_US     38000u          // Echo width with nothing in range
+#define IR_EDGES            512u
+#define IR_FRAME_GAP        SIM_MS(40)
+
+struct pin_ {
+    const char *name;
+    uint8 out;                      // data register
+    uint8 in;                       // level from outside when not driven
+    uint8 mode;
+    uint8 sensor;                   // reflectance sensor on this pin
+    uint64 fall_at;                 // discharged at, kept until the next release
+    uint8 captured;
+    void (*on_fall)(void);          // model to run when the firmware writes the output from 1 to 0
+};
+
+struct timer_ {
+    uint32 divider;                 // bus clock cycles per count
+    uint16 period;
+    uint16 next_period;
+    uint16 compare1;
+    uint16 compare2;
+    uint8 tc_bit;
+    uint8 irq;
+    uint8 irq_always;               // isr wired to terminal count directly, not through the status register
+    uint8 running;
+    uint8 status;
+    uint8 int_mode;
+    int64 t0;                       // time the counter was last loaded with the period
+    uint16 fifo[CAPTURE_FIFO];
+    uint8 fifo_n;
+    uint16 capture;
+    struct pin_ *sensor_pin;
+    void (*on_tc)(void);
+    struct hal_event_ tc;
+};
+
+static uint32 reflectance[SIM_SENSORS] = { 6000, 6000, 6000, 6000 };
+static sim_reflectance_t reflectance_model = NULL;
+static uint32 ultra_mm = 0;
+static uint32 battery_mv = 4800;
+
+uint8 hal_eeprom[CY_EEPROM_SIZE];
+
+
+/* pins */
+static uint32 read_reflectance(uint8 sensor)
+{
+    return reflectance_model != NULL ? reflectance_model(sensor) : reflectance[sensor];
+}
+
+
+static uint8 pin_level(struct pin_ *pin)
+{
+    if(pin->mode == PIN_DM_STRONG) {
+        return pin->out;
+    }
+    if(pin->sensor != NO_SENSOR) {
+        return hal_time < pin->fall_at;
+    }
+    return pin->in;
+}
+
+
+/**
+* @brief    Changing a pin's drive mode
+* @details  a charged reflectance pin starts to discharge when it is released
+*/
+static void pin_drive(struct pin_ *pin, uint8 mode)
+{
+    if(pin->sensor != NO_SENSOR) {
+        if(mode == PIN_DM_STRONG) {
+            if(pin->fall_at > hal_time) {
+                pin->fall_at = HAL_NEVER;               // recharged before it fell, no capture
+            }
+        }
+        else if(pin->mode == PIN_DM_STRONG && pin->out) {
+            pin->fall_at = hal_time + read_reflectance(pin->sensor);
+            pin->captured = 0;
+        }
+    }
+    pin->mode = mode;
+}
+
+
+static void pin_write(struct pin_ *pin, uint8 value)
+{
+    uint8 was = pin->out;
+
+    pin->out = value & 1u;
+    if(was && !pin->out && pin->on_fall != NULL) {
+        pin->on_fall();
+    }
+}
+
+
+#define HAL_PIN(n, dm, level, sensor) \
+    static struct pin_ pin_##n = { #n, 0, level, dm, sensor, HAL_NEVER, 1, NULL }; \
+    void n##_Write(uint8 value) { hal_enter(); pin_write(&pin_##n, value); } \
+    uint8 n##_Read(void) { hal_enter(); return pin_level(&pin_##n); } \
+    uint8 n##_ReadDataReg(void) { hal_enter(); return pin_##n.out; } \
+    void n##_SetDriveMode(uint8 mode) { hal_enter(); pin_drive(&pin_##n, mode); }
+
+HAL_PIN(SW1, PIN_DM_RES_UP, 1u, NO_SENSOR)
+HAL_PIN(BatteryLed, PIN_DM_STRONG, 0u, NO_SENSOR)
+HAL_PIN(IR_led, PIN_DM_STRONG, 0u, NO_SENSOR)
+HAL_PIN(MotorDirLeft, PIN_DM_STRONG, 0u, NO_SENSOR)
+HAL_PIN(MotorDirRight, PIN_DM_STRONG, 0u, NO_SENSOR)
+HAL_PIN(L3, PIN_DM_DIG_HIZ, 0u, SIM_SENSOR_L3)
+HAL_PIN(L1, PIN_DM_DIG_HIZ, 0u, SIM_SENSOR_L1)
+HAL_PIN(R1, PIN_DM_DIG_HIZ, 0u, SIM_SENSOR_R1)
+HAL_PIN(R3, PIN_DM_DIG_HIZ, 0u, SIM_SENSOR_R3)
+HAL_PIN(Echo, PIN_DM_DIG_HIZ, 0u, NO_SENSOR)
+HAL_PIN(Trig, PIN_DM_STRONG, 0u, NO_SENSOR)
+HAL_PIN(IR_receiver, PIN_DM_DIG_HIZ, 1u, NO_SENSOR)
+
+static struct pin_ *const pins[] = {
+    &pin_SW1, &pin_BatteryLed, &pin_IR_led, &pin_MotorDirLeft, &pin_MotorDirRight,
+    &pin_L3, &pin_L1, &pin_R1, &pin_R3, &pin_Echo, &pin_Trig, &pin_IR_receiver,
+};
+
+
+static struct pin_ *find_pin(const char *name)
+{
+    uint32 i;
+
+    for(i = 0; i < sizeof(pins) / sizeof(pins[0]); i++) {
+        if(strcmp(pins[i]->name, name) == 0) {
+            return pins[i];
+        }
+    }
+    fprintf(stderr, "sim: no pin %s\n", name);
+    return NULL;
+}
+
+
+void sim_pin_input(const char *name, uint8 level)
+{
+    struct pin_ *pin = find_pin(name);
+
+    if(pin != NULL) {
+        pin->in = level & 1u;
+    }
+}
+
+
+uint8 sim_pin_output(const char *name)
+{
+    struct pin_ *pin = find_pin(name);
+
+    return pin != NULL ? pin_level(pin) : 0;
+}
+
+
+/* timers and PWMs */
+static uint16 counter_at(struct timer_ *t, uint64 at)
+{
+    int64 counts = ((int64)at - t->t0) / (int64)t->divider;
+    int64 length = (int64)t->period + 1;
+
+    counts %= length;
+    if(counts < 0) {
+        counts += length;
+    }
+    return (uint16)(t->period - counts);
+}
+
+
+static uint8 timer_needs_tc(struct timer_ *t)
+{
+    return t->irq != NO_IRQ || t->on_tc != NULL;
+}
+
+
+/**
+* @brief    Latching a reflectance capture
+* @details  the capture happens when the pin discharges, it is only worked out when the firmware looks or the
+*           counter is about to reload
+*/
+static void sensor_capture(struct timer_ *t)
+{
+    struct pin_ *pin = t->sensor_pin;
+
+    if(pin != NULL && !pin->captured && pin->fall_at <= hal_time) {
+        pin->captured = 1;
+        if(t->running) {
+            t->capture = counter_at(t, pin->fall_at);
+            t->status |= HAL_TIMER_STATUS_CAPTURE;
+        }
+    }
+}
+
+
+static void timer_tc(void *arg)
+{
+    struct timer_ *t = arg;
+
+    sensor_capture(t);
+    t->t0 = (int64)hal_time;
+    t->period = t->next_period;
+    t->status |= t->tc_bit;
+    hal_schedule(&t->tc, hal_time + (uint64)(t->period + 1u) * t->divider);
+    if(t->on_tc != NULL) {
+        t->on_tc();
+    }
+    if(t->irq != NO_IRQ && (t->irq_always || (t->int_mode & t->tc_bit))) {
+        hal_irq_raise(t->irq);
+    }
+}
+
+
+static void timer_start(struct timer_ *t)
+{
+    if(t->running) {
+        return;
+    }
+    t->running = 1;
+    t->t0 = (int64)hal_time;
+    if(timer_needs_tc(t)) {
+        t->tc.fn = timer_tc;
+        t->tc.arg = t;
+        hal_schedule(&t->tc, hal_time + (uint64)(t->period + 1u) * t->divider);
+    }
+}
+
+
+static void timer_stop(struct timer_ *t)
+{
+    t->running = 0;
+    hal_cancel(&t->tc);
+}
+
+
+static void timer_push_capture(struct timer_ *t)
+{
+    if(!t->running) {
+        return;
+    }
+    t->capture = counter_at(t, hal_time);
+    if(t->fifo_n < CAPTURE_FIFO) {
+        t->fifo[t->fifo_n++] = t->capture;
+    }
+}
+
+
+static uint8 timer_status(struct timer_ *t)
+{
+    uint8 status;
+
+    sensor_capture(t);
+    status = t->status;
+    if(t->fifo_n > 0) {
+        status |= HAL_TIMER_STATUS_FIFONEMP;
+    }
+    if(t->fifo_n == CAPTURE_FIFO) {
+        status |= HAL_TIMER_STATUS_FIFOFULL;
+    }
+    t->status = 0;
+    return status;
+}
+
+
+static uint16 timer_capture(struct timer_ *t)
+{
+    uint8 i;
+
+    sensor_capture(t);
+    if(t->fifo_n > 0) {
+        t->capture = t->fifo[0];
+        for(i = 1; i < t->fifo_n; i++) {
+            t->fifo[i - 1u] = t->fifo[i];
+        }
+        t->fifo_n--;
+    }
+    return t->capture;
+}
+
+
+/**
+* @brief    Writing the period
+* @details  a running timer loads it on the next terminal count, which a timer without events schedules for it
+*/
+static void timer_write_period(struct timer_ *t, uint16 period)
+{
+    t->next_period = period;
+    if(!t->running) {
+        t->period = period;
+    }
+    else if(!t->tc.active && period != t->period) {
+        t->tc.fn = timer_tc;
+        t->tc.arg = t;
+        hal_schedule(&t->tc, hal_time + (uint64)(counter_at(t, hal_time) + 1u) * t->divider);
+    }
+}
+
+
+static void timer_write_counter(struct timer_ *t, uint16 counter)
+{
+    t->t0 = (int64)hal_time - (int64)(t->period - counter) * t->divider;
+    if(t->running && (timer_needs_tc(t) || t->tc.active)) {
+        hal_schedule(&t->tc, hal_time + (uint64)(counter + 1u) * t->divider);
+    }
+}
+
+
+static uint16 timer_counter(struct timer_ *t)
+{
+    return t->running ? counter_at(t, hal_time) : t->period;
+}
+
+
+#define TIMER_INIT(div, per, bit, irq, always) \
+    { div, per, per, 0, 0, bit, irq, always, 0, 0, 0, 0, { 0 }, 0, 0, NULL, NULL, { 0 } }
+
+#define HAL_TIMER(n) \
+    void n##_Start(void) { hal_enter(); timer_start(&timer_##n); } \
+    void n##_Stop(void) { hal_enter(); timer_stop(&timer_##n); } \
+    uint8 n##_ReadStatusRegister(void) { hal_enter(); return timer_status(&timer_##n); } \
+    void n##_SetInterruptMode(uint8 interruptMode) { hal_enter(); timer_##n.int_mode = interruptMode; } \
+    uint16 n##_ReadCapture(void) { hal_enter(); return timer_capture(&timer_##n); } \
+    uint16 n##_ReadPeriod(void) { hal_enter(); return timer_##n.next_period; } \
+    void n##_WritePeriod(uint16 period) { hal_enter(); timer_write_period(&timer_##n, period); } \
+    uint16 n##_ReadCounter(void) { hal_enter(); return timer_counter(&timer_##n); } \
+    void n##_WriteCounter(uint16 counter) { hal_enter(); timer_write_counter(&timer_##n, counter); }
+
+#define HAL_PWM(n) \
+    void n##_Start(void) { hal_enter(); timer_start(&timer_##n); } \
+    void n##_Stop(void) { hal_enter(); timer_stop(&timer_##n); } \
+    uint8 n##_ReadStatusRegister(void) { hal_enter(); return timer_status(&timer_##n); } \
+    void n##_SetInterruptMode(uint8 interruptMode) { hal_enter(); timer_##n.int_mode = interruptMode; } \
+    void n##_WriteCompare(uint16 compare) { hal_enter(); timer_##n.compare1 = compare; } \
+    void n##_WriteCompare1(uint16 compare) { hal_enter(); timer_##n.compare1 = compare; } \
+    void n##_WriteCompare2(uint16 compare) { hal_enter(); timer_##n.compare2 = compare; } \
+    void n##_WritePeriod(uint16 period) { hal_enter(); timer_write_period(&timer_##n, period); } \
+    uint16 n##_ReadPeriod(void) { hal_enter(); return timer_##n.next_period; } \
+    uint16 n##_ReadCounter(void) { hal_enter(); return timer_counter(&timer_##n); }
+
+static struct timer_ timer_Timer_R1 = TIMER_INIT(1u, 23999u, HAL_TIMER_STATUS_TC, HAL_IRQ_SENSOR, 1u);
+static struct timer_ timer_Timer_R3 = TIMER_INIT(1u, 23999u, HAL_TIMER_STATUS_TC, NO_IRQ, 0u);
+static struct timer_ timer_Timer_L3 = TIMER_INIT(1u, 23999u, HAL_TIMER_STATUS_TC, NO_IRQ, 0u);
+static struct timer_ timer_Timer_L1 = TIMER_INIT(1u, 23999u, HAL_TIMER_STATUS_TC, NO_IRQ, 0u);
+static struct timer_ timer_Timer = TIMER_INIT(30u, 23319u, HAL_TIMER_STATUS_TC, NO_IRQ, 0u);
+static struct timer_ timer_PWM = TIMER_INIT(24u, 255u, HAL_PWM_STATUS_TC, NO_IRQ, 0u);
+static struct timer_ timer_Buzzer_PWM = TIMER_INIT(120u, 255u, HAL_PWM_STATUS_TC, NO_IRQ, 0u);
+
+HAL_TIMER(Timer_R1)
+HAL_TIMER(Timer_R3)
+HAL_TIMER(Timer_L3)
+HAL_TIMER(Timer_L1)
+HAL_TIMER(Timer)
+HAL_PWM(PWM)
+HAL_PWM(Buzzer_PWM)
+
+
+void sim_reflectance_set(uint8 sensor, uint32 ticks)
+{
+    reflectance[sensor] = ticks;
+}
+
+
+void sim_reflectance_model(sim_reflectance_t model)
+{
+    reflectance_model = model;
+}
+
+
+void sim_motor(int16 *left, int16 *right)
+{
+    int16 l = timer_PWM.running ? (int16)timer_PWM.compare1 : 0;
+    int16 r = timer_PWM.running ? (int16)timer_PWM.compare2 : 0;
+
+    *left = pin_MotorDirLeft.out ? -l : l;
+    *right = pin_MotorDirRight.out ? -r : r;
+}
+
+
+void sim_buzzer(uint32 *hz)
+{
+    struct timer_ *t = &timer_Buzzer_PWM;
+
+    *hz = t->running && t->compare1 > 0 ? SIM_CLOCK_HZ / t->divider / (t->next_period + 1u) : 0;
+}
+
+
+/* HC-SR04 on Trig, Echo and Timer */
+static struct hal_event_ echo_rise;
+static struct hal_event_ echo_fall;
+
+
+static void echo_edge(void *arg)
+{
+    pin_Echo.in = arg == &echo_rise;
+    timer_push_capture(&timer_Timer);
+    if(!pin_Echo.in) {
+        hal_irq_raise(HAL_IRQ_ULTRA);
+    }
+}
+
+
+static void ultra_trigger(void)
+{
+    uint32 width_us = ultra_mm ? ultra_mm * 2000u / 343u : ECHO_TIMEOUT_US;
+
+    if(width_us > ECHO_TIMEOUT_US) {
+        width_us = ECHO_TIMEOUT_US;
+    }
+    echo_rise.fn = echo_edge;
+    echo_rise.arg = &echo_rise;
+    echo_fall.fn = echo_edge;
+    echo_fall.arg = &echo_fall;
+    hal_schedule(&echo_rise, hal_time + ECHO_DELAY);
+    hal_schedule(&echo_fall, hal_time + ECHO_DELAY + SIM_US(width_us));
+}
+
+
+__attribute__((constructor)) static void hal_peripherals_init(void)
+{
+    pin_Trig.on_fall = ultra_trigger;
+    timer_Timer_R1.sensor_pin = &pin_R1;
+    timer_Timer_R3.sensor_pin = &pin_R3;
+    timer_Timer_L3.sensor_pin = &pin_L3;
+    timer_Timer_L1.sensor_pin = &pin_L1;
+}
+
+
+void sim_ultra_distance(uint32 mm)
+{
+    ultra_mm = mm;
+}
+
+
+/* TSOP receiver on IR_receiver */
+static struct {
+    uint64 at[IR_EDGES];
+    uint8 level[IR_EDGES];
+    uint16 head;
+    uint16 tail;
+    uint64 end;                     // end of the last queued frame
+    struct hal_event_ edge;
+} ir;
+
+
+static void ir_edge(void *arg)
+{
+    (void)arg;
+    while(ir.tail != ir.head && ir.at[ir.tail] <= hal_time) {
+        pin_IR_receiver.in = ir.level[ir.tail];
+        ir.tail = (ir.tail + 1u) % IR_EDGES;
+    }
+    if(ir.tail != ir.head) {
+        hal_schedule(&ir.edge, ir.at[ir.tail]);
+    }
+}
+
+
+static uint64 ir_push(uint64 at, uint8 level)
+{
+    uint16 next = (ir.head + 1u) % IR_EDGES;
+
+    if(next != ir.tail) {
+        ir.at[ir.head] = at;
+        ir.level[ir.head] = level;
+        ir.head = next;
+    }
+    return at;
+}
+
+
+/**
+* @brief    Queueing a burst and the space after it
+* @details  the receiver output is low during the burst
+*/
+static uint64 ir_pulse(uint64 at, uint32 mark_us, uint32 space_us)
+{
+    ir_push(at, 0);
+    ir_push(at + SIM_US(mark_us), 1);
+    return at + SIM_US(mark_us + space_us);
+}
+
+
+static uint64 ir_frame_start(void)
+{
+    return ir.end + IR_FRAME_GAP > hal_time ? ir.end + IR_FRAME_GAP : hal_time;
+}
+
+
+static void ir_send(uint64 end)
+{
+    ir.end = end;
+    ir.edge.fn = ir_edge;
+    if(!ir.edge.active) {
+        hal_schedule(&ir.edge, ir.at[ir.tail]);
+    }
+}
+
+
+void sim_ir_nec(uint16 address, uint8 command)
+{
+    uint32 bits = address > 0xFFu ? address : (uint32)(address | (uint8)~address << 8);
+    uint64 at = ir_frame_start();
+    uint8 i;
+
+    bits |= (uint32)command << 16 | (uint32)(uint8)~command << 24;
+    at = ir_pulse(at, 9000, 4500);
+    for(i = 0; i < 32; i++) {
+        at = ir_pulse(at, 560, (bits >> i) & 1u ? 1690 : 560);
+    }
+    at = ir_pulse(at, 560, 0);
+    ir_send(at);
+}
+
+
+void sim_ir_repeat(void)
+{
+    uint64 at = ir_frame_start();
+
+    at = ir_pulse(at, 9000, 2250);
+    at = ir_pulse(at, 560, 0);
+    ir_send(at);
+}
+
+
+/* UART_1 */
+static struct {
+    uint8 fifo[UART_1_TX_BUFFER_SIZE];
+    uint8 fifo_n;
+    uint8 shifting;
+    uint8 shift;
+    uint8 complete;
+    uint8 out[UART_OUT_BUFFER];
+    uint32 out_n;
+    uint32 sent;
+    uint8 in[UART_IN_BUFFER];
+    uint16 in_head;
+    uint16 in_tail;
+    struct hal_event_ byte_done;
+} uart;
+
+
+static void uart_stdout(const uint8 *data, uint32 len)
+{
+    while(len > 0) {
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        if(n <= 0) {
+            return;
+        }
+        data += n;
+        len -= (uint32)n;
+    }
+}
+
+static sim_uart_t uart_output = uart_stdout;
+
+
+void hal_uart_flush(void)
+{
+    if(uart.out_n > 0 && uart_output != NULL) {
+        uart_output(uart.out, uart.out_n);
+    }
+    uart.out_n = 0;
+}
+
+
+static uint8 uart_tx_status(void)
+{
+    uint8 status = uart.complete ? UART_1_TX_STS_COMPLETE : 0;
+
+    if(uart.fifo_n == 0) {
+        status |= UART_1_TX_STS_FIFO_EMPTY;
+    }
+    if(uart.fifo_n < UART_1_TX_BUFFER_SIZE) {
+        status |= UART_1_TX_STS_FIFO_NOT_FULL;
+    }
+    else {
+        status |= UART_1_TX_STS_FIFO_FULL;
+    }
+    return status;
+}
+
+
+static void uart_load(void)
+{
+    uint8 i;
+
+    if(uart.shifting || uart.fifo_n == 0) {
+        return;
+    }
+    uart.shift = uart.fifo[0];
+    for(i = 1; i < uart.fifo_n; i++) {
+        uart.fifo[i - 1u] = uart.fifo[i];
+    }
+    uart.fifo_n--;
+    uart.shifting = 1;
+    hal_schedule(&uart.byte_done, hal_time + UART_BYTE_CYCLES);
+}
+
+
+static void uart_byte_done(void *arg)
+{
+    (void)arg;
+    uart.shifting = 0;
+    uart.complete = 1;
+    uart.sent++;
+    uart.out[uart.out_n++] = uart.shift;
+    if(uart.out_n == UART_OUT_BUFFER) {
+        hal_uart_flush();
+    }
+    uart_load();
+}
+
+
+void UART_1_Start(void)
+{
+    hal_enter();
+    uart.byte_done.fn = uart_byte_done;
+}
+
+
+void UART_1_Stop(void)
+{
+    hal_enter();
+}
+
+
+uint8 UART_1_ReadTxStatus(void)
+{
+    uint8 status;
+
+    hal_enter();
+    status = uart_tx_status();
+    uart.complete = 0;
+    return status;
+}
+
+
+void UART_1_WriteTxData(uint8 txDataByte)
+{
+    hal_enter();
+    if(uart.fifo_n < UART_1_TX_BUFFER_SIZE) {
+        uart.fifo[uart.fifo_n++] = txDataByte;
+    }
+    uart_load();
+}
+
+
+void UART_1_PutChar(uint8 txDataByte)
+{
+    hal_enter();
+    while(uart.fifo_n == UART_1_TX_BUFFER_SIZE) {
+        hal_wait_event();
+    }
+    UART_1_WriteTxData(txDataByte);
+}
+
+
+void UART_1_PutString(const char8 string[])
+{
+    while(*string) {
+        UART_1_PutChar((uint8)*string++);
+    }
+}
+
+
+void UART_1_PutArray(const uint8 string[], uint8 byteCount)
+{
+    while(byteCount--) {
+        UART_1_PutChar(*string++);
+    }
+}
+
+
+uint8 UART_1_GetChar(void)
+{
+    uint8 c = 0;
+
+    hal_enter();
+    if(uart.in_tail != uart.in_head) {
+        c = uart.in[uart.in_tail];
+        uart.in_tail = (uart.in_tail + 1u) % UART_IN_BUFFER;
+    }
+    return c;
+}
+
+
+void sim_uart_output(sim_uart_t output)
+{
+    hal_uart_flush();
+    uart_output = output;
+}
+
+
+void sim_uart_input(const uint8 *data, uint32 len)
+{
+    while(len--) {
+        uint16 next = (uart.in_head + 1u) % UART_IN_BUFFER;
+        if(next == uart.in_tail) {
+            return;
+        }
+        uart.in[uart.in_head] = *data++;
+        uart.in_head = next;
+    }
+}
+
+
+uint32 sim_uart_sent(void)
+{
+    return uart.sent;
+}
+
+
+/* ADC_Battery, 12 bits over 5 V behind a 2/3 divider */
+static uint64 adc_done_at = HAL_NEVER;
+
+
+void ADC_Battery_Start(void)
+{
+    hal_enter();
+}
+
+
+void ADC_Battery_Stop(void)
+{
+    hal_enter();
+}
+
+
+void ADC_Battery_StartConvert(void)
+{
+    hal_enter();
+    adc_done_at = hal_time + ADC_CONVERSION;
+}
+
+
+void ADC_Battery_StopConvert(void)
+{
+    hal_enter();
+}
+
+
+uint8 ADC_Battery_IsEndConversion(uint8 retMode)
+{
+    hal_enter();
+    if(adc_done_at == HAL_NEVER) {
+        return 0;
+    }
+    if(retMode == ADC_Battery_WAIT_FOR_RESULT && hal_time < adc_done_at) {
+        hal_wait_until(adc_done_at);
+    }
+    return hal_time >= adc_done_at;
+}
+
+
+uint16 ADC_Battery_GetResult16(void)
+{
+    hal_enter();
+    return (uint16)(battery_mv * 819u / 1500u);
+}
+
+
+void sim_battery_mv(uint32 mv)
+{
+    battery_mv = mv;
+}
+
+
+/* EEPROM */
+void CyEEPROM_Start(void)
+{
+    hal_enter();
+}
+
+
+void CyEEPROM_Stop(void)
+{
+    hal_enter();
+}
+
+
+void CyEEPROM_ReadReserve(void)
+{
+    hal_enter();
+}
+
+
+void CyEEPROM_ReadRelease(void)
+{
+    hal_enter();
+}
+
+
+cystatus CySetTemp(void)
+{
+    hal_enter();
+    return CYRET_SUCCESS;
+}
+
+
+cystatus CyWriteRowData(uint8 arrayId, uint16 rowAddress, const uint8 *rowData)
+{
+    hal_enter();
+    if(arrayId != CY_SPC_FIRST_EE_ARRAYID || rowAddress >= CY_EEPROM_SIZE / CY_EEPROM_SIZEOF_ROW) {
+        return CYRET_BAD_PARAM;
+    }
+    memcpy(&hal_eeprom[rowAddress * CY_EEPROM_SIZEOF_ROW], rowData, CY_EEPROM_SIZEOF_ROW);
+    hal_wait_until(hal_time + EEPROM_ROW_WRITE);
+    return CYRET_SUCCESS;
+}
+
+
+int sim_eeprom_load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    size_t n;
+
+    if(f == NULL) {
+        return 0;
+    }
+    n = fread(hal_eeprom, 1, sizeof(hal_eeprom), f);
+    fclose(f);
+    return n > 0;
+}
+
+
+int sim_eeprom_save(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    size_t n;
+
+    if(f == NULL) {
+        return 0;
+    }
+    n = fwrite(hal_eeprom, 1, sizeof(hal_eeprom), f);
+    fclose(f);
+    return n == sizeof(hal_eeprom);
+}
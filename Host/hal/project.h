@@ -0,0 +1,281 @@
+/**
+ * @file    project.h
+ * @brief   Host replacement for the PSoC Creator generated project.h
+ * @details Declares the cytypes, the Cy* library calls and the generated component APIs that ZumoLibrary and main.c
+ *          use, so they compile unmodified on Linux. The components are simulated in hal_core.c, hal_peripherals.c
+ *          and hal_i2c.c against a virtual bus clock; sim.h is the interface a host program uses to drive them.<br>
+ *          Only what the firmware calls is declared. A new component or API in TopDesign needs a declaration here
+ *          and a model in one of the hal_*.c files.
+*/
+#ifndef PROJECT_H_
+#define PROJECT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* cytypes.h, uint32 and int32 are long as on the target, which makes them 64 bits on an LP64 host. Host code that
+   needs 32 bit wrap or sign extension uses uint32_t and int32_t. */
+typedef uint8_t     uint8;
+typedef uint16_t    uint16;
+typedef unsigned long uint32;
+typedef uint64_t    uint64;
+typedef int8_t      int8;
+typedef int16_t     int16;
+typedef signed long int32;
+typedef int64_t     int64;
+typedef float       float32;
+typedef double      float64;
+typedef unsigned char char8;
+typedef uint32      cystatus;
+typedef volatile uint8  reg8;
+typedef volatile uint16 reg16;
+typedef volatile uint32 reg32;
+typedef void (*cyisraddress)(void);
+
+#define CY_ISR(FuncName)        void FuncName(void)
+#define CY_ISR_PROTO(FuncName)  void FuncName(void)
+
+#define CYRET_SUCCESS           (0x00u)
+#define CYRET_BAD_PARAM         (0x01u)
+#define CYRET_UNKNOWN           ((cystatus)0xFFFFFFFFu)
+
+#define BCLK__BUS_CLK__HZ       24000000U
+
+/* CyLib.h */
+#define CyGlobalIntEnable       do { hal_global_int(1u); } while(0)
+#define CyGlobalIntDisable      do { hal_global_int(0u); } while(0)
+
+void hal_global_int(uint8 enable);
+uint8 CyEnterCriticalSection(void);
+void CyExitCriticalSection(uint8 savedIntrStatus);
+void CyDelay(uint32 milliseconds);
+void CyDelayUs(uint16 microseconds);
+
+/* CyLib.h NVIC lines, a line with no component on it can be pended from software */
+extern reg32 hal_nvic_pending;
+#define CY_INT_SET_PEND_PTR     (&hal_nvic_pending)
+
+cyisraddress CyIntSetVector(uint8 number, cyisraddress address);
+cyisraddress CyIntGetVector(uint8 number);
+void CyIntSetPriority(uint8 number, uint8 priority);
+uint8 CyIntGetPriority(uint8 number);
+void CyIntEnable(uint8 number);
+void CyIntDisable(uint8 number);
+void CyIntSetPending(uint8 number);
+void CyIntClearPending(uint8 number);
+
+typedef void (*cySysTickCallback)(void);
+
+#define CY_SYS_SYST_CSR_CLK_SRC_SYSCLK      ((uint32) (1u))
+#define CY_SYS_SYST_CSR_CLK_SRC_LFCLK       ((uint32) (0u))
+#define CY_SYS_SYST_NUM_OF_CALLBACKS        ((uint32) (5u))
+
+void CySysTickStart(void);
+void CySysTickInit(void);
+void CySysTickEnable(void);
+void CySysTickStop(void);
+void CySysTickEnableInterrupt(void);
+void CySysTickDisableInterrupt(void);
+void CySysTickSetReload(uint32 value);
+uint32 CySysTickGetReload(void);
+uint32 CySysTickGetValue(void);
+cySysTickCallback CySysTickSetCallback(uint32 number, cySysTickCallback function);
+cySysTickCallback CySysTickGetCallback(uint32 number);
+void CySysTickSetClockSource(uint32 clockSource);
+uint32 CySysTickGetCountFlag(void);
+void CySysTickClear(void);
+
+/* core_cm3.h, only the SysTick pending bit is kept up to date */
+struct hal_scb_ {
+    volatile uint32 ICSR;
+};
+extern struct hal_scb_ hal_scb;
+#define SCB                         (&hal_scb)
+#define SCB_ICSR_PENDSTSET_Pos      26U
+#define SCB_ICSR_PENDSTSET_Msk      (1UL << SCB_ICSR_PENDSTSET_Pos)
+
+/* core_cm3.h, the DWT cycle counter follows the virtual bus clock once TRCENA and CYCCNTENA are set */
+struct hal_dwt_ {
+    volatile uint32 CTRL;
+    volatile uint32 CYCCNT;
+};
+struct hal_core_debug_ {
+    volatile uint32 DEMCR;
+};
+extern struct hal_dwt_ hal_dwt;
+extern struct hal_core_debug_ hal_core_debug;
+#define DWT                         (&hal_dwt)
+#define CoreDebug                   (&hal_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+
+/* CyFlash.h / CySpc.h */
+#define CY_EEPROM_SIZEOF_ROW        (16u)
+#define CY_EEPROM_SIZE              (2048u)
+#define CY_EEPROM_BASE              (hal_eeprom)
+#define CY_SPC_FIRST_EE_ARRAYID     (0x40u)
+
+extern uint8 hal_eeprom[CY_EEPROM_SIZE];
+void CyEEPROM_Start(void);
+void CyEEPROM_Stop(void);
+void CyEEPROM_ReadReserve(void);
+void CyEEPROM_ReadRelease(void);
+cystatus CySetTemp(void);
+cystatus CyWriteRowData(uint8 arrayId, uint16 rowAddress, const uint8 *rowData);
+
+/* Interrupt components */
+#define HAL_ISR_API(n) \
+    void n##_Start(void); \
+    void n##_StartEx(cyisraddress address); \
+    void n##_Stop(void); \
+    void n##_Enable(void); \
+    void n##_Disable(void); \
+    void n##_SetPriority(uint8 priority); \
+    uint8 n##_GetPriority(void); \
+    void n##_SetPending(void); \
+    void n##_ClearPending(void);
+
+HAL_ISR_API(sensor_isr)
+HAL_ISR_API(ultra_isr)
+
+/* Pins */
+#define PIN_DM_ALG_HIZ      (0x00u)
+#define PIN_DM_DIG_HIZ      (0x02u)
+#define PIN_DM_RES_UP       (0x04u)
+#define PIN_DM_RES_DWN      (0x06u)
+#define PIN_DM_OD_LO        (0x08u)
+#define PIN_DM_OD_HI        (0x0Au)
+#define PIN_DM_STRONG       (0x0Cu)
+#define PIN_DM_RES_UPDWN    (0x0Eu)
+
+#define HAL_PIN_API(n) \
+    void n##_Write(uint8 value); \
+    uint8 n##_Read(void); \
+    uint8 n##_ReadDataReg(void); \
+    void n##_SetDriveMode(uint8 mode);
+
+HAL_PIN_API(SW1)
+HAL_PIN_API(BatteryLed)
+HAL_PIN_API(IR_led)
+HAL_PIN_API(MotorDirLeft)
+HAL_PIN_API(MotorDirRight)
+HAL_PIN_API(R1)
+HAL_PIN_API(R3)
+HAL_PIN_API(L3)
+HAL_PIN_API(L1)
+HAL_PIN_API(Echo)
+HAL_PIN_API(Trig)
+HAL_PIN_API(IR_receiver)
+
+/* Timers, counting down from the period like the UDB timer */
+#define HAL_TIMER_STATUS_TC         (0x01u)
+#define HAL_TIMER_STATUS_CAPTURE    (0x02u)
+#define HAL_TIMER_STATUS_FIFOFULL   (0x04u)
+#define HAL_TIMER_STATUS_FIFONEMP   (0x08u)
+
+#define HAL_TIMER_API(n) \
+    void n##_Start(void); \
+    void n##_Stop(void); \
+    uint8 n##_ReadStatusRegister(void); \
+    void n##_SetInterruptMode(uint8 interruptMode); \
+    uint16 n##_ReadCapture(void); \
+    uint16 n##_ReadPeriod(void); \
+    void n##_WritePeriod(uint16 period); \
+    uint16 n##_ReadCounter(void); \
+    void n##_WriteCounter(uint16 counter);
+
+HAL_TIMER_API(Timer_R1)
+HAL_TIMER_API(Timer_R3)
+HAL_TIMER_API(Timer_L3)
+HAL_TIMER_API(Timer_L1)
+HAL_TIMER_API(Timer)
+
+#define Timer_R1_STATUS_CAPTURE         HAL_TIMER_STATUS_CAPTURE
+#define Timer_R3_STATUS_CAPTURE         HAL_TIMER_STATUS_CAPTURE
+#define Timer_L3_STATUS_CAPTURE         HAL_TIMER_STATUS_CAPTURE
+#define Timer_L1_STATUS_CAPTURE         HAL_TIMER_STATUS_CAPTURE
+#define Timer_STATUS_FIFONEMP           HAL_TIMER_STATUS_FIFONEMP
+
+/* PWMs */
+#define HAL_PWM_STATUS_TC               (0x08u)
+
+#define HAL_PWM_API(n) \
+    void n##_Start(void); \
+    void n##_Stop(void); \
+    uint8 n##_ReadStatusRegister(void); \
+    void n##_SetInterruptMode(uint8 interruptMode); \
+    void n##_WriteCompare(uint16 compare); \
+    void n##_WriteCompare1(uint16 compare); \
+    void n##_WriteCompare2(uint16 compare); \
+    void n##_WritePeriod(uint16 period); \
+    uint16 n##_ReadPeriod(void); \
+    uint16 n##_ReadCounter(void);
+
+HAL_PWM_API(PWM)
+HAL_PWM_API(Buzzer_PWM)
+
+
+/* UART_1 */
+#define UART_1_TX_STS_COMPLETE          (0x01u)
+#define UART_1_TX_STS_FIFO_EMPTY        (0x02u)
+#define UART_1_TX_STS_FIFO_FULL         (0x04u)
+#define UART_1_TX_STS_FIFO_NOT_FULL     (0x08u)
+#define UART_1_TX_BUFFER_SIZE           (4u)
+
+void UART_1_Start(void);
+void UART_1_Stop(void);
+uint8 UART_1_ReadTxStatus(void);
+void UART_1_WriteTxData(uint8 txDataByte);
+void UART_1_PutChar(uint8 txDataByte);
+void UART_1_PutString(const char8 string[]);
+void UART_1_PutArray(const uint8 string[], uint8 byteCount);
+uint8 UART_1_GetChar(void);
+
+/* ADC_Battery */
+#define ADC_Battery_RETURN_STATUS       (0x01u)
+#define ADC_Battery_WAIT_FOR_RESULT     (0x00u)
+
+void ADC_Battery_Start(void);
+void ADC_Battery_Stop(void);
+void ADC_Battery_StartConvert(void);
+void ADC_Battery_StopConvert(void);
+uint8 ADC_Battery_IsEndConversion(uint8 retMode);
+uint16 ADC_Battery_GetResult16(void);
+
+/* I2C master */
+#define I2C_MODE_COMPLETE_XFER      (0x00u)
+#define I2C_MODE_REPEAT_START       (0x01u)
+#define I2C_MODE_NO_STOP            (0x02u)
+
+#define I2C_MSTAT_CLEAR             (0x00u)
+#define I2C_MSTAT_RD_CMPLT          (0x01u)
+#define I2C_MSTAT_WR_CMPLT          (0x02u)
+#define I2C_MSTAT_XFER_INP          (0x04u)
+#define I2C_MSTAT_XFER_HALT         (0x08u)
+#define I2C_MSTAT_ERR_MASK          (0xF0u)
+#define I2C_MSTAT_ERR_SHORT_XFER    (0x10u)
+#define I2C_MSTAT_ERR_ADDR_NAK      (0x20u)
+#define I2C_MSTAT_ERR_ARB_LOST      (0x40u)
+#define I2C_MSTAT_ERR_XFER          (0x80u)
+
+#define I2C_MSTR_NO_ERROR           (0x00u)
+#define I2C_MSTR_BUS_BUSY           (0x01u)
+#define I2C_MSTR_NOT_READY          (0x02u)
+#define I2C_MSTR_ERR_LB_NAK         (0x03u)
+#define I2C_MSTR_ERR_ARB_LOST       (0x04u)
+#define I2C_MSTR_ERR_ABORT_START_GEN (0x05u)
+
+#define I2C_ISR_NUMBER              (15u)
+#define I2C_ISR_PRIORITY            (7u)
+
+void I2C_Start(void);
+void I2C_Stop(void);
+uint8 I2C_MasterStatus(void);
+uint8 I2C_MasterClearStatus(void);
+uint8 I2C_MasterWriteBuf(uint8 slaveAddress, uint8 *wrData, uint8 cnt, uint8 mode);
+uint8 I2C_MasterReadBuf(uint8 slaveAddress, uint8 *rdData, uint8 cnt, uint8 mode);
+uint8 I2C_MasterSendStop(void);
+
+#include "cyapicallbacks.h"
+
+#endif
@@ -0,0 +1,93 @@
+/**
+ * @file    sim.h
+ * @brief   Host simulation interface
+ * @details Drives the simulated PSoC components that project.h declares. Time is virtual: it is counted in bus clock
+ *          cycles and only advances when the firmware calls a component API (each call costs sim_set_call_cost
+ *          cycles), waits in CyDelay, or busy-waits on a variable an interrupt must change. Interrupts are taken
+ *          between component calls in priority order, so a run gives the same result every time.<br>
+ *          A host program sets up the outside world with the sim_* calls, then runs the firmware with sim_run. The
+ *          component state is global, so one process runs one simulation.
+*/
+#ifndef SIM_H_
+#define SIM_H_
+#include <project.h>
+
+#define SIM_CLOCK_HZ        BCLK__BUS_CLK__HZ
+#define SIM_US(us)          ((uint64)(us) * (SIM_CLOCK_HZ / 1000000u))
+#define SIM_MS(ms)          ((uint64)(ms) * (SIM_CLOCK_HZ / 1000u))
+
+/* Reflectance sensors wired to the sensor timers */
+#define SIM_SENSOR_L3       0u
+#define SIM_SENSOR_L1       1u
+#define SIM_SENSOR_R1       2u
+#define SIM_SENSOR_R3       3u
+#define SIM_SENSORS         4u
+
+typedef void (*sim_event_t)(void *arg);
+typedef int (*sim_entry_t)(void);
+typedef uint32 (*sim_reflectance_t)(uint8 sensor);
+typedef void (*sim_uart_t)(const uint8 *data, uint32 len);
+
+/**
+* @brief    Simulated I2C slave
+* @details  write gets the bytes of a write transfer, read fills the bytes of a read transfer. Either returns 0 to NAK
+*           the address. A repeated start shows as a write followed by a read.
+*/
+struct sim_i2c_device_ {
+    uint8 addr;
+    int (*write)(struct sim_i2c_device_ *dev, const uint8 *data, uint32 len);
+    int (*read)(struct sim_i2c_device_ *dev, uint8 *data, uint32 len);
+    void *ctx;
+    struct sim_i2c_device_ *next;
+};
+
+/**
+* @brief    Register file I2C slave
+* @details  The first written byte selects the register, the following ones are stored from there. Registers are
+*           read from the selected one on. The pointer moves on after each byte when the select byte had the
+*           auto_increment bit set (0x80 on the ST sensors), or always when auto_increment is 0. before_read runs
+*           before a register is read, so a model can fill in fresh data.
+*/
+struct sim_i2c_regs_ {
+    struct sim_i2c_device_ dev;
+    uint8 regs[256];
+    uint8 reg;
+    uint8 increment;
+    uint8 auto_increment;
+    void (*before_read)(struct sim_i2c_regs_ *regs, uint8 reg);
+    void (*after_write)(struct sim_i2c_regs_ *regs, uint8 reg);
+};
+
+/* time and running */
+uint64 sim_now(void);
+uint64 sim_now_us(void);
+void sim_set_call_cost(uint32 cycles);
+void sim_after(uint64 cycles, sim_event_t fn, void *arg);
+void sim_every(uint64 period, sim_event_t fn, void *arg);
+int sim_run(sim_entry_t entry, uint64 limit);
+int sim_advance(uint64 cycles);
+void sim_stop(void);
+uint32 sim_interrupts(void);
+
+/* outside world */
+void sim_pin_input(const char *name, uint8 level);
+uint8 sim_pin_output(const char *name);
+void sim_motor(int16 *left, int16 *right);
+void sim_reflectance_set(uint8 sensor, uint32 ticks);
+void sim_reflectance_model(sim_reflectance_t model);
+void sim_ultra_distance(uint32 mm);
+void sim_ir_nec(uint16 address, uint8 command);
+void sim_ir_repeat(void);
+void sim_battery_mv(uint32 mv);
+void sim_buzzer(uint32 *hz);
+void sim_uart_output(sim_uart_t output);
+void sim_uart_input(const uint8 *data, uint32 len);
+uint32 sim_uart_sent(void);
+int sim_eeprom_load(const char *path);
+int sim_eeprom_save(const char *path);
+
+/* I2C bus */
+void sim_i2c_attach(struct sim_i2c_device_ *dev);
+void sim_i2c_regs_init(struct sim_i2c_regs_ *regs, uint8 addr, uint8 auto_increment);
+
+#endif
@@ -0,0 +1,161 @@
+/**
+ * @file    ir_test.c
+ * @brief   NEC decoder of IR.c on a synthetic receiver signal
+ * @details Builds the receiver output of NEC frames, repeat codes and broken frames as marks and spaces, with every
+ *          width off by up to JITTER_PERCENT and the marks stretched by MARK_STRETCH_US like a TSOP receiver does, and
+ *          samples it every SYSTIME_SERVICE_US from a random phase into ir_sample. The decoded commands must be the
+ *          frames that were sent: 8-bit and 16-bit extended addresses, a repeat for every repeat code that follows a
+ *          good frame, nothing for a frame whose command inverse is wrong.<br>
+ *          Build and run: make check (see Makefile)<br>
+ *          The exit status is 1 if a command is missing, wrong or extra.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "IR.h"
+#include "SysTime.h"
+
+#define FRAMES              2000
+#define JITTER_PERCENT      10
+#define MARK_STRETCH_US     100         // the receiver output stays low a little longer than the burst
+#define FRAME_GAP_US        40000       // idle after a frame or a repeat code
+#define MAX_EDGES           80
+
+struct signal_ {
+    uint32 width[MAX_EDGES];            // alternating mark (receiver low) and space (high), starting with a mark
+    int n;
+};
+
+static uint32 rng = 1;
+static uint32 phase;                    // time of the next sample within the signal, microseconds
+
+
+static uint32 random_below(uint32 n)
+{
+    rng = rng * 1664525u + 1013904223u;
+    return (rng >> 8) % n;
+}
+
+
+/**
+* @brief    Adding a mark and the space after it
+* @details  widths in microseconds before jitter
+*/
+static void add(struct signal_ *s, uint32 mark, uint32 space)
+{
+    int32 jm = (int32)(mark * JITTER_PERCENT / 100u), js = (int32)(space * JITTER_PERCENT / 100u);
+
+    s->width[s->n++] = mark + MARK_STRETCH_US + random_below(2 * jm + 1) - jm;
+    s->width[s->n++] = space - MARK_STRETCH_US + random_below(2 * js + 1) - js;
+}
+
+
+static void nec_frame(struct signal_ *s, uint32 bits)
+{
+    int i;
+
+    s->n = 0;
+    add(s, 9000, 4500);
+    for(i = 0; i < 32; i++) {
+        add(s, 560, bits >> i & 1u ? 1690 : 560);
+    }
+    add(s, 560, FRAME_GAP_US);
+}
+
+
+static void nec_repeat(struct signal_ *s)
+{
+    s->n = 0;
+    add(s, 9000, 2250);
+    add(s, 560, FRAME_GAP_US + 55000);
+}
+
+
+/**
+* @brief    Sampling a signal into the decoder
+* @details  the receiver level every SYSTIME_SERVICE_US, continuing from where the previous signal left off
+*/
+static void play(const struct signal_ *s)
+{
+    uint32 start = 0;
+    int i;
+
+    for(i = 0; i < s->n; i++) {
+        for(; phase < start + s->width[i]; phase += SYSTIME_SERVICE_US) {
+            ir_sample(i % 2 ? 1 : 0);
+        }
+        start += s->width[i];
+    }
+    phase -= start;
+}
+
+
+static uint32 nec_bits(uint16 address, uint8 command, int extended, int broken)
+{
+    uint32 a = extended ? address : (uint32)(address & 0xFF) | (uint32)(~address & 0xFF) << 8;
+    uint8 inverse = broken ? (uint8)~command ^ (uint8)(1u << random_below(8)) : (uint8)~command;
+
+    return a | (uint32)command << 16 | (uint32)inverse << 24;
+}
+
+
+int main(void)
+{
+    struct signal_ s;
+    struct ir_command_ cmd;
+    int sent = 0, repeats = 0, wrong = 0, i, r;
+    uint32 broken_errors;
+
+    phase = random_below(SYSTIME_SERVICE_US);
+    for(i = 0; i < FRAMES; i++) {
+        int extended = random_below(4) == 0, broken = random_below(8) == 0;
+        uint16 address = extended ? (uint16)random_below(0x10000) : (uint16)random_below(0x100);
+        uint8 command = (uint8)random_below(0x100);
+        uint32 bits = nec_bits(address, command, extended, broken);
+        int n_repeat = random_below(3);
+
+        /* an extended address that happens to have a valid inverse decodes as an 8-bit one */
+        if(extended && (uint8)(address ^ address >> 8) == 0xFF) {
+            address &= 0xFF;
+        }
+        broken_errors = ir_errors();
+        nec_frame(&s, bits);
+        play(&s);
+        for(r = 0; r < n_repeat; r++) {
+            nec_repeat(&s);
+            play(&s);
+        }
+
+        if(broken) {
+            if(ir_get_command(&cmd) || ir_errors() == broken_errors) {
+                printf("frame %d: command inverse wrong, but the frame was not rejected\n", i);
+                wrong++;
+            }
+            ir_flush();
+            continue;
+        }
+        for(r = 0; r <= n_repeat; r++) {
+            if(!ir_get_command(&cmd)) {
+                printf("frame %d: %s missing\n", i, r ? "repeat" : "command");
+                wrong++;
+                break;
+            }
+            if(cmd.address != address || cmd.command != command || cmd.repeat != (r > 0) || cmd.raw != bits) {
+                printf("frame %d: got address %04X command %02X repeat %d raw %08lX, sent %04X %02X %d %08lX\n", i,
+                       cmd.address, cmd.command, cmd.repeat, (unsigned long)cmd.raw, address, command, r > 0,
+                       (unsigned long)bits);
+                wrong++;
+            }
+        }
+        if(ir_get_command(&cmd)) {
+            printf("frame %d: extra command %02X\n", i, cmd.command);
+            wrong++;
+            ir_flush();
+        }
+        sent++;
+        repeats += n_repeat;
+    }
+    printf("ir_test: %d frames and %d repeats decoded, %d broken frames rejected, %d wrong: %s\n", sent, repeats,
+           FRAMES - sent, wrong, wrong ? "FAILED" : "ok");
+    return wrong != 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file    lap_sim.c
+ * @brief   Lap time benchmark of the line follower on simulated tracks
+ * @details Races the firmware on each track (see track_sim.h) and prints the lap time, the largest and mean
+ *          cross-track error and the number of line losses. Each race runs in its own process.<br>
+ *          Build: make (see Makefile)<br>
+ *          Usage: lap_sim [-k kp] [-d kd] [-b base_speed] [-t timeout_s] [-n seed] [-G] [-c] [-o uart] [-p trace.csv] track...<br>
+ *          Without -k, -d and -b the race uses Kp, Kd and BASE_SPEED of main.c. -G races without the gyro. -c prints CSV. -o writes the UART
+ *          output with telemetry (decode with telemetry_decode) and -p the robot's path, both for a single track.<br>
+ *          The exit status is 1 if a race did not finish.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "track_sim.h"
+
+static int csv = 0;
+
+
+static void print_result(const char *name, const struct race_params_ *p, const struct race_result_ *r)
+{
+    const char *outcome = r->finished ? "finished" : r->false_finish ? "false finish" :
+                          r->calibrated ? "did not finish" : "calibration failed";
+
+    if(csv) {
+        printf("%s,%.3f,%.3f,%d,%d,%s,%.3f,%.1f,%.1f,%lu,%.3f\n", name, p->kp, p->kd, p->base, r->gyro, outcome,
+               r->lap_s, r->max_xte_mm, r->mean_xte_mm, (unsigned long)r->line_losses, r->progress);
+    }
+    else if(r->finished) {
+        printf("%s: lap %.3f s, max cross-track %.1f mm, mean %.1f mm, line losses %lu%s\n", name, r->lap_s,
+               r->max_xte_mm, r->mean_xte_mm, (unsigned long)r->line_losses, r->gyro ? "" : ", no gyro");
+    }
+    else {
+        printf("%s: %s at %.0f%% of the lap, max cross-track %.1f mm, line losses %lu\n", name, outcome,
+               r->progress * 100.0, r->max_xte_mm, (unsigned long)r->line_losses);
+    }
+    fflush(stdout);
+}
+
+
+static int race(const char *path, const struct race_params_ *params)
+{
+    struct track_ track;
+    struct race_result_ result;
+
+    if(!track_load(&track, path)) {
+        fprintf(stderr, "%s: not a track\n", path);
+        return 1;
+    }
+    race_run(&track, params, &result);
+    print_result(track.name, params, &result);
+    track_free(&track);
+    return !result.finished;
+}
+
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-k kp] [-d kd] [-b base_speed] [-t timeout_s] [-n seed] [-G] [-c] [-o uart] "
+                    "[-p trace.csv] track...\n", name);
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct race_params_ params;
+    int failed = 0;
+    int opt, i;
+
+    race_defaults(&params);
+    while((opt = getopt(argc, argv, "k:d:b:t:n:Gco:p:")) != -1) {
+        switch(opt) {
+        case 'k':
+            params.kp = atof(optarg);
+            break;
+        case 'd':
+            params.kd = atof(optarg);
+            break;
+        case 'b':
+            params.base = atoi(optarg);
+            break;
+        case 't':
+            params.timeout_s = atof(optarg);
+            break;
+        case 'n':
+            params.seed = (uint32)strtoul(optarg, NULL, 0);
+            break;
+        case 'G':
+            params.no_gyro = 1;
+            break;
+        case 'c':
+            csv = 1;
+            break;
+        case 'o':
+            params.uart_path = optarg;
+            break;
+        case 'p':
+            params.trace = fopen(optarg, "w");
+            if(params.trace == NULL) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind == argc || ((params.uart_path != NULL || params.trace != NULL) && argc - optind > 1)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(csv) {
+        printf("track,kp,kd,base,gyro,outcome,lap_s,max_xte_mm,mean_xte_mm,line_losses,progress\n");
+        fflush(stdout);
+    }
+    // the firmware state is global, a fresh process for every race
+    for(i = optind; i < argc; i++) {
+        pid_t pid = fork();
+        int status;
+
+        if(pid == 0) {
+            exit(race(argv[i], &params));
+        }
+        if(pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed = 1;
+        }
+    }
+    if(params.trace != NULL) {
+        fclose(params.trace);
+    }
+    return failed;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file    pd_test.c
+ * @brief   Fixed-point PD controller against the float one it replaced
+ * @details Runs PD.c and the float PD of the original main.c side by side (motorSpeed = Kp * error + Kd * (error -
+ *          lastError), each motor base -/+ motorSpeed limited to MIN_SPEED..MAX_SPEED and truncated to the PWM
+ *          value) on steps, ramps, sine sweeps and random walks of the error, with several gains from main.c's up to
+ *          the largest pd_tune tries. Both get the same Q16.16 error, so the test measures the controller arithmetic
+ *          and not the input rounding. pd_ratio is checked against float division as well.<br>
+ *          Build and run: make check (see Makefile)<br>
+ *          The exit status is 1 if a motor command differs by more than MAX_MOTOR_DIFF or a ratio by more than
+ *          MAX_RATIO_DIFF.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "PD.h"
+
+#define MIN_SPEED           0
+#define MAX_SPEED           255
+#define STEPS               2000
+#define MAX_ERROR           8.0         // a line lost under l3/r3 gives 5.0 since the line position error
+#define MAX_MOTOR_DIFF      1           // PWM units, truncation of the two versions may round apart
+#define MAX_RATIO_DIFF      (1.0 / 65536.0)
+
+struct gains_ {
+    double kp;
+    double kd;
+    int base;
+};
+
+static const struct gains_ gains[] = {
+    { 85.0, 600.0, 255 },               // the original gains
+    { 85.0, 600.0, 180 },
+    { 40.0, 250.0, 120 },
+    { 200.0, 2000.0, 200 },
+    { 1000.0, 10000.0, 255 },           // the largest pd_tune tries, the correction saturates
+    { 0.5, 3.0, 128 },
+};
+
+static uint32_t rng = 1;
+
+
+static double random_unit(void)
+{
+    rng = rng * 1664525u + 1013904223u;
+    return (double)(rng >> 8) / (double)(1u << 24);
+}
+
+
+/**
+* @brief    Error sequence
+* @details  pattern 0 steps, 1 ramps, 2 a sine sweep, 3 a random walk
+*/
+static double error_at(int pattern, int i, double *walk)
+{
+    switch(pattern) {
+    case 0:
+        return (i / 100) % 2 ? MAX_ERROR * 0.3 : -MAX_ERROR * 0.1;
+    case 1:
+        return -MAX_ERROR + 2.0 * MAX_ERROR * (i % 500) / 500.0;
+    case 2:
+        return MAX_ERROR * sin(i * i * 1e-5);
+    default:
+        *walk += (random_unit() - 0.5) * 0.4;
+        *walk = fmax(-MAX_ERROR, fmin(MAX_ERROR, *walk));
+        return *walk;
+    }
+}
+
+
+static uint8_t float_motor(double speed)
+{
+    if(speed < MIN_SPEED)
+        speed = MIN_SPEED;
+    if(speed > MAX_SPEED)
+        speed = MAX_SPEED;
+    return (uint8_t)speed;
+}
+
+
+/**
+* @brief    One gain set on one error pattern
+* @details  returns the largest motor command difference
+*/
+static int run(const struct gains_ *g, int pattern)
+{
+    struct pd_ pd;
+    double last_error = 0.0, walk = 0.0;
+    int worst = 0, i;
+
+    pd_init(&pd, Q16(g->kp), Q16(g->kd), g->base, MIN_SPEED, MAX_SPEED);
+    for(i = 0; i < STEPS; i++) {
+        q16_t error = (q16_t)lround(error_at(pattern, i, &walk) * Q16_ONE);
+        double e = (double)error / Q16_ONE;
+        double speed = g->kp * e + g->kd * (e - last_error);
+        uint8 left, right;
+        int dl, dr;
+
+        last_error = e;
+        pd_motor_speeds(&pd, pd_update(&pd, error), &left, &right);
+        dl = abs(left - float_motor(g->base + speed));
+        dr = abs(right - float_motor(g->base - speed));
+        worst = dl > worst ? dl : worst;
+        worst = dr > worst ? dr : worst;
+    }
+    return worst;
+}
+
+
+/**
+* @brief    pd_ratio against float division
+* @details  returns the largest difference in Q16.16 units of one
+*/
+static double ratio_diff(void)
+{
+    double worst = 0.0;
+    int i;
+
+    for(i = 0; i < 100000; i++) {
+        int32 num = (int32)(random_unit() * 60000.0) - 30000;
+        int32 den = (int32)(random_unit() * 30000.0) + 1;
+        double d = fabs((double)pd_ratio(num, den) / Q16_ONE - (double)num / den);
+
+        worst = fmax(worst, d);
+    }
+    return worst;
+}
+
+
+int main(void)
+{
+    static const char *const pattern_name[4] = { "steps", "ramps", "sweep", "walk" };
+    int failed = 0, worst = 0;
+    double ratio;
+    unsigned g;
+    int p;
+
+    for(g = 0; g < sizeof(gains) / sizeof(gains[0]); g++) {
+        for(p = 0; p < 4; p++) {
+            int diff = run(&gains[g], p);
+
+            if(diff > MAX_MOTOR_DIFF) {
+                printf("kp %.1f kd %.1f base %d, %s: motor commands differ by %d\n", gains[g].kp, gains[g].kd,
+                       gains[g].base, pattern_name[p], diff);
+                failed = 1;
+            }
+            worst = diff > worst ? diff : worst;
+        }
+    }
+    ratio = ratio_diff();
+    if(ratio > MAX_RATIO_DIFF) {
+        printf("pd_ratio differs from float division by %g\n", ratio);
+        failed = 1;
+    }
+    printf("pd_test: largest motor command difference %d, pd_ratio difference %.2g: %s\n", worst, ratio,
+           failed ? "FAILED" : "ok");
+    return failed;
+}
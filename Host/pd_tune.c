@@ -0,0 +1,340 @@
+/**
+ * @file    pd_tune.c
+ * @brief   PD gain and base speed tuning against the track simulator
+ * @details Compass search over Kp, Kd and the base speed. Every iteration races the current best settings moved one
+ *          step up and down in each of them on all the tracks and seeds, moves to the best one that improves the
+ *          cost and halves the steps when none does. The races run in a pool of forked processes, one per core by
+ *          default (see track_sim.h).<br>
+ *          A race with a line loss, a false finish or no finish costs PENALTY_S plus the part of the lap it did not
+ *          drive, so settings that go round cleanly always win and among them the shortest total lap time.<br>
+ *          Build: make (see Makefile)<br>
+ *          Usage: pd_tune [-k kp] [-d kd] [-b base_speed] [-s seeds] [-i iterations] [-j jobs] [-o header] track...<br>
+ *          The search starts from Kp, Kd and BASE_SPEED of main.c unless given. The result is written as a header of
+ *          TUNED_KP, TUNED_KD and TUNED_BASE_SPEED to stdout or the -o file. Nothing is written if any race ran
+ *          without the gyro, gains tuned that way don't fit the robot, which measures its sharp turns with it.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "track_sim.h"
+
+#define DIMS            3
+#define PENALTY_S       100.0
+#define MAX_TRACKS      32
+#define MAX_SEEDS       16
+#define TIMEOUT_S       30.0
+
+struct point_ {
+    double v[DIMS];                 // kp, kd, base
+};
+
+struct job_ {
+    const struct track_ *track;
+    struct race_params_ params;
+    struct race_result_ result;
+    pid_t pid;
+    int fd;
+};
+
+static const char *const dim_name[DIMS] = { "kp", "kd", "base" };
+static const double dim_min[DIMS] = { 0.0, 0.0, 60.0 };
+static const double dim_max[DIMS] = { 1000.0, 10000.0, 255.0 };
+static const double dim_step[DIMS] = { 20.0, 150.0, 30.0 };
+static const double dim_last_step[DIMS] = { 1.0, 10.0, 4.0 };
+
+static struct track_ tracks[MAX_TRACKS];
+static int n_tracks = 0;
+static int n_seeds = 2;
+static int n_workers = 1;
+static int no_gyro_races = 0;      // calibrated races the firmware ran without the gyro
+
+
+static void params_of(const struct point_ *p, uint32 seed, struct race_params_ *params)
+{
+    race_defaults(params);
+    params->kp = p->v[0];
+    params->kd = p->v[1];
+    params->base = (int)lround(p->v[2]);
+    params->timeout_s = TIMEOUT_S;
+    params->seed = seed;
+}
+
+
+static void finish_job(struct job_ *job)
+{
+    ssize_t n = read(job->fd, &job->result, sizeof(job->result));
+
+    if(n != (ssize_t)sizeof(job->result)) {
+        memset(&job->result, 0, sizeof(job->result));
+        job->result.dnf = 1;
+    }
+    close(job->fd);
+    job->pid = 0;
+}
+
+
+/**
+* @brief    Running races in parallel
+* @details  at most n_workers child processes at a time, each runs one race and writes its result to a pipe
+*/
+static void run_jobs(struct job_ *jobs, int n)
+{
+    int next = 0, running = 0, i;
+
+    while(next < n || running > 0) {
+        if(next < n && running < n_workers) {
+            struct job_ *job = &jobs[next++];
+            int fds[2];
+
+            if(pipe(fds) != 0) {
+                perror("pipe");
+                exit(1);
+            }
+            fflush(NULL);
+            job->pid = fork();
+            if(job->pid == 0) {
+                close(fds[0]);
+                race_run(job->track, &job->params, &job->result);
+                if(write(fds[1], &job->result, sizeof(job->result)) != (ssize_t)sizeof(job->result)) {
+                    _exit(1);
+                }
+                _exit(0);
+            }
+            close(fds[1]);
+            job->fd = fds[0];
+            if(job->pid < 0) {
+                perror("fork");
+                exit(1);
+            }
+            running++;
+            continue;
+        }
+
+        pid_t pid = wait(NULL);
+        for(i = 0; i < n; i++) {
+            if(jobs[i].pid == pid && pid > 0) {
+                finish_job(&jobs[i]);
+                running--;
+                break;
+            }
+        }
+    }
+}
+
+
+static double race_cost(const struct race_result_ *r)
+{
+    if(r->finished && r->line_losses == 0) {
+        return r->lap_s;
+    }
+    return PENALTY_S + (1.0 - fmin(r->progress, 1.0)) * PENALTY_S;
+}
+
+
+/**
+* @brief    Racing a set of settings
+* @details  every point on every track with every seed, all in one batch
+* @param    struct point_ *points : settings to race
+* @param    int n : number of points
+* @param    double *cost : total cost of each point
+* @param    int *clean : number of clean laps of each point
+*/
+static void evaluate(const struct point_ *points, int n, double *cost, int *clean)
+{
+    int per_point = n_tracks * n_seeds;
+    struct job_ *jobs = calloc((size_t)(n * per_point), sizeof(*jobs));
+    int p, t, s;
+
+    for(p = 0; p < n; p++) {
+        for(t = 0; t < n_tracks; t++) {
+            for(s = 0; s < n_seeds; s++) {
+                struct job_ *job = &jobs[(p * n_tracks + t) * n_seeds + s];
+                job->track = &tracks[t];
+                params_of(&points[p], (uint32)s + 1u, &job->params);
+            }
+        }
+    }
+    run_jobs(jobs, n * per_point);
+
+    for(p = 0; p < n; p++) {
+        cost[p] = 0.0;
+        clean[p] = 0;
+        for(t = 0; t < per_point; t++) {
+            const struct race_result_ *r = &jobs[p * per_point + t].result;
+            cost[p] += race_cost(r);
+            clean[p] += r->finished && r->line_losses == 0;
+            no_gyro_races += r->calibrated && !r->gyro;
+        }
+    }
+    free(jobs);
+}
+
+
+static void print_point(FILE *f, const char *label, const struct point_ *p, double cost, int clean)
+{
+    fprintf(f, "%s kp %.2f kd %.1f base %d: cost %.3f, %d/%d clean laps\n", label, p->v[0], p->v[1],
+            (int)lround(p->v[2]), cost, clean, n_tracks * n_seeds);
+}
+
+
+static int write_header(const char *path, const struct point_ *best, double cost, int clean)
+{
+    FILE *f = path != NULL ? fopen(path, "w") : stdout;
+    const char *name = path == NULL ? "PdTuned.h" : strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+    time_t now = time(NULL);
+    char date[32];
+    int t;
+
+    if(f == NULL) {
+        perror(path);
+        return 0;
+    }
+    strftime(date, sizeof(date), "%Y-%m-%d", localtime(&now));
+    fprintf(f, "/**\n");
+    fprintf(f, " * @file    %s\n", name);
+    fprintf(f, " * @brief   PD gains and base speed tuned in the track simulator\n");
+    fprintf(f, " * @details Generated by Host/pd_tune on %s. Tracks:", date);
+    for(t = 0; t < n_tracks; t++) {
+        fprintf(f, " %s", tracks[t].name);
+    }
+    fprintf(f, ", %d seeds each, %d/%d clean laps", n_seeds, clean, n_tracks * n_seeds);
+    if(clean == n_tracks * n_seeds) {
+        fprintf(f, " in %.3f s", cost);
+    }
+    fprintf(f, ".<br>\n");
+    fprintf(f, " *          Check them on the robot before taking them into use in main.c (Kp, Kd and BASE_SPEED).\n");
+    fprintf(f, "*/\n");
+    fprintf(f, "#ifndef PD_TUNED_H_\n#define PD_TUNED_H_\n\n");
+    fprintf(f, "#define TUNED_KP            Q16(%.2f)\n", best->v[0]);
+    fprintf(f, "#define TUNED_KD            Q16(%.1f)\n", best->v[1]);
+    fprintf(f, "#define TUNED_BASE_SPEED    %d\n", (int)lround(best->v[2]));
+    fprintf(f, "\n#endif\n");
+    if(f != stdout) {
+        fclose(f);
+    }
+    return 1;
+}
+
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-k kp] [-d kd] [-b base_speed] [-s seeds] [-i iterations] [-j jobs] [-o header] "
+                    "track...\n", name);
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct race_params_ defaults;
+    struct point_ best, trial[2 * DIMS];
+    double step[DIMS], best_cost, cost[2 * DIMS];
+    int best_clean, clean[2 * DIMS];
+    int iterations = 40, iteration, opt, d, i;
+    const char *header = NULL;
+
+    race_defaults(&defaults);
+    best.v[0] = defaults.kp;
+    best.v[1] = defaults.kd;
+    best.v[2] = defaults.base;
+    n_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    while((opt = getopt(argc, argv, "k:d:b:s:i:j:o:")) != -1) {
+        switch(opt) {
+        case 'k':
+            best.v[0] = atof(optarg);
+            break;
+        case 'd':
+            best.v[1] = atof(optarg);
+            break;
+        case 'b':
+            best.v[2] = atof(optarg);
+            break;
+        case 's':
+            n_seeds = atoi(optarg);
+            break;
+        case 'i':
+            iterations = atoi(optarg);
+            break;
+        case 'j':
+            n_workers = atoi(optarg);
+            break;
+        case 'o':
+            header = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind == argc || argc - optind > MAX_TRACKS || n_seeds < 1 || n_seeds > MAX_SEEDS) {
+        usage(argv[0]);
+        return 1;
+    }
+    if(n_workers < 1) {
+        n_workers = 1;
+    }
+    for(i = optind; i < argc; i++) {
+        if(!track_load(&tracks[n_tracks++], argv[i])) {
+            fprintf(stderr, "%s: not a track\n", argv[i]);
+            return 1;
+        }
+    }
+
+    evaluate(&best, 1, &best_cost, &best_clean);
+    print_point(stderr, "start", &best, best_cost, best_clean);
+    memcpy(step, dim_step, sizeof(step));
+
+    for(iteration = 1; iteration <= iterations; iteration++) {
+        int n = 0, pick = -1;
+
+        for(d = 0; d < DIMS; d++) {
+            for(i = -1; i <= 1; i += 2) {
+                trial[n] = best;
+                trial[n].v[d] = fmin(fmax(best.v[d] + i * step[d], dim_min[d]), dim_max[d]);
+                if(trial[n].v[d] != best.v[d]) {
+                    n++;
+                }
+            }
+        }
+        evaluate(trial, n, cost, clean);
+        for(i = 0; i < n; i++) {
+            if(cost[i] < best_cost && (pick < 0 || cost[i] < cost[pick])) {
+                pick = i;
+            }
+        }
+
+        if(pick >= 0) {
+            best = trial[pick];
+            best_cost = cost[pick];
+            best_clean = clean[pick];
+        }
+        else {
+            int done = 1;
+            for(d = 0; d < DIMS; d++) {
+                step[d] /= 2.0;
+                done &= step[d] < dim_last_step[d];
+            }
+            if(done) {
+                break;
+            }
+        }
+        fprintf(stderr, "%2d:", iteration);
+        print_point(stderr, "", &best, best_cost, best_clean);
+        for(d = 0; d < DIMS; d++) {
+            fprintf(stderr, "%s %s step %g", d ? "," : "   ", dim_name[d], step[d]);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    print_point(stderr, "best", &best, best_cost, best_clean);
+    if(no_gyro_races > 0) {
+        fprintf(stderr, "%d races ran without the gyro, no header written\n", no_gyro_races);
+        return 1;
+    }
+    return !write_header(header, &best, best_cost, best_clean);
+}
@@ -0,0 +1,574 @@
+/**
+ * @file    replay.c
+ * @brief   Replays a recorded race through the firmware's race controller
+ * @details Reads a UART capture of a race driven with TELEMETRY_RECORD in main.c, then runs main.c's own pd_step once
+ *          for every recorded sample with the recorded calibration, gains, motor trim and gyro headings. The
+ *          recording is taken where pd_step reads its inputs, so this program replaces the sample reads of
+ *          Reflectance.c (linked with --wrap, its calibration code is used as it is) and the gyro heading driver
+ *          (Heading.c is left out) with functions that hand pd_step the recorded values. Everything from there on is the firmware code as it is in the tree, so a regression
+ *          shows up as a different output on the same recording.<br>
+ *          Build: make (see Makefile)<br>
+ *          Usage: replay [-r race] [-k kp] [-d kd] [-b base_speed] [-n repeats] [-o output.csv] capture<br>
+ *          -r picks the race when the capture has several (default 1). -k, -d and -b replace the recorded gains and
+ *          BASE_SPEED. -o writes what pd_step did with each sample as CSV. The summary on stderr has the events of
+ *          the run, gaps in the samples, where the finish line was seen compared with the robot and the host CPU
+ *          time of each pd_step call, the best of -n repeats (default 10). Every repeat must give the same output.
+ *          The exit status is 1 on errors and 2 if the replay didn't see the finish line.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "telemetry_reader.h"
+
+// the firmware's race code with its static state
+#define main zumo_main
+#include "main.c"
+#undef main
+
+#define DEFAULT_REPEATS     10
+#define FNV_OFFSET          0xcbf29ce484222325ull
+#define FNV_PRIME           0x100000001b3ull
+
+/**
+* @brief    One sample as pd_step read it
+*/
+struct input_ {
+    uint32 seq;
+    uint32 time_ms;
+    struct sensors_ values;
+    uint8 has_heading;
+    int32 heading;                  // millidegrees, from the HEADING record of this sample
+};
+
+/**
+* @brief    Recorded race
+* @details  seq and time_ms of the inputs are extended from their low 16 bits, anchored to the full seq of the
+*           first heading record and to the start time
+*/
+struct recording_ {
+    int wanted;                     // race to pick, from 1
+    int races;                      // RACE records seen
+    int collecting;
+    int has_calibration;
+    struct sensors_ white;
+    struct sensors_ black;
+    struct sensors_ next_white;     // calibration sent before the next race
+    struct sensors_ next_black;
+    uint32 start_ms;
+    q16_t kp;
+    q16_t kd;
+    uint8 base;
+    uint8 gyro;
+    int8 trim_left;
+    int8 trim_right;
+    int seq_anchored;
+    int has_finish;
+    uint16 finish_seq;
+    struct input_ *inputs;
+    uint32 n;
+    uint32 size;
+    uint32 orphan_headings;         // headings without the sample before them
+};
+
+/**
+* @brief    Replay settings
+*/
+struct replay_params_ {
+    q16_t kp;
+    q16_t kd;
+    int base;
+    int repeats;
+    FILE *csv;
+};
+
+/**
+* @brief    Result of one pass over the recording
+*/
+struct replay_result_ {
+    uint64 hash;                    // of everything pd_step did
+    uint32 steps;
+    int finished;
+    uint32 finish_index;
+    uint32 missing_headings;
+    double min_ns;
+    double max_ns;
+    double total_ns;
+};
+
+static const struct recording_ *rec;
+static const struct replay_params_ *params;
+static struct replay_result_ *result;
+static uint32 current;                  // index of the input pd_step gets next
+static uint8 fed;                       // the current input has been read
+static int32 replay_heading;           // what gyro_heading_mdeg returns
+
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+static uint32 extend16(uint32 previous, uint16 low)
+{
+    return previous + (uint16)(low - (uint16)previous);
+}
+
+
+static void print_event(const uint8 *p)
+{
+    uint32 t = telemetry_get32(p);
+
+    switch(p[4]) {
+    case TELEMETRY_EVENT_BUTTON:
+        fprintf(stderr, "%9lu ms  button %s\n", (unsigned long)t, p[5] ? "pressed" : "released");
+        break;
+    case TELEMETRY_EVENT_IR:
+    case TELEMETRY_EVENT_IR_REPEAT:
+        fprintf(stderr, "%9lu ms  remote command %u address %u%s\n", (unsigned long)t, p[5], telemetry_get16(p + 6),
+                p[4] == TELEMETRY_EVENT_IR_REPEAT ? " (repeat)" : "");
+        break;
+    case TELEMETRY_EVENT_FINISH:
+        fprintf(stderr, "%9lu ms  finish line\n", (unsigned long)t);
+        break;
+    }
+}
+
+
+static void add_input(struct recording_ *r, const uint8 *p)
+{
+    struct input_ *in;
+
+    if(r->n == r->size) {
+        r->size = r->size ? r->size * 2u : 4096u;
+        r->inputs = realloc(r->inputs, r->size * sizeof(*r->inputs));
+        if(r->inputs == NULL) {
+            perror("replay");
+            exit(1);
+        }
+    }
+    in = &r->inputs[r->n];
+    memset(in, 0, sizeof(*in));
+    if(r->n == 0) {
+        in->seq = telemetry_get16(p);
+        in->time_ms = extend16(r->start_ms, telemetry_get16(p + 2));
+    }
+    else {
+        in->seq = extend16(r->inputs[r->n - 1].seq, telemetry_get16(p));
+        in->time_ms = extend16(r->inputs[r->n - 1].time_ms, telemetry_get16(p + 2));
+    }
+    in->values.l3 = telemetry_get16(p + 4);
+    in->values.l1 = telemetry_get16(p + 6);
+    in->values.r1 = telemetry_get16(p + 8);
+    in->values.r3 = telemetry_get16(p + 10);
+    r->n++;
+}
+
+
+static void add_heading(struct recording_ *r, const uint8 *p)
+{
+    uint32 seq = telemetry_get32(p);
+    struct input_ *last = r->n > 0 ? &r->inputs[r->n - 1] : NULL;
+    uint32 i;
+
+    if(last == NULL || (uint16)last->seq != (uint16)seq) {
+        r->orphan_headings++;
+        return;
+    }
+    // pd_step updates the heading on every HEADING_DIVIDER:th seq, which the low bits alone don't tell
+    if(!r->seq_anchored) {
+        uint32 offset = seq - last->seq;
+        for(i = 0; i < r->n; i++) {
+            r->inputs[i].seq += offset;
+        }
+        r->seq_anchored = 1;
+    }
+    last->has_heading = 1;
+    last->heading = (int32_t)telemetry_get32(p + 4);
+}
+
+
+static void take_record(uint8 type, uint8 seq, const uint8 *p, void *context)
+{
+    struct recording_ *r = context;
+
+    (void)seq;
+    switch(type) {
+    case TELEMETRY_CALIBRATION:
+        r->next_white.l3 = telemetry_get16(p);
+        r->next_white.l1 = telemetry_get16(p + 2);
+        r->next_white.r1 = telemetry_get16(p + 4);
+        r->next_white.r3 = telemetry_get16(p + 6);
+        r->next_black.l3 = telemetry_get16(p + 8);
+        r->next_black.l1 = telemetry_get16(p + 10);
+        r->next_black.r1 = telemetry_get16(p + 12);
+        r->next_black.r3 = telemetry_get16(p + 14);
+        r->has_calibration = 1;
+        break;
+    case TELEMETRY_RACE:
+        r->collecting = ++r->races == r->wanted;
+        if(r->collecting) {
+            r->white = r->next_white;
+            r->black = r->next_black;
+            r->start_ms = telemetry_get32(p);
+            r->kp = (int32_t)telemetry_get32(p + 4);
+            r->kd = (int32_t)telemetry_get32(p + 8);
+            r->base = p[12];
+            r->gyro = (p[13] & TELEMETRY_RACE_GYRO) != 0;
+            r->trim_left = (int8)p[14];
+            r->trim_right = (int8)p[15];
+            fprintf(stderr, "%9lu ms  race %d starts\n", (unsigned long)r->start_ms, r->races);
+        }
+        break;
+    case TELEMETRY_INPUT:
+        if(r->collecting) {
+            add_input(r, p);
+        }
+        break;
+    case TELEMETRY_HEADING:
+        if(r->collecting) {
+            add_heading(r, p);
+        }
+        break;
+    case TELEMETRY_EVENT:
+        if(r->collecting && p[4] == TELEMETRY_EVENT_FINISH && !r->has_finish) {
+            r->has_finish = 1;
+            r->finish_seq = telemetry_get16(p + 6);
+        }
+        if(r->collecting || r->races < r->wanted) {
+            print_event(p);
+        }
+        break;
+    }
+}
+
+
+static int load_recording(const char *path, struct recording_ *r)
+{
+    struct telemetry_reader_ reader;
+    uint8 buf[4096];
+    size_t n;
+    FILE *f = fopen(path, "rb");
+
+    if(f == NULL) {
+        perror(path);
+        return 0;
+    }
+    telemetry_reader_init(&reader, take_record, r);
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        telemetry_reader_feed(&reader, buf, n);
+    }
+    fclose(f);
+
+    fprintf(stderr, "frames: %lu bad: %lu with junk: %lu dropped: %lu\n", reader.frames, reader.bad, reader.junk,
+            reader.dropped);
+    if(r->races < r->wanted) {
+        fprintf(stderr, "%s: race %d not found, %d races recorded\n", path, r->wanted, r->races);
+        return 0;
+    }
+    if(!r->has_calibration || r->n == 0) {
+        fprintf(stderr, "%s: no %s recorded for race %d, was TELEMETRY_RECORD on?\n", path,
+                r->has_calibration ? "samples" : "calibration", r->wanted);
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * The drivers pd_step reads through, fed from the recording. The reflectance reads are linked in place of
+ * Reflectance.c's with --wrap, see Makefile.
+ */
+
+void __wrap_reflectance_start(void)
+{
+}
+
+
+uint8_t __wrap_reflectance_try_read(struct reflectance_sample_ *s)
+{
+    const struct input_ *in = &rec->inputs[current];
+
+    if(fed) {
+        return 0;
+    }
+    fed = 1;
+    memset(&s->values, 0, sizeof(s->values));
+    s->values.l3 = in->values.l3;
+    s->values.l1 = in->values.l1;
+    s->values.r1 = in->values.r1;
+    s->values.r3 = in->values.r3;
+    s->seq = in->seq;
+    s->time_ms = in->time_ms;
+    return 1;
+}
+
+
+void __wrap_reflectance_wait_new(struct reflectance_sample_ *s)
+{
+    fed = 0;
+    __wrap_reflectance_try_read(s);
+}
+
+
+void __wrap_reflectance_read(struct sensors_ *values)
+{
+    struct reflectance_sample_ s;
+
+    __wrap_reflectance_wait_new(&s);
+    *values = s.values;
+}
+
+
+int gyro_heading_start(void)
+{
+    return rec->gyro;
+}
+
+
+void gyro_heading_update(void)
+{
+    const struct input_ *in = &rec->inputs[current];
+
+    if(in->has_heading) {
+        replay_heading = in->heading;
+    }
+    else {
+        result->missing_headings++;
+    }
+}
+
+
+void gyro_heading_reset(void)
+{
+    replay_heading = 0;
+}
+
+
+int32 gyro_heading_mdeg(void)
+{
+    return replay_heading;
+}
+
+
+int32 gyro_heading_deg(void)
+{
+    return replay_heading / 1000;
+}
+
+
+static uint64 fnv(uint64 hash, const void *data, size_t len)
+{
+    const uint8 *p = data;
+
+    while(len--) {
+        hash = (hash ^ *p++) * FNV_PRIME;
+    }
+    return hash;
+}
+
+
+/**
+* @brief    One pass over the recording
+* @details  starts the race with main.c's race_begin as main() does and runs pd_step once per sample until it sees
+*           the finish line. Runs outside sim_run: pd_step never waits, and the idle signal would disturb the timing.
+*/
+static void replay_race(void)
+{
+    const struct input_ *in;
+    int16 left, right;
+    double start, ns;
+
+    memset(&cal, 0, sizeof(cal));
+    cal.white.l3 = rec->white.l3;
+    cal.white.l1 = rec->white.l1;
+    cal.white.r1 = rec->white.r1;
+    cal.white.r3 = rec->white.r3;
+    cal.black.l3 = rec->black.l3;
+    cal.black.l1 = rec->black.l1;
+    cal.black.r1 = rec->black.r1;
+    cal.black.r3 = rec->black.r3;
+    cal.trim_left = rec->trim_left;
+    cal.trim_right = rec->trim_right;
+    cal.mag.scale_x = MAGNET_SCALE_ONE;
+    cal.mag.scale_y = MAGNET_SCALE_ONE;
+    cal.mag.scale_z = MAGNET_SCALE_ONE;
+    apply_calibration();
+    gyroOk = gyro_heading_start();
+    motor_start();
+
+    replay_heading = 0;
+    race_begin(params->kp, params->kd, params->base, rec->start_ms);
+
+    result->hash = FNV_OFFSET;
+    result->min_ns = INFINITY;
+    for(current = 0; current < rec->n && !lineCrossed; current++) {
+        in = &rec->inputs[current];
+        fed = 0;
+        start = now_ns();
+        pd_step();
+        ns = now_ns() - start;
+
+        result->min_ns = fmin(result->min_ns, ns);
+        result->max_ns = fmax(result->max_ns, ns);
+        result->total_ns += ns;
+        result->steps++;
+
+        sim_motor(&left, &right);
+        result->hash = fnv(result->hash, &pd.last_error, sizeof(pd.last_error));
+        result->hash = fnv(result->hash, &left, sizeof(left));
+        result->hash = fnv(result->hash, &right, sizeof(right));
+        result->hash = fnv(result->hash, &replay_heading, sizeof(replay_heading));
+        if(params->csv != NULL) {
+            fprintf(params->csv, "%lu,%lu,%u,%u,%u,%u,%ld,%.5f,%d,%d,%d\n", (unsigned long)in->seq,
+                    (unsigned long)in->time_ms, in->values.l3, in->values.l1, in->values.r1, in->values.r3,
+                    (long)replay_heading, pd.last_error / 65536.0, left, right, lineCrossed ? 1 : 0);
+        }
+    }
+    result->finished = lineCrossed;
+    result->finish_index = current - 1u;
+    motor_stop();
+}
+
+
+static void print_summary(const struct recording_ *r, const struct replay_result_ *first,
+                          const struct replay_result_ *fastest)
+{
+    uint32 gaps = 0, missing = 0, i;
+
+    for(i = 1; i < r->n; i++) {
+        if(r->inputs[i].seq != r->inputs[i - 1].seq + RECORD_DIVIDER) {
+            gaps++;
+            missing += (r->inputs[i].seq - r->inputs[i - 1].seq) / RECORD_DIVIDER - 1u;
+        }
+    }
+    fprintf(stderr, "samples: %lu from seq %lu, %lu gaps with %lu samples missing, %lu headings%s\n",
+            (unsigned long)r->n, (unsigned long)r->inputs[0].seq, (unsigned long)gaps, (unsigned long)missing,
+            (unsigned long)first->missing_headings, r->gyro ? " missing" : " (no gyro)");
+    if(r->orphan_headings > 0) {
+        fprintf(stderr, "headings without their sample: %lu\n", (unsigned long)r->orphan_headings);
+    }
+    fprintf(stderr, "kp %.3f kd %.3f base %d (recorded kp %.3f kd %.3f base %u), trim %d/%d\n",
+            params->kp / 65536.0, params->kd / 65536.0, params->base, r->kp / 65536.0, r->kd / 65536.0, r->base,
+            r->trim_left, r->trim_right);
+
+    if(first->finished) {
+        const struct input_ *in = &r->inputs[first->finish_index];
+        fprintf(stderr, "finish line at seq %lu, %.3f s after the start", (unsigned long)in->seq,
+                (in->time_ms - r->start_ms) / 1000.0);
+        if(r->has_finish) {
+            fprintf(stderr, ", %s the robot\n", (uint16)in->seq == r->finish_seq ? "same as" : "NOT the same as");
+        }
+        else {
+            fprintf(stderr, ", the robot didn't report one\n");
+        }
+    }
+    else {
+        fprintf(stderr, "no finish line in %lu samples%s\n", (unsigned long)r->n,
+                r->has_finish ? ", the robot saw one" : "");
+    }
+    fprintf(stderr, "pd_step host CPU time: min %.0f ns, mean %.0f ns, max %.0f ns over %lu steps, hash %016llx\n",
+            fastest->min_ns, fastest->total_ns / fastest->steps, fastest->max_ns, (unsigned long)fastest->steps,
+            (unsigned long long)first->hash);
+}
+
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-r race] [-k kp] [-d kd] [-b base_speed] [-n repeats] [-o output.csv] capture\n", name);
+}
+
+
+int main(int argc, char *argv[])
+{
+    static struct recording_ recording;
+    struct replay_params_ settings;
+    struct replay_result_ first, fastest, run;
+    const char *kp = NULL, *kd = NULL;
+    int opt, i;
+
+    memset(&settings, 0, sizeof(settings));
+    settings.base = -1;
+    settings.repeats = DEFAULT_REPEATS;
+    recording.wanted = 1;
+    while((opt = getopt(argc, argv, "r:k:d:b:n:o:")) != -1) {
+        switch(opt) {
+        case 'r':
+            recording.wanted = atoi(optarg);
+            break;
+        case 'k':
+            kp = optarg;
+            break;
+        case 'd':
+            kd = optarg;
+            break;
+        case 'b':
+            settings.base = atoi(optarg);
+            break;
+        case 'n':
+            settings.repeats = atoi(optarg);
+            break;
+        case 'o':
+            settings.csv = fopen(optarg, "w");
+            if(settings.csv == NULL) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind != argc - 1 || recording.wanted < 1 || settings.repeats < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if(!load_recording(argv[optind], &recording)) {
+        return 1;
+    }
+
+    settings.kp = kp != NULL ? Q16(atof(kp)) : recording.kp;
+    settings.kd = kd != NULL ? Q16(atof(kd)) : recording.kd;
+    if(settings.base < 0) {
+        settings.base = recording.base;
+    }
+    rec = &recording;
+    params = &settings;
+    if(settings.csv != NULL) {
+        fprintf(settings.csv, "seq,time_ms,l3,l1,r1,r3,heading_mdeg,error,left,right,finish\n");
+    }
+
+    // the first pass writes the CSV, the others must do the same and keep the fastest time
+    memset(&first, 0, sizeof(first));
+    result = &first;
+    replay_race();
+    if(settings.csv != NULL) {
+        fclose(settings.csv);
+        settings.csv = NULL;
+    }
+    fastest = first;
+    for(i = 1; i < settings.repeats; i++) {
+        memset(&run, 0, sizeof(run));
+        result = &run;
+        replay_race();
+        if(run.hash != first.hash || run.steps != first.steps) {
+            fprintf(stderr, "repeat %d gave a different result, the replay is not deterministic\n", i + 1);
+            return 1;
+        }
+        if(run.total_ns < fastest.total_ns) {
+            fastest = run;
+        }
+    }
+
+    print_summary(&recording, &first, &fastest);
+    return first.finished ? 0 : 2;
+}
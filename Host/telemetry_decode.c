@@ -0,0 +1,203 @@
+/**
+ * @file    telemetry_decode.c
+ * @brief   Host decoder for ZumoBot binary telemetry
+ * @details Reads COBS framed telemetry (see ZumoLibrary/TelemetryFormat.h) from a file, a serial port or stdin and
+ *          writes the records as CSV. Frames with a bad CRC (including text printed on the same UART) are skipped and
+ *          sequence gaps are counted as dropped frames (see telemetry_reader.h).<br>
+ *          Build: make (see Makefile)<br>
+ *          Usage: telemetry_decode [-b baud] [-o prefix] [input]<br>
+ *          Without -o all records go to stdout with the record type in the second column. With -o each record type
+ *          goes to its own file, prefix_reflectance.csv, prefix_pd.csv and so on.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "telemetry_reader.h"
+
+static const char *type_name[TELEMETRY_RECORD_TYPES] = {
+    NULL, "reflectance", "pd", "motor", "battery", "input", "heading", "race", "calibration", "event"
+};
+static const char *type_header[TELEMETRY_RECORD_TYPES] = {
+    NULL,
+    "time_ms,l3,l2,l1,r1,r2,r3",
+    "error,correction",
+    "left_dir,right_dir,left_speed,right_speed",
+    "battery_mv",
+    "sample_seq,time_ms,l3,l1,r1,r3",
+    "sample_seq,heading_mdeg",
+    "start_ms,kp,kd,base,gyro,trim_left,trim_right",
+    "white_l3,white_l1,white_r1,white_r3,black_l3,black_l1,black_r1,black_r3",
+    "time_ms,kind,value,data",
+};
+static const char *event_name[] = { "?", "button", "ir", "ir_repeat", "finish" };
+
+static FILE *out[TELEMETRY_RECORD_TYPES];
+static int split = 0;
+
+
+static uint16_t get16(const uint8_t *p)
+{
+    return telemetry_get16(p);
+}
+
+
+static uint32_t get32(const uint8_t *p)
+{
+    return telemetry_get32(p);
+}
+
+
+static void print_record(uint8_t type, uint8_t seq, const uint8_t *p, void *context)
+{
+    FILE *f = split ? out[type] : stdout;
+    
+    (void)context;
+    if(split)
+        fprintf(f, "%u,", seq);
+    else
+        fprintf(f, "%u,%s,", seq, type_name[type]);
+    
+    switch(type) {
+    case TELEMETRY_REFLECTANCE:
+        fprintf(f, "%lu,%u,%u,%u,%u,%u,%u\n", (unsigned long)get32(p), get16(p + 2 * 2), get16(p + 3 * 2),
+                get16(p + 4 * 2), get16(p + 5 * 2), get16(p + 6 * 2), get16(p + 7 * 2));
+        break;
+    case TELEMETRY_PD:
+        fprintf(f, "%.5f,%.5f\n", (int32_t)get32(p) / 65536.0, (int32_t)get32(p + 4) / 65536.0);
+        break;
+    case TELEMETRY_MOTOR:
+        fprintf(f, "%u,%u,%u,%u\n", p[0] & 1u, (p[0] >> 1) & 1u, p[1], p[2]);
+        break;
+    case TELEMETRY_BATTERY:
+        fprintf(f, "%u\n", get16(p));
+        break;
+    case TELEMETRY_INPUT:
+        fprintf(f, "%u,%u,%u,%u,%u,%u\n", get16(p), get16(p + 2), get16(p + 4), get16(p + 6), get16(p + 8),
+                get16(p + 10));
+        break;
+    case TELEMETRY_HEADING:
+        fprintf(f, "%lu,%ld\n", (unsigned long)get32(p), (long)(int32_t)get32(p + 4));
+        break;
+    case TELEMETRY_RACE:
+        fprintf(f, "%lu,%.5f,%.5f,%u,%u,%d,%d\n", (unsigned long)get32(p), (int32_t)get32(p + 4) / 65536.0,
+                (int32_t)get32(p + 8) / 65536.0, p[12], p[13] & TELEMETRY_RACE_GYRO, (int8_t)p[14], (int8_t)p[15]);
+        break;
+    case TELEMETRY_CALIBRATION:
+        fprintf(f, "%u,%u,%u,%u,%u,%u,%u,%u\n", get16(p), get16(p + 2), get16(p + 4), get16(p + 6), get16(p + 8),
+                get16(p + 10), get16(p + 12), get16(p + 14));
+        break;
+    case TELEMETRY_EVENT:
+        fprintf(f, "%lu,%s,%u,%u\n", (unsigned long)get32(p),
+                p[4] < sizeof(event_name) / sizeof(event_name[0]) ? event_name[p[4]] : "?", p[5], get16(p + 6));
+        break;
+    }
+}
+
+
+static speed_t baud_constant(long baud)
+{
+    switch(baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    default: return B0;
+    }
+}
+
+
+static int open_input(const char *path, long baud)
+{
+    struct termios tio;
+    int fd;
+    
+    if(path == NULL)
+        return STDIN_FILENO;
+    
+    fd = open(path, O_RDONLY | O_NOCTTY);
+    if(fd < 0) {
+        perror(path);
+        exit(1);
+    }
+    if(isatty(fd)) {
+        if(baud_constant(baud) == B0) {
+            fprintf(stderr, "unsupported baud rate %ld\n", baud);
+            exit(1);
+        }
+        tcgetattr(fd, &tio);
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, baud_constant(baud));
+        cfsetospeed(&tio, baud_constant(baud));
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *prefix = NULL;
+    long baud = 115200;
+    struct telemetry_reader_ reader;
+    uint8_t buf[4096];
+    int opt;
+    int fd;
+    int t;
+    ssize_t n;
+    
+    while((opt = getopt(argc, argv, "b:o:")) != -1) {
+        switch(opt) {
+        case 'b':
+            baud = strtol(optarg, NULL, 10);
+            break;
+        case 'o':
+            prefix = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-b baud] [-o prefix] [input]\n", argv[0]);
+            return 1;
+        }
+    }
+    fd = open_input(optind < argc ? argv[optind] : NULL, baud);
+    
+    if(prefix != NULL) {
+        char path[1024];
+        
+        split = 1;
+        for(t = 1; t < TELEMETRY_RECORD_TYPES; t++) {
+            snprintf(path, sizeof(path), "%s_%s.csv", prefix, type_name[t]);
+            out[t] = fopen(path, "w");
+            if(out[t] == NULL) {
+                perror(path);
+                return 1;
+            }
+            fprintf(out[t], "seq,%s\n", type_header[t]);
+        }
+    }
+    else {
+        printf("seq,type,fields...\n");
+        for(t = 1; t < TELEMETRY_RECORD_TYPES; t++)
+            printf("# %s: %s\n", type_name[t], type_header[t]);
+    }
+    
+    telemetry_reader_init(&reader, print_record, NULL);
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+        telemetry_reader_feed(&reader, buf, (size_t)n);
+    
+    if(split) {
+        for(t = 1; t < TELEMETRY_RECORD_TYPES; t++)
+            fclose(out[t]);
+    }
+    fprintf(stderr, "frames: %lu bad: %lu with junk: %lu dropped: %lu\n", reader.frames, reader.bad, reader.junk,
+            reader.dropped);
+    return 0;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file    telemetry_reader.c
+ * @brief   Host side reader of ZumoBot binary telemetry. For more details, please refer to telemetry_reader.h file.
+ * @details Frames with a bad CRC (including text printed on the same UART) are skipped and sequence gaps are counted
+ *          as dropped frames.
+*/
+#include <string.h>
+
+#include "telemetry_reader.h"
+#include "Crc.h"
+
+static const uint8_t type_len[TELEMETRY_RECORD_TYPES] = {
+    0, TELEMETRY_REFLECTANCE_LEN, TELEMETRY_PD_LEN, TELEMETRY_MOTOR_LEN, TELEMETRY_BATTERY_LEN,
+    TELEMETRY_INPUT_LEN, TELEMETRY_HEADING_LEN, TELEMETRY_RACE_LEN, TELEMETRY_CALIBRATION_LEN, TELEMETRY_EVENT_LEN
+};
+
+
+uint16_t telemetry_get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+
+uint32_t telemetry_get32(const uint8_t *p)
+{
+    return (uint32_t)telemetry_get16(p) | ((uint32_t)telemetry_get16(p + 2) << 16);
+}
+
+
+/**
+* @brief    Payload length of a record type
+* @return   0 for an unknown type
+*/
+uint8_t telemetry_record_len(uint8_t type)
+{
+    return type < TELEMETRY_RECORD_TYPES ? type_len[type] : 0;
+}
+
+
+/**
+* @brief    COBS decoding
+* @details  decodes one frame without its delimiter
+* @return   decoded length or -1 if the frame is malformed
+*/
+static int cobs_decode(const uint8_t *src, int len, uint8_t *dst, int max)
+{
+    int in = 0;
+    int n = 0;
+    
+    while(in < len) {
+        int code = src[in++];
+        int i;
+        
+        if(code == 0 || in + code - 1 > len)
+            return -1;
+        for(i = 1; i < code; i++) {
+            if(n >= max)
+                return -1;
+            dst[n++] = src[in++];
+        }
+        if(code < 0xFF && in < len) {
+            if(n >= max)
+                return -1;
+            dst[n++] = 0;
+        }
+    }
+    return n;
+}
+
+
+/**
+* @brief    Decoding and checking one frame
+* @return   record type or 0 if the frame is not valid
+*/
+static uint8_t check_frame(const uint8_t *raw, int raw_len, uint8_t *frame)
+{
+    int len = cobs_decode(raw, raw_len, frame, TELEMETRY_MAX_FRAME);
+    uint8_t type;
+    
+    if(len < 4 || crc16_ccitt(frame, (uint16_t)(len - 2)) != telemetry_get16(&frame[len - 2]))
+        return 0;
+    type = frame[0];
+    if(telemetry_record_len(type) == 0 || len - 4 != telemetry_record_len(type))
+        return 0;
+    return type;
+}
+
+
+/**
+* @brief    Handling bytes between two delimiters
+* @details  text printed on the same UART ends up in front of the next frame, so if the bytes don't decode as a
+*           frame, shorter tails of them are tried
+*/
+static void handle_frame(struct telemetry_reader_ *reader)
+{
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    uint8_t type = 0;
+    int start;
+    
+    for(start = 0; start < reader->raw_len && type == 0; start++)
+        type = check_frame(reader->raw + start, reader->raw_len - start, frame);
+    if(type == 0) {
+        reader->bad++;
+        return;
+    }
+    if(start > 1)
+        reader->junk++;
+    
+    if(reader->have_seq)
+        reader->dropped += (uint8_t)(frame[1] - reader->last_seq - 1u);
+    reader->last_seq = frame[1];
+    reader->have_seq = 1;
+    reader->frames++;
+    
+    reader->record(type, frame[1], &frame[2], reader->context);
+}
+
+
+/**
+* @brief    Starting a stream
+* @param    struct telemetry_reader_ *reader : reader state
+* @param    telemetry_record_fn record : called with every valid record
+* @param    void *context : passed to record
+*/
+void telemetry_reader_init(struct telemetry_reader_ *reader, telemetry_record_fn record, void *context)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->record = record;
+    reader->context = context;
+}
+
+
+/**
+* @brief    Reading bytes of the stream
+* @details  a record is handed to the callback when the delimiter after it has been read
+* @param    struct telemetry_reader_ *reader : reader state
+* @param    const uint8_t *data : bytes received
+* @param    size_t len : number of bytes
+*/
+void telemetry_reader_feed(struct telemetry_reader_ *reader, const uint8_t *data, size_t len)
+{
+    size_t i;
+    
+    for(i = 0; i < len; i++) {
+        if(data[i] == 0) {
+            if(reader->overflow)
+                reader->bad++;
+            else if(reader->raw_len > 0)
+                handle_frame(reader);
+            reader->raw_len = 0;
+            reader->overflow = 0;
+        }
+        else if(reader->raw_len < (int)sizeof(reader->raw)) {
+            reader->raw[reader->raw_len++] = data[i];
+        }
+        else {
+            reader->overflow = 1;
+        }
+    }
+}
@@ -0,0 +1,42 @@
+/**
+ * @file    telemetry_reader.h
+ * @brief   Host side reader of ZumoBot binary telemetry
+ * @details Splits a byte stream into COBS frames, checks them (see ZumoLibrary/TelemetryFormat.h) and hands the valid
+ *          records to a callback. Shared by telemetry_decode and replay.
+*/
+#ifndef TELEMETRY_READER_H_
+#define TELEMETRY_READER_H_
+#include <stddef.h>
+#include <stdint.h>
+
+#include "TelemetryFormat.h"
+
+#define TELEMETRY_RECORD_TYPES      10u     // record types are 1..TELEMETRY_RECORD_TYPES - 1
+
+typedef void (*telemetry_record_fn)(uint8_t type, uint8_t seq, const uint8_t *payload, void *context);
+
+/**
+* @brief    Reader state
+* @details  the counters are for the whole stream fed so far
+*/
+struct telemetry_reader_ {
+    uint8_t raw[256];               // bytes since the last delimiter
+    int raw_len;
+    int overflow;
+    int have_seq;
+    uint8_t last_seq;
+    telemetry_record_fn record;
+    void *context;
+    unsigned long frames;
+    unsigned long bad;              // bytes between delimiters that didn't contain a valid frame
+    unsigned long junk;             // valid frames with other bytes in front of them
+    unsigned long dropped;          // sequence gaps
+};
+
+void telemetry_reader_init(struct telemetry_reader_ *reader, telemetry_record_fn record, void *context);
+void telemetry_reader_feed(struct telemetry_reader_ *reader, const uint8_t *data, size_t len);
+uint8_t telemetry_record_len(uint8_t type);
+uint16_t telemetry_get16(const uint8_t *p);
+uint32_t telemetry_get32(const uint8_t *p);
+
+#endif
@@ -0,0 +1,607 @@
+/**
+ * @file    track_sim.c
+ * @brief   Line following race on a simulated track. For more details, please refer to track_sim.h file.
+ * @details main.c is compiled in here so the race uses its static pd_step, sharpTurn and calibration state as they are.
+ *          race_run does what main does from the button press to the finish line, without the waits for the button
+ *          and the remote. The race itself waits with sim_advance instead of main's busy-wait on lineCrossed, so it
+ *          runs many times faster than real time.<br>
+ *          The robot is a differential drive with a first order lag from PWM to track speed. The reflectance sensors
+ *          see the part of a small spot that is over the line, and the discharge time goes from white to black
+ *          linearly with it. The I2C bus has an L3GD20H whose z rate is the model's yaw rate, sampled at the output
+ *          data rate into its FIFO, so the firmware measures its sharp turns with the gyro as on the robot. The
+ *          LSM303D only answers its WHO_AM_I. l2 and r2 are not wired on the shield and are not simulated either.
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sim.h"
+#include "track_sim.h"
+
+#define main zumo_main
+#include "main.c"
+#undef main
+
+#define ROBOT_VMAX_MM_S     600.0       // track speed at PWM 255
+#define ROBOT_MOTOR_TAU_S   0.040       // speed lag of the motors and the robot's mass
+#define ROBOT_BASE_MM       98.0        // effective distance between the tracks, they skid when turning
+#define SENSOR_AHEAD_MM     50.0        // sensor array in front of the point between the tracks
+#define SENSOR_OUTER_MM     38.0        // l3 & r3 to the side of the centre line
+#define SENSOR_INNER_MM     9.0         // l1 & r1
+#define SENSOR_SPOT_MM      3.0         // radius of the spot a sensor sees
+#define SENSOR_WHITE_TICKS  4000.0      // discharge time on white, in bus clock cycles
+#define SENSOR_BLACK_TICKS  26000.0     // on black, longer than the 1 ms sensor timer period
+#define SENSOR_NOISE        0.02        // relative
+#define BAR_HALF_MM         60.0        // start/finish bar reaches this far to both sides of the line
+#define CALIBRATION_AT_MM   150.0       // where the robot is calibrated, from the start bar
+#define SETTLE_MS           200         // standing on the start line before the race
+#define STEP_MS             1
+#define TRACE_MS            10
+#define LOST_DNF_MS         1000
+#define XTE_DNF_MM          200.0
+#define LAP_MIN_PROGRESS    0.9
+#define GYRO_BIAS_COUNTS    -9          // z rate the gyro reads at rest
+#define GYRO_POWER_ON       0x08        // CTRL1 PD
+#define GYRO_FIFO_EN        0x40        // CTRL5
+#define GYRO_FIFO_MODE      0xE0        // FIFO_CTRL FM, 0 is bypass, the other modes act as stream mode here
+#define GYRO_FIFO_FTH       0x1F        // FIFO_CTRL watermark
+
+static const double sensor_side[SIM_SENSORS] = {
+    SENSOR_OUTER_MM, SENSOR_INNER_MM, -SENSOR_INNER_MM, -SENSOR_OUTER_MM    // L3, L1, R1, R3, left is positive
+};
+
+static struct {
+    const struct track_ *track;
+    const struct race_params_ *params;
+    struct race_result_ *result;
+    double x;                       // point between the tracks, mm
+    double y;
+    double heading;                 // radians
+    double v_left;                  // mm/s
+    double v_right;
+    double w;                       // yaw rate, rad/s counter-clockwise
+    uint32_t rng;                   // 32 bit LCG state
+    uint8 racing;
+    uint32 steps;
+    double last_s;
+    double driven;                  // along the line
+    double xte_sum;
+    double max_xte;
+    uint32 lost_ms;
+    uint32 losses;
+    uint8 dnf;
+} robot;
+
+static FILE *uart_file = NULL;
+
+/* L3GD20H with the registers the firmware uses */
+static struct {
+    struct sim_i2c_device_ dev;
+    uint8 regs[0x40];
+    uint8 reg;
+    uint8 increment;
+    int16 fifo[IMU_FIFO_DEPTH];     // z rates, x and y read 0
+    uint8 head;
+    uint8 level;
+    uint8 overrun;
+    uint64 next_at;                 // next sample at the output data rate
+} gyro;
+
+static struct sim_i2c_regs_ accel_magnet;
+
+
+/* track geometry */
+int track_load(struct track_ *track, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    const char *base = strrchr(path, '/');
+    char line[256];
+    uint32 size = 0;
+    double x, y;
+
+    memset(track, 0, sizeof(*track));
+    if(f == NULL) {
+        return 0;
+    }
+    snprintf(track->name, sizeof(track->name), "%s", base != NULL ? base + 1 : path);
+    if(strrchr(track->name, '.') != NULL) {
+        *strrchr(track->name, '.') = '\0';
+    }
+    track->width = 19.0;
+
+    while(fgets(line, sizeof(line), f) != NULL) {
+        if(line[0] == '#' || sscanf(line, "width %lf", &track->width) == 1) {
+            continue;
+        }
+        if(sscanf(line, "%lf %lf", &x, &y) != 2) {
+            continue;
+        }
+        if(track->n == size) {
+            size = size ? size * 2u : 256u;
+            track->x = realloc(track->x, size * sizeof(double));
+            track->y = realloc(track->y, size * sizeof(double));
+            track->s = realloc(track->s, size * sizeof(double));
+        }
+        track->x[track->n] = x;
+        track->y[track->n] = y;
+        track->s[track->n] = track->n ? track->s[track->n - 1u] + hypot(x - track->x[track->n - 1u],
+                                                                        y - track->y[track->n - 1u]) : 0.0;
+        track->n++;
+    }
+    fclose(f);
+
+    if(track->n < 3) {
+        track_free(track);
+        return 0;
+    }
+    track->length = track->s[track->n - 1u] + hypot(track->x[0] - track->x[track->n - 1u],
+                                                    track->y[0] - track->y[track->n - 1u]);
+    return 1;
+}
+
+
+void track_free(struct track_ *track)
+{
+    free(track->x);
+    free(track->y);
+    free(track->s);
+    memset(track, 0, sizeof(*track));
+}
+
+
+/**
+* @brief    Distance to the centreline
+* @details  also gives the distance along the line of the nearest point
+*/
+static double line_distance(const struct track_ *t, double px, double py, double *along)
+{
+    double best = INFINITY;
+    uint32 i;
+
+    for(i = 0; i < t->n; i++) {
+        uint32 j = (i + 1u) % t->n;
+        double dx = t->x[j] - t->x[i], dy = t->y[j] - t->y[i];
+        double len2 = dx * dx + dy * dy;
+        double u = len2 > 0.0 ? ((px - t->x[i]) * dx + (py - t->y[i]) * dy) / len2 : 0.0;
+        double d;
+
+        u = u < 0.0 ? 0.0 : u > 1.0 ? 1.0 : u;
+        d = hypot(px - t->x[i] - u * dx, py - t->y[i] - u * dy);
+        if(d < best) {
+            best = d;
+            if(along != NULL) {
+                *along = t->s[i] + u * sqrt(len2);
+            }
+        }
+    }
+    return best;
+}
+
+
+static double coverage(double inside)
+{
+    double c = inside / (2.0 * SENSOR_SPOT_MM) + 0.5;
+
+    return c < 0.0 ? 0.0 : c > 1.0 ? 1.0 : c;
+}
+
+
+/**
+* @brief    How much of a sensor spot is black
+* @details  the line or the start/finish bar across the first segment
+*/
+static double darkness(const struct track_ *t, double px, double py)
+{
+    double tx = t->x[1] - t->x[0], ty = t->y[1] - t->y[0];
+    double len = hypot(tx, ty);
+    double u, v, line, bar;
+
+    line = coverage(t->width / 2.0 - line_distance(t, px, py, NULL));
+    u = fabs(((px - t->x[0]) * tx + (py - t->y[0]) * ty) / len);
+    v = fabs(((px - t->x[0]) * -ty + (py - t->y[0]) * tx) / len);
+    bar = coverage(fmin(t->width / 2.0 - u, BAR_HALF_MM - v));
+    return fmax(line, bar);
+}
+
+
+static void sensor_position(uint8 sensor, double *px, double *py)
+{
+    double c = cos(robot.heading), s = sin(robot.heading);
+
+    *px = robot.x + c * SENSOR_AHEAD_MM - s * sensor_side[sensor];
+    *py = robot.y + s * SENSOR_AHEAD_MM + c * sensor_side[sensor];
+}
+
+
+static double noise(void)
+{
+    robot.rng = robot.rng * 1664525u + 1013904223u;
+    return ((double)(robot.rng >> 8) / (double)(1u << 24) - 0.5) * 2.0 * SENSOR_NOISE;
+}
+
+
+/**
+* @brief    Discharge time of a reflectance sensor
+* @details  called by the HAL when the firmware releases the sensor pin
+*/
+static uint32 sensor_ticks(uint8 sensor)
+{
+    double px, py, ticks;
+
+    sensor_position(sensor, &px, &py);
+    ticks = SENSOR_WHITE_TICKS + darkness(robot.track, px, py) * (SENSOR_BLACK_TICKS - SENSOR_WHITE_TICKS);
+    return (uint32)(ticks * (1.0 + noise()));
+}
+
+
+/**
+* @brief    Storing a gyroscope sample
+* @details  in the FIFO when it is enabled and not in bypass mode, the oldest sample is overwritten when it is full.
+*           Otherwise straight in the output registers.
+*/
+static void gyro_store(int16 z)
+{
+    uint8 *out = &gyro.regs[OUT_X_AXIS_L];
+
+    if((gyro.regs[GYRO_CTRL5_REG] & GYRO_FIFO_EN) && (gyro.regs[GYRO_FIFO_CTRL_REG] & GYRO_FIFO_MODE)) {
+        gyro.fifo[(gyro.head + gyro.level) % IMU_FIFO_DEPTH] = z;
+        if(gyro.level < IMU_FIFO_DEPTH) {
+            gyro.level++;
+        }
+        else {
+            gyro.head = (gyro.head + 1u) % IMU_FIFO_DEPTH;
+            gyro.overrun = 1;
+        }
+        return;
+    }
+    memset(out, 0, 6);
+    out[4] = (uint8)z;
+    out[5] = (uint8)((uint16)z >> 8);
+}
+
+
+/**
+* @brief    Sampling the gyroscope
+* @details  stores the samples due since the last call at the output data rate (CTRL1 DR) and the full scale (CTRL4 FS)
+*           the firmware has set. Runs from step, so the rate is at most STEP_MS old.
+*/
+static void gyro_sample(void)
+{
+    static const uint16 odr_hz[4] = { 100, 200, 400, 800 };
+    static const double mdps_lsb[4] = { 8.75, 17.5, 70.0, 70.0 };
+    uint64 period = SIM_CLOCK_HZ / odr_hz[gyro.regs[GYRO_CTRL1_REG] >> 6];
+    double counts = robot.w * 180.0 / M_PI * 1000.0 / mdps_lsb[(gyro.regs[GYRO_CTRL4_REG] >> 4) & 3u];
+    int16 z;
+
+    counts = fmax(-32768.0, fmin(32767.0, round(counts) + GYRO_BIAS_COUNTS));
+    z = (int16)counts;
+    if(!(gyro.regs[GYRO_CTRL1_REG] & GYRO_POWER_ON)) {
+        gyro.next_at = sim_now() + period;
+        return;
+    }
+    while(gyro.next_at <= sim_now()) {
+        gyro_store(z);
+        gyro.next_at += period;
+    }
+}
+
+
+/**
+* @brief    Reading the oldest FIFO sample to the output registers
+* @details
+*/
+static void gyro_pop(void)
+{
+    uint8 *out = &gyro.regs[OUT_X_AXIS_L];
+    int16 z = gyro.fifo[gyro.head];
+
+    if(gyro.level == 0) {
+        return;
+    }
+    gyro.head = (gyro.head + 1u) % IMU_FIFO_DEPTH;
+    gyro.level--;
+    gyro.overrun = 0;
+    memset(out, 0, 6);
+    out[4] = (uint8)z;
+    out[5] = (uint8)((uint16)z >> 8);
+}
+
+
+static int gyro_write(struct sim_i2c_device_ *dev, const uint8 *data, uint32 len)
+{
+    (void)dev;
+    if(len == 0) {
+        return 1;
+    }
+    gyro.reg = data[0] & (uint8)~IMU_AUTO_INCREMENT;
+    gyro.increment = (data[0] & IMU_AUTO_INCREMENT) != 0;
+    for(data++, len--; len > 0; data++, len--) {
+        gyro.regs[gyro.reg % sizeof(gyro.regs)] = *data;
+        if(gyro.reg == GYRO_FIFO_CTRL_REG && !(*data & GYRO_FIFO_MODE)) {
+            gyro.level = 0;                         // bypass empties the FIFO
+            gyro.overrun = 0;
+        }
+        gyro.reg += gyro.increment;
+    }
+    return 1;
+}
+
+
+/**
+* @brief    Reading the gyroscope registers
+* @details  with the FIFO enabled a read of OUT_X_L takes the next sample and the address wraps from OUT_Z_H back to
+*           OUT_X_L, so one burst reads many samples
+*/
+static int gyro_read(struct sim_i2c_device_ *dev, uint8 *data, uint32 len)
+{
+    uint8 fifo = (gyro.regs[GYRO_CTRL5_REG] & GYRO_FIFO_EN) != 0;
+    uint8 fth = gyro.regs[GYRO_FIFO_CTRL_REG] & GYRO_FIFO_FTH;
+
+    (void)dev;
+    for(; len > 0; data++, len--) {
+        uint8 reg = gyro.reg % sizeof(gyro.regs);
+
+        if(reg == OUT_X_AXIS_L && fifo) {
+            gyro_pop();
+        }
+        else if(reg == GYRO_FIFO_SRC_REG) {
+            gyro.regs[reg] = (gyro.level >= fth && fth > 0 ? 0x80 : 0) | (gyro.overrun ? 0x40 : 0) |
+                             (gyro.level == 0 ? 0x20 : 0) | (gyro.level < 31u ? gyro.level : 31u);
+        }
+        *data = gyro.regs[reg];
+        if(gyro.increment) {
+            gyro.reg = fifo && reg == OUT_X_AXIS_L + 5u ? OUT_X_AXIS_L : gyro.reg + 1u;
+        }
+    }
+    return 1;
+}
+
+
+/**
+* @brief    Putting the IMU chips on the I2C bus
+* @details  the registers read 0 until the firmware writes them, like after a power on
+*/
+static void imu_attach(void)
+{
+    memset(&gyro, 0, sizeof(gyro));
+    gyro.regs[WHO_AM_I_GYRO] = 0xD7;
+    gyro.dev.addr = GYRO_ADDR;
+    gyro.dev.write = gyro_write;
+    gyro.dev.read = gyro_read;
+    sim_i2c_attach(&gyro.dev);
+
+    sim_i2c_regs_init(&accel_magnet, ACCEL_MAG_ADDR, IMU_AUTO_INCREMENT);
+    accel_magnet.regs[WHO_AM_I_ACCEL] = 0x49;
+}
+
+
+/**
+* @brief    Putting the robot down
+* @details  sensor array centre on the line, at the given distance from the start bar along the first segment
+*/
+static void place(double at_mm)
+{
+    const struct track_ *t = robot.track;
+
+    robot.heading = atan2(t->y[1] - t->y[0], t->x[1] - t->x[0]);
+    robot.x = t->x[0] + cos(robot.heading) * (at_mm - SENSOR_AHEAD_MM);
+    robot.y = t->y[0] + sin(robot.heading) * (at_mm - SENSOR_AHEAD_MM);
+    robot.v_left = 0.0;
+    robot.v_right = 0.0;
+}
+
+
+/**
+* @brief    Race bookkeeping on every step
+* @details  progress along the line, cross-track error of the sensor array and line losses
+*/
+static void measure(void)
+{
+    const struct track_ *t = robot.track;
+    double ax, ay, along, xte, ds;
+    uint8 sensor, seen = 0;
+
+    ax = robot.x + cos(robot.heading) * SENSOR_AHEAD_MM;
+    ay = robot.y + sin(robot.heading) * SENSOR_AHEAD_MM;
+    xte = line_distance(t, ax, ay, &along);
+
+    ds = along - robot.last_s;
+    if(ds > t->length / 2.0) {
+        ds -= t->length;
+    }
+    else if(ds < -t->length / 2.0) {
+        ds += t->length;
+    }
+    if(fabs(ds) < t->width) {       // jumps come from the nearest point moving to another part of the track
+        robot.driven += ds;
+    }
+    robot.last_s = along;
+
+    robot.xte_sum += xte;
+    if(xte > robot.max_xte) {
+        robot.max_xte = xte;
+    }
+
+    for(sensor = 0; sensor < SIM_SENSORS; sensor++) {
+        double px, py;
+        sensor_position(sensor, &px, &py);
+        seen |= darkness(t, px, py) >= 0.5;
+    }
+    if(!seen) {
+        if(robot.lost_ms == 0) {
+            robot.losses++;
+        }
+        robot.lost_ms += STEP_MS;
+    }
+    else {
+        robot.lost_ms = 0;
+    }
+
+    if(robot.lost_ms > LOST_DNF_MS || xte > XTE_DNF_MM) {
+        robot.dnf = 1;
+    }
+}
+
+
+/**
+* @brief    Moving the robot
+* @details  runs every STEP_MS of simulated time
+*/
+static void step(void *arg)
+{
+    const double dt = STEP_MS / 1000.0;
+    const double lag = 1.0 - exp(-dt / ROBOT_MOTOR_TAU_S);
+    double v, w;
+    int16 left, right;
+
+    (void)arg;
+    sim_motor(&left, &right);
+    robot.v_left += (left / 255.0 * ROBOT_VMAX_MM_S - robot.v_left) * lag;
+    robot.v_right += (right / 255.0 * ROBOT_VMAX_MM_S - robot.v_right) * lag;
+
+    v = (robot.v_left + robot.v_right) / 2.0;
+    w = (robot.v_right - robot.v_left) / ROBOT_BASE_MM;
+    robot.x += v * cos(robot.heading + w * dt / 2.0) * dt;
+    robot.y += v * sin(robot.heading + w * dt / 2.0) * dt;
+    robot.heading += w * dt;
+    robot.w = w;
+    gyro_sample();
+
+    if(!robot.racing) {
+        return;
+    }
+    measure();
+    if(robot.params->trace != NULL && robot.steps % (TRACE_MS / STEP_MS) == 0) {
+        fprintf(robot.params->trace, "%lu,%.1f,%.1f,%.1f,%d,%d\n", (unsigned long)(millis() - raceStart),
+                robot.x, robot.y, robot.heading * 180.0 / M_PI, left, right);
+    }
+    robot.steps++;
+}
+
+
+static void uart_to_file(const uint8 *data, uint32 len)
+{
+    fwrite(data, 1, len, uart_file);
+}
+
+
+static ssize_t firmware_write(void *cookie, const char *buf, size_t size)
+{
+    (void)cookie;
+    return _write(1, (char *)buf, (int)size);
+}
+
+
+void race_defaults(struct race_params_ *params)
+{
+    memset(params, 0, sizeof(*params));
+    params->kp = (double)Kp / Q16_ONE;
+    params->kd = (double)Kd / Q16_ONE;
+    params->base = BASE_SPEED;
+    params->timeout_s = 60.0;
+    params->seed = 1;
+}
+
+
+/**
+* @brief    Firmware side of a race
+* @details  runs under sim_run, which takes care of the firmware's busy-waits on samples
+*/
+static int race_firmware(void)
+{
+    const struct race_params_ *params = robot.params;
+    struct race_result_ *result = robot.result;
+    uint64 end;
+
+    // boot as main does
+    CyGlobalIntEnable;
+    systime_start();
+    UART_1_Start();
+    uart_tx_start();
+    telemetry_enable(uart_file != NULL);
+    reflectance_start();
+    gyroOk = gyro_heading_start();
+    result->gyro = gyroOk;
+    memset(&cal, 0, sizeof(cal));
+    cal.mag.scale_x = MAGNET_SCALE_ONE;
+    cal.mag.scale_y = MAGNET_SCALE_ONE;
+    cal.mag.scale_z = MAGNET_SCALE_ONE;
+
+    result->calibrated = calibrate();
+    if(!result->calibrated) {
+        return 0;
+    }
+    apply_calibration();
+
+    place(0.0);
+    CyDelay(SETTLE_MS);
+    robot.last_s = 0.0;
+    robot.racing = 1;
+
+    race_begin(Q16(params->kp), Q16(params->kd), (uint8)params->base, millis());
+    control_tick_start(CONTROL_RATE_HZ, pd_step);
+    end = sim_now() + (uint64)(params->timeout_s * SIM_CLOCK_HZ);
+    while(!lineCrossed && !robot.dnf && sim_now() < end) {
+        sim_advance(SIM_MS(STEP_MS));
+    }
+    control_tick_stop();
+    motor_forward(0, 0);
+    robot.racing = 0;
+
+    result->progress = robot.driven / robot.track->length;
+    result->finished = lineCrossed && result->progress >= LAP_MIN_PROGRESS;
+    result->false_finish = lineCrossed && !result->finished;
+    result->lap_s = (double)(int32)(sample.time_ms - raceStart) / 1000.0;
+    result->max_xte_mm = robot.max_xte;
+    result->mean_xte_mm = robot.steps ? robot.xte_sum / robot.steps : 0.0;
+    result->line_losses = robot.losses;
+
+    CyDelay(50);                    // lets the UART drain
+    return 0;
+}
+
+
+/**
+* @brief    Running one race
+* @details  boots the firmware, calibrates on the line, then races from the start bar until the firmware sees the
+*           finish line, the robot is lost or the timeout passes. Can only be called once per process.
+*/
+void race_run(const struct track_ *track, const struct race_params_ *params, struct race_result_ *result)
+{
+    static cookie_io_functions_t firmware_out = { NULL, firmware_write, NULL, NULL };
+    FILE *host_out = stdout;
+
+    memset(result, 0, sizeof(*result));
+    memset(&robot, 0, sizeof(robot));
+    robot.track = track;
+    robot.params = params;
+    robot.result = result;
+    robot.rng = params->seed;
+    place(CALIBRATION_AT_MM);
+
+    uart_file = params->uart_path != NULL ? fopen(params->uart_path, "wb") : NULL;
+    sim_uart_output(uart_file != NULL ? uart_to_file : NULL);
+    sim_reflectance_model(sensor_ticks);
+    if(!params->no_gyro) {
+        imu_attach();
+    }
+    sim_every(SIM_MS(STEP_MS), step, NULL);
+    if(params->trace != NULL) {
+        fprintf(params->trace, "time_ms,x_mm,y_mm,heading_deg,left,right\n");
+    }
+
+    // the firmware's printf goes to its UART
+    stdout = fopencookie(NULL, "w", firmware_out);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    sim_run(race_firmware, 0);
+    fclose(stdout);
+    stdout = host_out;
+
+    result->dnf = !result->finished && !result->false_finish;
+    if(uart_file != NULL) {
+        fclose(uart_file);
+        uart_file = NULL;
+    }
+}
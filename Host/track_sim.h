@@ -0,0 +1,66 @@
+/**
+ * @file    track_sim.h
+ * @brief   Line following race on a simulated track
+ * @details Drives the firmware's own race code (calibrate, pd_step on the control tick, the finish line check) on the
+ *          host HAL, with a differential drive model moved by the motor PWMs and the reflectance sensors rendered from
+ *          a track drawn as a polyline. One race per process, the firmware state is global.
+*/
+#ifndef TRACK_SIM_H_
+#define TRACK_SIM_H_
+#include <stdio.h>
+#include <project.h>
+
+/**
+* @brief    Track
+* @details  closed centreline of a black line on white, the start/finish bar crosses it at the first point
+*/
+struct track_ {
+    char name[64];
+    uint32 n;
+    double *x;                      // mm
+    double *y;
+    double *s;                      // distance along the line to each point
+    double length;
+    double width;                   // line width in mm
+};
+
+/**
+* @brief    Race settings
+* @details  kp and kd are the PD gains as real numbers, base the PD base speed in motor PWM units
+*/
+struct race_params_ {
+    double kp;
+    double kd;
+    int base;
+    double timeout_s;
+    uint32 seed;                    // sensor noise
+    int no_gyro;                    // leave the IMU off the I2C bus, the firmware races without the gyro
+    const char *uart_path;          // UART output with telemetry, NULL for none
+    FILE *trace;                    // pose every 10 ms as CSV, NULL for none
+};
+
+/**
+* @brief    Race result
+* @details  lap_s is the time from the start to the firmware seeing the finish line. A finish seen before the robot
+*           has gone round is a false finish. A race ends as did not finish when the line was lost for too long,
+*           the robot was too far off the line or the timeout passed.
+*/
+struct race_result_ {
+    int calibrated;
+    int finished;
+    int false_finish;
+    int dnf;
+    int gyro;                       // the firmware found the gyro and measured its sharp turns with it
+    double lap_s;
+    double max_xte_mm;              // largest distance of the sensor array centre from the line
+    double mean_xte_mm;
+    uint32 line_losses;             // times none of the sensors saw the line
+    double progress;                // part of the lap driven, 1.0 for a full lap
+};
+
+int track_load(struct track_ *track, const char *path);
+void track_free(struct track_ *track);
+void race_defaults(struct race_params_ *params);
+void race_run(const struct track_ *track, const struct race_params_ *params, struct race_result_ *result);
+
+#endif
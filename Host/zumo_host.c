@@ -0,0 +1,193 @@
+/**
+ * @file    zumo_host.c
+ * @brief   Runs the ZumoBot firmware on Linux
+ * @details main.c and ZumoLibrary are built unmodified against the simulated components in hal/ (see hal/sim.h), with
+ *          main renamed to zumo_main. printf goes through the firmware's _write and the UART, so stdout shows what
+ *          the serial port would, telemetry frames included.<br>
+ *          Build: make (see Makefile)<br>
+ *          Usage: zumo_host [-t seconds] [-e eeprom] [-o output] [-b battery_mv] [-p ms[:length_ms]]... [-i ms:command]...
+ *          [-s ms:text]...<br>
+ *          -t stops the run after the given virtual time (default 10 s). -e loads the EEPROM from a file and saves it
+ *          back at the end. -o writes the UART output to a file instead of stdout. -p presses SW1 at the given time
+ *          for length_ms (default 200 ms). -i sends an NEC command from the remote (address 0) at the given time and
+ *          -s types text on the serial terminal.
+ *          The robot sees a white floor and no I2C sensors.
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+#define DEFAULT_LIMIT_S     10u
+#define DEFAULT_PRESS_MS    200u
+#define MAX_ACTIONS         32u
+
+int zumo_main(void);
+int _write(int file, char *ptr, int len);
+
+struct action_ {
+    uint32 at_ms;
+    uint32 value;
+};
+
+struct serial_ {
+    uint32 at_ms;
+    const char *text;
+};
+
+static FILE *uart_file = NULL;
+
+
+static ssize_t firmware_write(void *cookie, const char *buf, size_t size)
+{
+    (void)cookie;
+    return _write(1, (char *)buf, (int)size);
+}
+
+
+static void uart_to_file(const uint8 *data, uint32 len)
+{
+    fwrite(data, 1, len, uart_file);
+}
+
+
+static void button(void *arg)
+{
+    sim_pin_input("SW1", (uint8)(uintptr_t)arg);
+}
+
+
+static void remote(void *arg)
+{
+    sim_ir_nec(0, (uint8)(uintptr_t)arg);
+}
+
+
+static void serial(void *arg)
+{
+    const char *text = arg;
+
+    sim_uart_input((const uint8 *)text, (uint32)strlen(text));
+}
+
+
+static int parse_serial(const char *arg, struct serial_ *input)
+{
+    char *end;
+
+    input->at_ms = (uint32)strtoul(arg, &end, 0);
+    input->text = end + 1;
+    return end != arg && *end == ':';
+}
+
+
+static int parse_action(const char *arg, uint32 fallback, struct action_ *action)
+{
+    char *end;
+
+    action->at_ms = (uint32)strtoul(arg, &end, 0);
+    action->value = fallback;
+    if(*end == ':') {
+        action->value = (uint32)strtoul(end + 1, &end, 0);
+    }
+    return end != arg && *end == '\0';
+}
+
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t seconds] [-e eeprom] [-o output] [-b battery_mv] [-p ms[:length_ms]]... "
+                    "[-i ms:command]... [-s ms:text]...\n", name);
+}
+
+
+int main(int argc, char *argv[])
+{
+    static cookie_io_functions_t firmware_out = { NULL, firmware_write, NULL, NULL };
+    struct action_ presses[MAX_ACTIONS];
+    struct action_ commands[MAX_ACTIONS];
+    struct serial_ inputs[MAX_ACTIONS];
+    uint32 n_presses = 0, n_commands = 0, n_inputs = 0, i;
+    double limit_s = DEFAULT_LIMIT_S;
+    const char *eeprom = NULL;
+    int returned;
+    int opt;
+
+    while((opt = getopt(argc, argv, "t:e:o:b:p:i:s:")) != -1) {
+        switch(opt) {
+        case 't':
+            limit_s = atof(optarg);
+            break;
+        case 'e':
+            eeprom = optarg;
+            break;
+        case 'o':
+            uart_file = fopen(optarg, "wb");
+            if(uart_file == NULL) {
+                perror(optarg);
+                return 1;
+            }
+            sim_uart_output(uart_to_file);
+            break;
+        case 'b':
+            sim_battery_mv((uint32)strtoul(optarg, NULL, 0));
+            break;
+        case 'p':
+            if(n_presses == MAX_ACTIONS || !parse_action(optarg, DEFAULT_PRESS_MS, &presses[n_presses++])) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'i':
+            if(n_commands == MAX_ACTIONS || !parse_action(optarg, 0, &commands[n_commands++])) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 's':
+            if(n_inputs == MAX_ACTIONS || !parse_serial(optarg, &inputs[n_inputs++])) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(eeprom != NULL && !sim_eeprom_load(eeprom)) {
+        fprintf(stderr, "%s: starting with an erased EEPROM\n", eeprom);
+    }
+    for(i = 0; i < n_presses; i++) {
+        sim_after(SIM_MS(presses[i].at_ms), button, (void *)(uintptr_t)0);
+        sim_after(SIM_MS(presses[i].at_ms + presses[i].value), button, (void *)(uintptr_t)1);
+    }
+    for(i = 0; i < n_commands; i++) {
+        sim_after(SIM_MS(commands[i].at_ms), remote, (void *)(uintptr_t)commands[i].value);
+    }
+    for(i = 0; i < n_inputs; i++) {
+        sim_after(SIM_MS(inputs[i].at_ms), serial, (void *)inputs[i].text);
+    }
+
+    // the firmware's stdout is the UART, like newlib's on the robot
+    stdout = fopencookie(NULL, "w", firmware_out);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    returned = sim_run(zumo_main, (uint64)(limit_s * SIM_CLOCK_HZ));
+    fflush(stdout);
+    sim_advance(SIM_MS(100));
+
+    fprintf(stderr, "%s after %.3f s, %lu interrupts, %lu bytes sent\n", returned ? "main returned" : "stopped",
+            (double)sim_now() / SIM_CLOCK_HZ, (unsigned long)sim_interrupts(), (unsigned long)sim_uart_sent());
+    if(eeprom != NULL && !sim_eeprom_save(eeprom)) {
+        perror(eeprom);
+    }
+    if(uart_file != NULL) {
+        fclose(uart_file);
+    }
+    return 0;
+}
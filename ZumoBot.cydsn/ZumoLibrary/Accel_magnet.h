@@ -3,6 +3,8 @@
  * @brief   Accelerometer and Magnetometer header file.
  * @details If you want to use Accelerometer methods, you need to include Accel_magnet.h file. Defining register address for basic setting up and reading sensor output values.
 */
+#ifndef ACCEL_MAGNET_H_
+#define ACCEL_MAGNET_H_
 #include <project.h>
 #include <stdio.h>
 #include <math.h>
@@ -15,7 +17,10 @@ void value_convert_accel(uint16 X_AXIS, uint16 Y_AXIS, uint16 Z_AXIS);
 
 #define WHO_AM_I_ACCEL      0x0F
 #define ACCEL_MAG_ADDR      0x1D
+#define ACCEL_CTRL0_REG     0x1F
 #define ACCEL_CTRL1_REG     0x20                
+#define ACCEL_CTRL5_REG     0x24
+#define ACCEL_CTRL6_REG     0x25
 #define ACCEL_CTRL7_REG     0x26
 
 #define OUT_X_L_M           0x08            // Magnetometer output
@@ -32,4 +37,7 @@ void value_convert_accel(uint16 X_AXIS, uint16 Y_AXIS, uint16 Z_AXIS);
 #define OUT_Z_L_A           0x2C
 #define OUT_Z_H_A           0x2D
 
+#define ACCEL_FIFO_CTRL_REG 0x2E            // Accelerometer FIFO
+#define ACCEL_FIFO_SRC_REG  0x2F
 
+#endif
@@ -1,25 +1,218 @@
-/* ========================================
- *
- * Copyright YOUR COMPANY, THE YEAR
- * All Rights Reserved
- * UNPUBLISHED, LICENSED SOFTWARE.
- *
- * CONFIDENTIAL AND PROPRIETARY INFORMATION
- * WHICH IS THE PROPERTY OF your company.
- *
- * ========================================
-*/
-#include <project.h>
+/**
+ * @file    Beep.c
+ * @brief   Buzzer tune sequencer. For more details, please refer to Beep.h file.
+ * @details Notes are played by Buzzer_PWM and timed by a SysTime service, which counts down the SysTick periods of
+ *          the current note and loads the next one from the queue when it is done. A rest keeps the PWM running at
+ *          1 kHz with a zero compare value so the output stays low.
+*/
 #include "Beep.h"
+#include "SysTime.h"
 
-void Beep(uint32 length, uint8 pitch)
+#define BEEP_QUEUE_MASK     (BEEP_QUEUE_SIZE - 1u)
+#define BEEP_REST_PERIOD    (BEEP_CLOCK_HZ / 1000u - 1u)
+
+struct queued_note_ {
+    uint32 periods;     // number of SysTick periods to play
+    uint8 pitch;
+};
+
+static struct queued_note_ queue[BEEP_QUEUE_SIZE];
+static volatile uint8 q_head = 0;           // next free slot, written by the enqueue functions
+static volatile uint8 q_tail = 0;           // next note to play, written by the service
+static volatile uint32 remaining = 0;       // periods left of the note being played
+static volatile int playing = 0;
+static volatile beep_done_t on_done = NULL;
+static int started = 0;
+
+
+/**
+* @brief    Loading the next note to Buzzer_PWM
+* @details  called from the service or with interrupts disabled. Stops the PWM and calls the completion callback when
+*           the queue is empty.
+*/
+static void next_note(void)
+{
+    beep_done_t done;
+    
+    if(q_tail == q_head) {
+        Buzzer_PWM_Stop();
+        playing = 0;
+        done = on_done;
+        on_done = NULL;
+        if(done != NULL) {
+            done();
+        }
+        return;
+    }
+    
+    remaining = queue[q_tail].periods;
+    if(queue[q_tail].pitch == BEEP_REST) {
+        Buzzer_PWM_WriteCompare(0);
+        Buzzer_PWM_WritePeriod(BEEP_REST_PERIOD);
+    }
+    else {
+        Buzzer_PWM_WriteCompare(queue[q_tail].pitch / 2);
+        Buzzer_PWM_WritePeriod(queue[q_tail].pitch);
+    }
+    q_tail = (q_tail + 1u) & BEEP_QUEUE_MASK;
+}
+
+
+/**
+* @brief    SysTime service
+* @details  moves to the next note when the current one has played its SysTick periods
+*/
+static void beep_service(void)
+{
+    if(!playing) {
+        return;
+    }
+    if(remaining > 1u) {
+        remaining--;
+    }
+    else {
+        next_note();
+    }
+}
+
+
+/**
+* @brief    Adding a note to the queue
+* @details  called with interrupts disabled. Starts playing if the buzzer is idle.
+*/
+static void enqueue(uint32 length, uint8 pitch)
+{
+    queue[q_head].periods = length * (SYSTIME_SERVICE_HZ / 1000u);
+    queue[q_head].pitch = pitch;
+    q_head = (q_head + 1u) & BEEP_QUEUE_MASK;
+    
+    if(!playing) {
+        if(!started) {
+            started = systime_add_service(beep_service);
+        }
+        playing = 1;
+        Buzzer_PWM_Start();
+        next_note();
+    }
+}
+
+
+/**
+* @brief    Free slots in the queue
+* @details
+*/
+static uint8 queue_free(void)
+{
+    return (uint8)((q_tail - q_head - 1u) & BEEP_QUEUE_MASK);
+}
+
+
+/**
+* @brief    Queueing a note
+* @details  never waits. A zero length note is ignored.
+* @param    uint32 length : length of the note in ms
+* @param    uint8 pitch : Buzzer_PWM period, BEEP_REST for silence
+* @return   int
+*   - returns 1 if the note was queued, 0 if the queue is full
+*/
+int beep_note(uint32 length, uint8 pitch)
+{
+    uint8 intr;
+    
+    if(length == 0) {
+        return 1;
+    }
+    intr = CyEnterCriticalSection();
+    if(queue_free() == 0) {
+        CyExitCriticalSection(intr);
+        return 0;
+    }
+    enqueue(length, pitch);
+    CyExitCriticalSection(intr);
+    
+    return 1;
+}
+
+
+/**
+* @brief    Queueing a rest
+* @details  never waits
+* @param    uint32 length : length of the rest in ms
+* @return   int
+*   - returns 1 if the rest was queued, 0 if the queue is full
+*/
+int beep_rest(uint32 length)
+{
+    return beep_note(length, BEEP_REST);
+}
+
+
+/**
+* @brief    Queueing a tune
+* @details  never waits. If all notes don't fit, none of them are queued. done is called from the SysTick interrupt when
+*           the queue runs empty after the tune and replaces any earlier callback.
+* @param    const struct note_ *tune : notes and rests to play
+* @param    uint8 count : number of notes
+* @param    beep_done_t done : completion callback, NULL if not needed
+* @return   int
+*   - returns 1 if the tune was queued, 0 if it doesn't fit
+*/
+int beep_play(const struct note_ *tune, uint8 count, beep_done_t done)
+{
+    uint8 intr = CyEnterCriticalSection();
+    uint8 i;
+    
+    if(count > queue_free()) {
+        CyExitCriticalSection(intr);
+        return 0;
+    }
+    on_done = done;
+    for(i = 0; i < count; i++) {
+        if(tune[i].length > 0) {
+            enqueue(tune[i].length, tune[i].pitch);
+        }
+    }
+    CyExitCriticalSection(intr);
+    
+    return 1;
+}
+
+
+/**
+* @brief    Checking if the buzzer is playing
+* @details
+*/
+int beep_busy()
 {
-    uint8 cmp = pitch / 2;
-    Buzzer_PWM_Start();
-    Buzzer_PWM_WriteCompare(cmp);
-    Buzzer_PWM_WritePeriod(pitch);
-    CyDelay(length);
-    Buzzer_PWM_Stop();
+    return playing;
 }
 
-/* [] END OF FILE */
+
+/**
+* @brief    Stopping the buzzer and emptying the queue
+* @details  the completion callback is not called
+*/
+void beep_cancel()
+{
+    uint8 intr = CyEnterCriticalSection();
+    
+    on_done = NULL;
+    q_tail = q_head;
+    if(playing) {
+        next_note();
+    }
+    CyExitCriticalSection(intr);
+}
+
+
+/**
+* @brief    Playing a note and waiting until it is done
+* @details  waits for the notes already in the queue too
+* @param    uint32 length : length of the note in ms
+* @param    uint8 pitch : Buzzer_PWM period
+*/
+void Beep(uint32 length, uint8 pitch)
+{
+    while(!beep_note(length, pitch));
+    while(beep_busy());
+}
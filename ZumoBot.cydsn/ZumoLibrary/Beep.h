@@ -1,6 +1,30 @@
+/**
+ * @file    Beep.h
+ * @brief   Buzzer header file
+ * @details If you want to play notes without waiting, include Beep.h file. Notes and rests are queued and a SysTime
+ *          service moves to the next one when the current one has played long enough. SysTime must be started first.
+*/
 #ifndef BEEP_H_
 #define BEEP_H_
+#include <project.h>
+
+#define BEEP_CLOCK_HZ       200000u     // Buzzer_PWM clock (Clock_2)
+#define BEEP_QUEUE_SIZE     64u         // must be a power of two
+#define BEEP_REST           0u          // pitch of a rest
+
+/* one note of a tune. pitch is the Buzzer_PWM period, frequency is BEEP_CLOCK_HZ / (pitch + 1) */
+struct note_ {
+    uint16 length;      // ms
+    uint8 pitch;        // BEEP_REST for silence
+};
+
+typedef void (*beep_done_t)(void);
 
 void Beep(uint32 length, uint8 pitch);
+int beep_note(uint32 length, uint8 pitch);
+int beep_rest(uint32 length);
+int beep_play(const struct note_ *tune, uint8 count, beep_done_t done);
+int beep_busy(void);
+void beep_cancel(void);
 
-#endif 
\ No newline at end of file
+#endif
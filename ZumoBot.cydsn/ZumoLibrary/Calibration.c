@@ -0,0 +1,95 @@
+/**
+ * @file    Calibration.c
+ * @brief   Calibration store in EEPROM. For more details, please refer to Calibration.h file.
+ * @details The record is written row by row with CyWriteRowData and read back through the memory mapped EEPROM.
+ *          A version, size and CRC-16 check decide if a stored record can be used.
+*/
+#include <stddef.h>
+#include <string.h>
+#include "Calibration.h"
+#include "Crc.h"
+
+#define CALIBRATION_ROWS    ((sizeof(struct calibration_) + CY_EEPROM_SIZEOF_ROW - 1u) / CY_EEPROM_SIZEOF_ROW)
+
+
+/**
+* @brief    Loading calibration record
+* @details  copies the stored record to cal
+* @param    struct calibration_ *cal : loaded record
+* @return   uint8
+*   - returns 1 if the record has the current version and a valid CRC, otherwise 0
+*/
+uint8 calibration_load(struct calibration_ *cal)
+{
+    CyEEPROM_Start();
+    CyEEPROM_ReadReserve();
+    memcpy(cal, (const void *)CY_EEPROM_BASE, sizeof(*cal));
+    CyEEPROM_ReadRelease();
+    
+    if(cal->version != CALIBRATION_VERSION || cal->size != sizeof(*cal))
+        return 0;
+    
+    return crc16_ccitt((const uint8 *)cal, offsetof(struct calibration_, crc)) == cal->crc;
+}
+
+
+/**
+* @brief    Saving calibration record
+* @details  fills in version, size and crc and writes the record to the first EEPROM rows. Takes a few ms per row.
+* @param    struct calibration_ *cal : record to save
+* @return   cystatus
+*   - returns CYRET_SUCCESS or the error of the failed row write
+*/
+cystatus calibration_save(struct calibration_ *cal)
+{
+    uint8 row[CY_EEPROM_SIZEOF_ROW];
+    const uint8 *src = (const uint8 *)cal;
+    uint16 left = sizeof(*cal);
+    uint16 i;
+    cystatus status;
+    
+    cal->version = CALIBRATION_VERSION;
+    cal->size = sizeof(*cal);
+    cal->crc = crc16_ccitt((const uint8 *)cal, offsetof(struct calibration_, crc));
+    
+    CyEEPROM_Start();
+    status = CySetTemp();
+    if(status != CYRET_SUCCESS)
+        return status;
+    
+    for(i = 0; i < CALIBRATION_ROWS; i++) {
+        uint16 n = left < CY_EEPROM_SIZEOF_ROW ? left : CY_EEPROM_SIZEOF_ROW;
+        
+        memset(row, 0, sizeof(row));
+        memcpy(row, src, n);
+        status = CyWriteRowData(CY_SPC_FIRST_EE_ARRAYID, i, row);
+        if(status != CYRET_SUCCESS)
+            return status;
+        src += n;
+        left -= n;
+    }
+    return CYRET_SUCCESS;
+}
+
+
+/**
+* @brief    Checking the stored PD gains against the build's
+* @details  Stored gains were tuned from the defaults of the build that stored them. If the defaults have changed since,
+*           the gains are replaced with the new defaults, so a retuned build doesn't race with the old gains.
+* @param    struct calibration_ *cal : loaded or cleared record
+* @param    q16_t default_kp : Kp of this build
+* @param    q16_t default_kd : Kd of this build
+* @return   uint8
+*   - returns 1 if the stored gains were kept, 0 if they were replaced
+*/
+uint8 calibration_gains(struct calibration_ *cal, q16_t default_kp, q16_t default_kd)
+{
+    if(cal->default_kp == default_kp && cal->default_kd == default_kd)
+        return 1;
+    
+    cal->kp = default_kp;
+    cal->kd = default_kd;
+    cal->default_kp = default_kp;
+    cal->default_kd = default_kd;
+    return 0;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file    Calibration.h
+ * @brief   Calibration store header file
+ * @details If you want to keep calibration values over reset, include Calibration.h file. The record is stored at the start of the on-chip EEPROM.
+*/
+#ifndef CALIBRATION_H_
+#define CALIBRATION_H_
+#include <project.h>
+#include "Reflectance.h"
+#include "PD.h"
+#include "Magnet.h"
+
+#define CALIBRATION_VERSION     4u
+
+/**
+* @brief    Calibration record
+* @details  version, size and crc are filled in by calibration_save
+*/
+struct calibration_ {
+    uint16 version;
+    uint16 size;
+    struct sensors_ white;          // raw reflectance on background (minimum)
+    struct sensors_ black;          // raw reflectance on line (maximum)
+    struct sensors_ threshold;      // reflectance_digital thresholds
+    q16_t kp;
+    q16_t kd;
+    q16_t default_kp;               // the build's Kp and Kd when kp and kd were stored
+    q16_t default_kd;
+    int8 trim_left;                 // added to left motor speed
+    int8 trim_right;                // added to right motor speed
+    struct magnet_calibration_ mag;
+    uint16 crc;
+};
+
+uint8 calibration_load(struct calibration_ *cal);
+cystatus calibration_save(struct calibration_ *cal);
+uint8 calibration_gains(struct calibration_ *cal, q16_t default_kp, q16_t default_kd);
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * @file    ControlTick.c
+ * @brief   Fixed rate control tick. For more details, please refer to ControlTick.h file.
+ * @details The tick needs no timer of its own. A SysTime service counts SysTick periods and on every tick sets the
+ *          control tick NVIC line pending from software. The handler runs at CONTROL_TICK_PRIORITY, below the
+ *          interrupts the step depends on, so the step itself can be preempted by them and by SysTick.
+*/
+#include <project.h>
+
+#include "ControlTick.h"
+#include "SysTime.h"
+
+static volatile control_step_t control_step = NULL;
+static volatile uint32 ticks = 0;
+static volatile uint32 overruns = 0;
+static volatile uint16 max_latency = 0;
+static volatile uint32 pended_us = 0;           // micros() when the tick was pended
+static uint16 divider = 1;                      // SysTick periods per tick
+static uint16 periods = 0;
+static uint8 service_added = 0;
+
+
+/**
+* @brief    SysTime service
+* @details  pends the control tick interrupt every divider SysTick periods while a step function is set
+*/
+static void control_tick_service(void)
+{
+    if(control_step == NULL) {
+        return;
+    }
+    if(++periods >= divider) {
+        periods = 0;
+        pended_us = micros();
+        CyIntSetPending(CONTROL_TICK_IRQ);
+    }
+}
+
+
+/**
+* @brief    Control tick Interrupt Handler
+* @details  Measures how late the handler started after the tick was pended, runs the step function and counts an
+*           overrun if the next tick became pending before the step function returned
+*/
+CY_ISR(control_tick_handler)
+{
+    uint32 latency = micros() - pended_us;
+    
+    ticks++;
+    if(latency > max_latency) {
+        max_latency = latency < 0xFFFFu ? (uint16)latency : 0xFFFFu;
+    }
+    
+    if(control_step != NULL) {
+        control_step();
+    }
+    
+    if(*CY_INT_SET_PEND_PTR & (1u << CONTROL_TICK_IRQ)) {
+        overruns++;                                             // Step took longer than one period
+    }
+}
+
+
+/**
+* @brief    Starting control tick
+* @details  SysTime must be started first. rate_hz must divide SYSTIME_SERVICE_HZ, other rates are rounded up to the
+*           next rate that does.
+* @param    uint16 rate_hz : tick rate in Hz
+* @param    control_step_t step : function called on every tick
+*/
+void control_tick_start(uint16 rate_hz, control_step_t step)
+{
+    uint8 intr;
+    
+    control_tick_reset_stats();
+    CyIntDisable(CONTROL_TICK_IRQ);
+    CyIntClearPending(CONTROL_TICK_IRQ);
+    (void)CyIntSetVector(CONTROL_TICK_IRQ, control_tick_handler);
+    CyIntSetPriority(CONTROL_TICK_IRQ, CONTROL_TICK_PRIORITY);
+    CyIntEnable(CONTROL_TICK_IRQ);
+    
+    intr = CyEnterCriticalSection();
+    divider = (uint16)(SYSTIME_SERVICE_HZ / rate_hz);
+    if(divider == 0) {
+        divider = 1;
+    }
+    periods = 0;
+    control_step = step;
+    CyExitCriticalSection(intr);
+    
+    if(!service_added) {
+        service_added = systime_add_service(control_tick_service);
+    }
+}
+
+
+/**
+* @brief    Stopping control tick
+* @details
+*/
+void control_tick_stop()
+{
+    control_step = NULL;
+    CyIntDisable(CONTROL_TICK_IRQ);
+    CyIntClearPending(CONTROL_TICK_IRQ);
+}
+
+
+/**
+* @brief    Number of ticks since control_tick_start
+* @details
+*/
+uint32 control_tick_count()
+{
+    return ticks;
+}
+
+
+/**
+* @brief    Number of ticks where the step function overran the period
+* @details
+*/
+uint32 control_tick_overruns()
+{
+    return overruns;
+}
+
+
+/**
+* @brief    Worst case delay from pending the tick to handler entry
+* @details  returned in microseconds
+*/
+uint16 control_tick_max_jitter_us()
+{
+    return max_latency;
+}
+
+
+/**
+* @brief    Clearing tick, overrun and jitter statistics
+* @details
+*/
+void control_tick_reset_stats()
+{
+    uint8 intr = CyEnterCriticalSection();
+    ticks = 0;
+    overruns = 0;
+    max_latency = 0;
+    CyExitCriticalSection(intr);
+}
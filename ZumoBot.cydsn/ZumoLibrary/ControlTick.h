@@ -0,0 +1,25 @@
+/**
+ * @file    ControlTick.h
+ * @brief   Control tick header file
+ * @details If you want to run code at a fixed rate, include ControlTick.h file. A SysTime service divides the SysTick rate down to the tick rate and pends the
+ *          control tick interrupt, whose handler runs the registered step function.
+*/
+#ifndef CONTROLTICK_H_
+#define CONTROLTICK_H_
+#include <project.h>
+
+#define CONTROL_TICK_IRQ        31u     // NVIC line the step runs on, nothing in TopDesign is placed on it
+#define CONTROL_TICK_PRIORITY   7u      // lowest, the sensor, ultrasonic and I2C interrupts preempt the step
+
+typedef void (*control_step_t)(void);
+
+CY_ISR_PROTO(control_tick_handler);
+
+void control_tick_start(uint16 rate_hz, control_step_t step);
+void control_tick_stop(void);
+uint32 control_tick_count(void);
+uint32 control_tick_overruns(void);
+uint16 control_tick_max_jitter_us(void);
+void control_tick_reset_stats(void);
+
+#endif
@@ -0,0 +1,30 @@
+/**
+ * @file    Crc.c
+ * @brief   CRC calculation. For more details, please refer to Crc.h file.
+ * @details
+*/
+#include "Crc.h"
+
+
+/**
+* @brief    CRC-16-CCITT
+* @details  polynomial 0x1021, initial value 0xFFFF, no reflection, no final xor
+* @param    const uint8_t *data : data
+* @param    uint16_t len : number of bytes
+*/
+uint16_t crc16_ccitt(const uint8_t *data, uint16_t len)
+{
+    uint16_t crc = 0xFFFFu;
+    uint8_t i;
+    
+    while(len--) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for(i = 0; i < 8; i++) {
+            if(crc & 0x8000u)
+                crc = (uint16_t)((crc << 1) ^ 0x1021u);
+            else
+                crc <<= 1;
+        }
+    }
+    return crc;
+}
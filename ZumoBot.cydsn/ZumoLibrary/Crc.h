@@ -0,0 +1,12 @@
+/**
+ * @file    Crc.h
+ * @brief   CRC header file
+ * @details If you want to check data integrity, include Crc.h file. Only depends on stdint.h so host tools can use it too.
+*/
+#ifndef CRC_H_
+#define CRC_H_
+#include <stdint.h>
+
+uint16_t crc16_ccitt(const uint8_t *data, uint16_t len);
+
+#endif
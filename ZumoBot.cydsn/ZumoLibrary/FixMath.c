@@ -0,0 +1,69 @@
+/**
+ * @file    FixMath.c
+ * @brief   Integer math. For more details, please refer to FixMath.h file.
+ * @details The Cortex-M3 has no floating point unit, these take a fixed and small number of cycles instead.
+*/
+#include <stdlib.h>
+#include "FixMath.h"
+
+
+/**
+* @brief    Angle of a vector
+* @details  atan(z) ~= 45 z + 15.64 z (1 - z) degrees for 0 <= z <= 1, then folded to the right octant. The error
+*           is below 0.23 degrees.
+* @param    int64 y : y component
+* @param    int64 x : x component
+* @return   int32
+*   - returns the angle in millidegrees, -180000..180000
+*/
+int32 fix_atan2_mdeg(int64 y, int64 x)
+{
+    int32 ay, ax, z, a;
+    
+    while(llabs(y) > 0x7FFF || llabs(x) > 0x7FFF) {
+        y >>= 1;
+        x >>= 1;
+    }
+    ay = abs((int32)y);
+    ax = abs((int32)x);
+    if(ax == 0 && ay == 0) {
+        return 0;
+    }
+    
+    z = ay <= ax ? (ay << 15) / ax : (ax << 15) / ay;
+    a = (45000 * z + 15640 * ((z * (32768 - z)) >> 15)) >> 15;
+    if(ay > ax) {
+        a = 90000 - a;
+    }
+    if(x < 0) {
+        a = 180000 - a;
+    }
+    return y < 0 ? -a : a;
+}
+
+
+/**
+* @brief    Integer square root
+* @details  rounds down
+* @param    uint64 n : value
+*/
+uint32 fix_isqrt(uint64 n)
+{
+    uint64 bit = (uint64)1 << 62;
+    uint64 root = 0;
+    
+    while(bit > n) {
+        bit >>= 2;
+    }
+    while(bit != 0) {
+        if(n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32)root;
+}
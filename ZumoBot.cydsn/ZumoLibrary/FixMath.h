@@ -0,0 +1,13 @@
+/**
+ * @file    FixMath.h
+ * @brief   Integer math header file
+ * @details If you need angles or square roots without floating point, include FixMath.h file.
+*/
+#ifndef FIXMATH_H_
+#define FIXMATH_H_
+#include <project.h>
+
+int32 fix_atan2_mdeg(int64 y, int64 x);
+uint32 fix_isqrt(uint64 n);
+
+#endif
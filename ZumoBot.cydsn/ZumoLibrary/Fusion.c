@@ -0,0 +1,241 @@
+/**
+ * @file    Fusion.c
+ * @brief   Attitude and heading fusion. For more details, please refer to Fusion.h file.
+ * @details Every gyroscope sample turns the angles by rate / FUSION_GYRO_RATE_HZ. Every accelerometer sample moves roll
+ *          and pitch 1/2^FUSION_ACCEL_SHIFT of the way to the angles of the gravity vector, unless the robot is being
+ *          pushed or bumped (length of the vector not near 1 g). Every magnetometer sample moves yaw towards the tilt
+ *          compensated compass direction. The compass needs no trigonometry: east = mag x up and north = up x east
+ *          are computed in body axes and yaw is the angle of the x axis between them.
+ *
+ *          Angles are kept in 1/256 millidegrees. The only non-trivial operations per update are one fix_isqrt and
+ *          one or two fix_atan2_mdeg, so an update costs the same every time.
+*/
+#include "Fusion.h"
+#include "FixMath.h"
+#include "Magnet.h"
+#include "SysTime.h"
+
+#define ANGLE_SHIFT     8
+#define HALF_TURN       (180000L << ANGLE_SHIFT)
+#define MDPS_LSB        70                      // gyroscope mdps per count at 2000 dps
+#define ACCEL_SHIFT     4                       // accelerometer counts >> 4, 1 g = 1024
+#define ONE_G           1024
+#define MAG_EVERY       (FUSION_GYRO_RATE_HZ / FUSION_MAG_RATE_HZ)
+
+static struct attitude_ angle;                  // in 1/256 mdeg
+static int32 bias[3];                           // gyroscope rate at rest << ANGLE_SHIFT
+static struct imu_axes_ up;                     // last accelerometer sample, full resolution for the compass
+static struct imu_axes_ mag;                    // written by the magnetometer read, only while mag_new is 0
+static struct i2c_xfer_ mag_xfer;
+static volatile uint8 mag_busy = 0;
+static volatile uint8 mag_new = 0;
+static uint16 gyro_count = 0;
+
+
+/**
+* @brief    Wrapping an angle to -180..180 degrees
+* @details  angle in 1/256 mdeg
+*/
+static int32 wrap(int32 a)
+{
+    while(a > HALF_TURN) {
+        a -= 2 * HALF_TURN;
+    }
+    while(a < -HALF_TURN) {
+        a += 2 * HALF_TURN;
+    }
+    return a;
+}
+
+
+/**
+* @brief    Moving an angle part of the way to a measured angle
+* @details  the shorter way around
+* @param    int32 *a : angle in 1/256 mdeg
+* @param    int32 measured : measured angle in mdeg
+* @param    uint8 shift : the angle moves 1/2^shift of the difference
+*/
+static void correct(int32 *a, int32 measured, uint8 shift)
+{
+    int32 d = wrap((measured << ANGLE_SHIFT) - *a);
+    *a = wrap(*a + (d >> shift));
+}
+
+
+/**
+* @brief    I2C callback of a magnetometer read
+* @details
+*/
+static void mag_done(struct i2c_xfer_ *xfer)
+{
+    if(xfer->status == I2C_XFER_DONE) {
+        mag_new = 1;
+    }
+    mag_busy = 0;
+}
+
+
+/**
+* @brief    Turning the angles by one gyroscope sample
+* @details
+*/
+static void add_gyro(const struct imu_axes_ *g)
+{
+    angle.roll = wrap(angle.roll + (((int32)g->x << ANGLE_SHIFT) - bias[0]) * MDPS_LSB / FUSION_GYRO_RATE_HZ);
+    angle.pitch = wrap(angle.pitch + (((int32)g->y << ANGLE_SHIFT) - bias[1]) * MDPS_LSB / FUSION_GYRO_RATE_HZ);
+    angle.yaw = wrap(angle.yaw + (((int32)g->z << ANGLE_SHIFT) - bias[2]) * MDPS_LSB / FUSION_GYRO_RATE_HZ);
+}
+
+
+/**
+* @brief    Pulling roll and pitch towards gravity
+* @details  skipped when the acceleration isn't close to 1 g
+*/
+static void add_accel(const struct imu_axes_ *a)
+{
+    int32 x = a->x >> ACCEL_SHIFT, y = a->y >> ACCEL_SHIFT, z = a->z >> ACCEL_SHIFT;
+    int32 yz2 = y * y + z * z;
+    int32 len2 = x * x + yz2;
+    
+    up = *a;
+    if(len2 < ONE_G * ONE_G * 9 / 16 || len2 > ONE_G * ONE_G * 25 / 16) {
+        return;
+    }
+    correct(&angle.roll, fix_atan2_mdeg(y, z), FUSION_ACCEL_SHIFT);
+    correct(&angle.pitch, fix_atan2_mdeg(-x, fix_isqrt((uint64)yz2)), FUSION_ACCEL_SHIFT);
+}
+
+
+/**
+* @brief    Tilt compensated compass direction
+* @details  east = mag x up, north = up x east. east is scaled by |up| so both have the same length. The magnetometer
+*           sample is corrected with the calibration set by magnet_set_calibration.
+* @param    int32 *yaw : compass yaw in millidegrees
+* @return   int
+*   - returns 0 if there is no accelerometer sample yet
+*/
+static int compass_mdeg(int32 *yaw)
+{
+    struct imu_axes_ m;
+    int64 ex, ey, ez, nx;
+    uint32 len;
+    
+    magnet_correct(&mag, &m);
+    ex = (int64)m.y * up.z - (int64)m.z * up.y;
+    ey = (int64)m.z * up.x - (int64)m.x * up.z;
+    ez = (int64)m.x * up.y - (int64)m.y * up.x;
+    nx = up.y * ez - up.z * ey;
+    len = fix_isqrt((uint64)((int64)up.x * up.x + (int64)up.y * up.y + (int64)up.z * up.z));
+    
+    if(len == 0) {
+        return 0;
+    }
+    *yaw = fix_atan2_mdeg(-ex * len, nx);
+    return 1;
+}
+
+
+/**
+* @brief    Starting the fusion
+* @details  starts FIFO streaming and measures the gyroscope bias for FUSION_BIAS_MS, the robot must not move. The
+*           angles start from the accelerometer and magnetometer readings.
+* @return   int
+*   - returns 1 if the sensors are working, 0 if they didn't answer or gave too few samples in FUSION_START_TIMEOUT_MS
+*/
+int fusion_start()
+{
+    const int32 count = FUSION_GYRO_RATE_HZ * FUSION_BIAS_MS / 1000;
+    struct imu_axes_ g, a;
+    int32 total[3] = {0, 0, 0};
+    int32 n = 0;
+    int32 yaw;
+    uint32 start;
+    
+    if(!imu_fifo_start(IMU_FIFO_ACCEL | IMU_FIFO_GYRO, FUSION_ACCEL_ODR, FUSION_GYRO_ODR, FUSION_WATERMARK)) {
+        return 0;
+    }
+    
+    start = millis();
+    while(n < count) {
+        if(millis() - start > FUSION_START_TIMEOUT_MS) {
+            imu_fifo_stop();
+            return 0;
+        }
+        imu_fifo_poll();
+        while(n < count && imu_fifo_gyro(&g)) {
+            total[0] += g.x;
+            total[1] += g.y;
+            total[2] += g.z;
+            n++;
+        }
+        while(imu_fifo_accel(&a)) {
+            up = a;
+        }
+        CyDelay(1000 * FUSION_WATERMARK / FUSION_GYRO_RATE_HZ / 2);
+    }
+    for(n = 0; n < 3; n++) {
+        bias[n] = (total[n] << ANGLE_SHIFT) / count;
+    }
+    
+    angle.roll = fix_atan2_mdeg(up.y, up.z) << ANGLE_SHIFT;
+    angle.pitch = fix_atan2_mdeg(-up.x, fix_isqrt((uint64)((int64)up.y * up.y + (int64)up.z * up.z))) << ANGLE_SHIFT;
+    angle.yaw = 0;
+    if(imu_read_mag(&mag) && compass_mdeg(&yaw)) {
+        angle.yaw = yaw << ANGLE_SHIFT;
+    }
+    
+    return 1;
+}
+
+
+/**
+* @brief    Updating the angles
+* @details  never waits. Uses the samples already read from the FIFO, queues the next FIFO read and a magnetometer
+*           read at its data rate. Call at least once per FUSION_WATERMARK gyroscope samples, for example from the
+*           control tick. A magnetometer read is only queued once the previous sample has been used, so the compass
+*           never sees a sample that is being overwritten.
+*/
+void fusion_update()
+{
+    struct imu_axes_ s;
+    int32 yaw;
+    
+    while(imu_fifo_gyro(&s)) {
+        add_gyro(&s);
+        if(++gyro_count >= MAG_EVERY && !mag_busy && !mag_new) {
+            gyro_count = 0;
+            mag_busy = 1;
+            if(!imu_read_mag_async(&mag_xfer, &mag, mag_done)) {
+                mag_busy = 0;
+            }
+        }
+    }
+    while(imu_fifo_accel(&s)) {
+        add_accel(&s);
+    }
+    if(mag_new) {
+        if(compass_mdeg(&yaw)) {
+            correct(&angle.yaw, yaw, FUSION_MAG_SHIFT);
+        }
+        mag_new = 0;
+    }
+    imu_fifo_poll();
+}
+
+
+/**
+* @brief    Reading the angles
+* @details
+* @param    struct attitude_ *attitude : roll, pitch and yaw in millidegrees
+*/
+void fusion_read(struct attitude_ *attitude)
+{
+    uint8 intr = CyEnterCriticalSection();
+    struct attitude_ a = angle;
+    CyExitCriticalSection(intr);
+    
+    attitude->roll = a.roll >> ANGLE_SHIFT;
+    attitude->pitch = a.pitch >> ANGLE_SHIFT;
+    attitude->yaw = a.yaw >> ANGLE_SHIFT;
+}
+
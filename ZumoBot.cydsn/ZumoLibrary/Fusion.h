@@ -0,0 +1,35 @@
+/**
+ * @file    Fusion.h
+ * @brief   Attitude and heading fusion header file
+ * @details If you want the robot's yaw, pitch and roll, include Fusion.h file. A fixed point complementary filter
+ *          integrates the gyroscope and pulls the result slowly towards the accelerometer (pitch, roll) and the
+ *          magnetometer (yaw). Don't use it together with gyro_heading_update, both take the samples from the FIFO.
+*/
+#ifndef FUSION_H_
+#define FUSION_H_
+#include <project.h>
+#include "ImuFifo.h"
+
+#define FUSION_GYRO_ODR         IMU_GYRO_ODR_200HZ
+#define FUSION_GYRO_RATE_HZ     200             // gyroscope samples per second
+#define FUSION_ACCEL_ODR        IMU_ACCEL_ODR_50HZ
+#define FUSION_MAG_RATE_HZ      25              // magnetometer rate set by imu_start
+#define FUSION_WATERMARK        8               // samples per FIFO burst
+#define FUSION_BIAS_MS          500             // time to measure the gyroscope bias at start
+#define FUSION_START_TIMEOUT_MS 1000            // gives up if the bias samples take longer
+#define FUSION_ACCEL_SHIFT      5               // accelerometer weight 1/32 per sample, 0.6 s time constant
+#define FUSION_MAG_SHIFT        5               // magnetometer weight 1/32 per sample, 1.3 s time constant
+
+/* angles in millidegrees, -180000..180000. Body axes: x forward, y left, z up, positive angles turn
+   counter-clockwise around the axis (roll: left side up, pitch: nose down, yaw: turning left) */
+struct attitude_ {
+    int32 roll;
+    int32 pitch;
+    int32 yaw;
+};
+
+int fusion_start(void);
+void fusion_update(void);
+void fusion_read(struct attitude_ *attitude);
+
+#endif
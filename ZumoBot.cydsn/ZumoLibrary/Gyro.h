@@ -12,10 +12,14 @@ uint16 value_convert_gyro(uint16 raw);
 #define GYRO_ADDR           0x6B
 #define GYRO_CTRL1_REG      0x20  
 #define GYRO_CTRL4_REG      0x23
+#define GYRO_CTRL5_REG      0x24
 #define OUT_X_AXIS_L        0x28            // Gyroscope output
 #define OUT_X_AXIS_H        0x29
 #define OUT_Y_AXIS_L        0x2A
 #define OUT_Y_AXIS_H        0x2B
 #define OUT_Z_AXIS_L        0x2C
 #define OUT_Z_AXIS_H        0x2D
+#define GYRO_FIFO_CTRL_REG  0x2E            // Gyroscope FIFO
+#define GYRO_FIFO_SRC_REG   0x2F
+#define GYRO_LOW_ODR_REG    0x39
 
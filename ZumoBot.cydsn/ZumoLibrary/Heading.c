@@ -0,0 +1,117 @@
+/**
+ * @file    Heading.c
+ * @brief   Gyroscope heading estimator. For more details, please refer to Heading.h file.
+ * @details Every sample covers exactly 1 / GYRO_HEADING_RATE_HZ seconds because the chip's output data rate sets the
+ *          tick, so the heading is the sum of the bias corrected z rates. The sum is kept in counts * 256 so the bias
+ *          doesn't have to be a whole count, and it is scaled to millidegrees only when read. Counter-clockwise seen
+ *          from above is positive. The heading isn't wrapped, a full turn left reads 360 degrees.
+*/
+#include "Heading.h"
+#include "SysTime.h"
+
+#define BIAS_SHIFT  8
+
+static int64 sum = 0;               // (z << BIAS_SHIFT) - bias summed over the samples
+static int32 bias = 0;              // z rate at rest << BIAS_SHIFT
+
+
+/**
+* @brief    Starting the heading estimator
+* @details  starts FIFO streaming and measures the gyroscope bias for GYRO_HEADING_BIAS_MS. The robot must not move
+*           during that time. SysTime must be started first.
+* @return   int
+*   - returns 1 if the gyroscope is working, 0 if it didn't answer or gave too few samples in GYRO_HEADING_TIMEOUT_MS
+*/
+int gyro_heading_start()
+{
+    const int32 count = GYRO_HEADING_RATE_HZ * GYRO_HEADING_BIAS_MS / 1000;
+    struct imu_axes_ gyro;
+    int32 total = 0;
+    int32 n = 0;
+    uint32 start;
+    
+    if(!imu_fifo_start(IMU_FIFO_GYRO, 0, GYRO_HEADING_ODR, GYRO_HEADING_WATERMARK)) {
+        return 0;
+    }
+    
+    start = millis();
+    while(n < count) {
+        if(millis() - start > GYRO_HEADING_TIMEOUT_MS) {
+            imu_fifo_stop();
+            return 0;
+        }
+        imu_fifo_poll();
+        while(n < count && imu_fifo_gyro(&gyro)) {
+            total += gyro.z;
+            n++;
+        }
+        CyDelay(1000 * GYRO_HEADING_WATERMARK / GYRO_HEADING_RATE_HZ / 2);
+    }
+    bias = (total << BIAS_SHIFT) / count;
+    gyro_heading_reset();
+    
+    return 1;
+}
+
+
+/**
+* @brief    Adding one gyroscope sample to the heading
+* @details  samples must come at GYRO_HEADING_RATE_HZ
+* @param    const struct imu_axes_ *gyro : gyroscope sample
+*/
+void gyro_heading_add(const struct imu_axes_ *gyro)
+{
+    sum += ((int32)gyro->z << BIAS_SHIFT) - bias;
+}
+
+
+/**
+* @brief    Updating the heading
+* @details  never waits. Adds the samples already read from the FIFO and queues the next FIFO read. Call at least once
+*           per GYRO_HEADING_WATERMARK samples, for example from the control tick.
+*/
+void gyro_heading_update()
+{
+    struct imu_axes_ gyro;
+    
+    while(imu_fifo_gyro(&gyro)) {
+        gyro_heading_add(&gyro);
+    }
+    imu_fifo_poll();
+}
+
+
+/**
+* @brief    Setting the current heading to zero
+* @details
+*/
+void gyro_heading_reset()
+{
+    uint8 intr = CyEnterCriticalSection();
+    sum = 0;
+    CyExitCriticalSection(intr);
+}
+
+
+/**
+* @brief    Heading in millidegrees
+* @details  counter-clockwise is positive, not wrapped to a full turn
+*/
+int32 gyro_heading_mdeg()
+{
+    uint8 intr = CyEnterCriticalSection();
+    int64 s = sum;
+    CyExitCriticalSection(intr);
+    
+    return (int32)(s * GYRO_HEADING_MDPS_LSB / ((int64)GYRO_HEADING_RATE_HZ << BIAS_SHIFT));
+}
+
+
+/**
+* @brief    Heading in degrees
+* @details  counter-clockwise is positive, not wrapped to a full turn
+*/
+int32 gyro_heading_deg()
+{
+    return gyro_heading_mdeg() / 1000;
+}
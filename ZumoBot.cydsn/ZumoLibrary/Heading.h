@@ -0,0 +1,26 @@
+/**
+ * @file    Heading.h
+ * @brief   Gyroscope heading header file
+ * @details If you want to know how much the robot has turned, include Heading.h file. The gyroscope z axis is sampled
+ *          by the chip at a fixed rate through its FIFO and integrated in fixed point.
+*/
+#ifndef HEADING_H_
+#define HEADING_H_
+#include <project.h>
+#include "ImuFifo.h"
+
+#define GYRO_HEADING_ODR        IMU_GYRO_ODR_200HZ
+#define GYRO_HEADING_RATE_HZ    200             // samples per second at GYRO_HEADING_ODR
+#define GYRO_HEADING_MDPS_LSB   70              // mdps per count at 2000 dps full scale
+#define GYRO_HEADING_WATERMARK  8               // samples per FIFO burst
+#define GYRO_HEADING_BIAS_MS    500             // time to measure the bias at start
+#define GYRO_HEADING_TIMEOUT_MS 1000            // gives up if the bias samples take longer
+
+int gyro_heading_start(void);
+void gyro_heading_add(const struct imu_axes_ *gyro);
+void gyro_heading_update(void);
+void gyro_heading_reset(void);
+int32 gyro_heading_mdeg(void);
+int32 gyro_heading_deg(void);
+
+#endif
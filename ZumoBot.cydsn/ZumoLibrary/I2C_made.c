@@ -4,6 +4,7 @@
  * @details 
 */
 #include "I2C_made.h"
+#include "I2cAsync.h"
 
 
 /**
@@ -15,13 +16,13 @@
 */
 void I2C_write(uint8 device_addr, uint8 Reg, uint8 value)             // Gyroscope: you need to change the value of PD of CTRL1 register(20h) to power on 
 {
+    struct i2c_xfer_ xfer;
     uint8 write_buf[2] = {};
     write_buf[0] = Reg;                //register address that you want to write
     write_buf[1] = value;                //value that you want to write to register
     
-    I2C_MasterClearStatus();
-    I2C_MasterWriteBuf(device_addr, write_buf, 2, I2C_MODE_COMPLETE_XFER);
-    while(((I2C_MasterStatus()) & I2C_MSTAT_WR_CMPLT) == 0);
+    while(!i2c_write_async(&xfer, device_addr, write_buf, 2, NULL));
+    i2c_wait(&xfer);
     
     return;
 }
@@ -29,26 +30,20 @@ void I2C_write(uint8 device_addr, uint8 Reg, uint8 value)             // Gyrosco
 
 /**
 * @brief    Read function of I2C communication
-* @details  read value from slave register by I2C communication
+* @details  read value from slave register by I2C communication. The register address is written and the value read
+*           back after a repeated start. Returns 0 if the slave doesn't answer.
 * @param    uint8 device_addr : Slave Device address
 * @param    uint8 Reg : register address
 */
 uint8 I2C_read(uint8 device_addr, uint8 Reg) 
 {
-   
-    uint8 write_buf[1] = {};
-    write_buf[0] = Reg;
-    
+    struct i2c_xfer_ xfer;
     uint8 read_buf[1] = {};
     
-    I2C_MasterClearStatus();
-    CyDelay(100);
-    I2C_MasterWriteBuf(device_addr, write_buf, 1, I2C_MODE_COMPLETE_XFER);
-    while((I2C_MasterStatus() & I2C_MSTAT_WR_CMPLT) == 0);
-    CyDelay(50);
-    I2C_MasterClearStatus();
-    I2C_MasterReadBuf(device_addr, read_buf, 1, I2C_MODE_COMPLETE_XFER);
-    while((I2C_MasterStatus() & I2C_MSTAT_RD_CMPLT) == 0);
+    while(!i2c_write_read_async(&xfer, device_addr, &Reg, 1, read_buf, 1, NULL));
+    if(!i2c_wait(&xfer)) {
+        return 0;
+    }
    
     return read_buf[0];
 }
@@ -0,0 +1,253 @@
+/**
+ * @file    I2cAsync.c
+ * @brief   Queued I2C transfers. For more details, please refer to I2cAsync.h file.
+ * @details The generated I2C master already moves the bytes in its interrupt. I2C_ISR_ExitCallback (enabled in
+ *          cyapicallbacks.h) runs at the end of every I2C interrupt, checks whether the current phase has completed
+ *          and starts the read phase or the next queued transfer. If the bus is taken when a transfer should start,
+ *          it is retried from the next i2c_submit or i2c_done call.
+*/
+#include "I2cAsync.h"
+
+#define I2C_QUEUE_MASK      (I2C_QUEUE_SIZE - 1u)
+
+#define PHASE_IDLE          0u
+#define PHASE_WRITE         1u
+#define PHASE_READ          2u
+
+static struct i2c_xfer_ *volatile queue[I2C_QUEUE_SIZE];
+static volatile uint8 q_head = 0;           // next free slot, written by i2c_submit
+static volatile uint8 q_tail = 0;           // transfer on the bus, written by the ISR
+static volatile uint8 phase = PHASE_IDLE;
+
+
+/**
+* @brief    Starting the transfer at the head of the queue
+* @details  called from the ISR or with interrupts disabled. Leaves phase idle if the master isn't ready.
+*/
+static void start_next(void)
+{
+    struct i2c_xfer_ *xfer;
+    uint8 err;
+    
+    if(phase != PHASE_IDLE || q_tail == q_head) {
+        return;
+    }
+    
+    xfer = queue[q_tail];
+    I2C_MasterClearStatus();
+    if(xfer->wr_len > 0) {
+        err = I2C_MasterWriteBuf(xfer->addr, (uint8 *)xfer->wr, xfer->wr_len,
+                                 xfer->rd_len > 0 ? I2C_MODE_NO_STOP : I2C_MODE_COMPLETE_XFER);
+        if(err == I2C_MSTR_NO_ERROR) {
+            phase = PHASE_WRITE;
+        }
+    }
+    else {
+        err = I2C_MasterReadBuf(xfer->addr, xfer->rd, xfer->rd_len, I2C_MODE_COMPLETE_XFER);
+        if(err == I2C_MSTR_NO_ERROR) {
+            phase = PHASE_READ;
+        }
+    }
+    if(err == I2C_MSTR_NO_ERROR) {
+        xfer->status = I2C_XFER_BUSY;
+    }
+}
+
+
+/**
+* @brief    Completing the current transfer
+* @details  called from the ISR. The next transfer is started before the callback so the callback can submit more.
+* @param    uint8 status : I2C master status at the end of the transfer
+*/
+static void finish(uint8 status)
+{
+    struct i2c_xfer_ *xfer = queue[q_tail];
+    
+    q_tail = (q_tail + 1u) & I2C_QUEUE_MASK;
+    phase = PHASE_IDLE;
+    xfer->error = status & I2C_MSTAT_ERR_MASK;
+    xfer->status = xfer->error ? I2C_XFER_ERROR : I2C_XFER_DONE;
+    start_next();
+    
+    if(xfer->done != NULL) {
+        xfer->done(xfer);
+    }
+}
+
+
+/**
+* @brief    I2C Interrupt exit callback
+* @details  runs at the end of the generated I2C_ISR
+*/
+void I2C_ISR_ExitCallback(void)
+{
+    struct i2c_xfer_ *xfer;
+    uint8 status;
+    
+    if(phase == PHASE_IDLE) {
+        return;
+    }
+    
+    xfer = queue[q_tail];
+    status = I2C_MasterStatus();
+    if(phase == PHASE_WRITE) {
+        if(!(status & I2C_MSTAT_WR_CMPLT)) {
+            return;
+        }
+        if(xfer->rd_len > 0) {
+            // the write ended with a halt instead of a stop, the bus is still ours
+            if(!(status & I2C_MSTAT_ERR_MASK) &&
+               I2C_MasterReadBuf(xfer->addr, xfer->rd, xfer->rd_len, I2C_MODE_REPEAT_START) == I2C_MSTR_NO_ERROR) {
+                phase = PHASE_READ;
+                return;
+            }
+            I2C_MasterSendStop();
+            status |= I2C_MSTAT_ERR_XFER;
+        }
+    }
+    else if(!(status & I2C_MSTAT_RD_CMPLT)) {
+        return;
+    }
+    
+    finish(status);
+}
+
+
+/**
+* @brief    Queueing a transfer
+* @details  never waits. addr, wr, wr_len, rd, rd_len and done must be filled in. I2C must be started with
+*           I2C_Start() before the first transfer.
+* @param    struct i2c_xfer_ *xfer : transfer to queue
+* @return   int
+*   - returns 1 if the transfer was queued, 0 if the queue is full or there is nothing to transfer
+*/
+int i2c_submit(struct i2c_xfer_ *xfer)
+{
+    uint8 intr;
+    
+    if(xfer->wr_len == 0 && xfer->rd_len == 0) {
+        return 0;
+    }
+    
+    intr = CyEnterCriticalSection();
+    if(((q_head + 1u) & I2C_QUEUE_MASK) == q_tail) {
+        start_next();
+        CyExitCriticalSection(intr);
+        return 0;
+    }
+    xfer->status = I2C_XFER_QUEUED;
+    xfer->error = 0;
+    queue[q_head] = xfer;
+    q_head = (q_head + 1u) & I2C_QUEUE_MASK;
+    start_next();
+    CyExitCriticalSection(intr);
+    
+    return 1;
+}
+
+
+/**
+* @brief    Queueing a write
+* @details  writes len bytes with a start and a stop
+* @param    struct i2c_xfer_ *xfer : transfer to fill in and queue
+* @param    uint8 addr : Slave Device address
+* @param    const uint8 *data : bytes to write, usually the register address first
+* @param    uint8 len : number of bytes
+* @param    i2c_done_t done : completion callback, NULL if not needed
+* @return   int
+*   - returns 1 if the transfer was queued, otherwise 0
+*/
+int i2c_write_async(struct i2c_xfer_ *xfer, uint8 addr, const uint8 *data, uint8 len, i2c_done_t done)
+{
+    return i2c_write_read_async(xfer, addr, data, len, NULL, 0, done);
+}
+
+
+/**
+* @brief    Queueing a read
+* @details  reads len bytes with a start and a stop
+* @param    struct i2c_xfer_ *xfer : transfer to fill in and queue
+* @param    uint8 addr : Slave Device address
+* @param    uint8 *data : buffer for the bytes read
+* @param    uint8 len : number of bytes
+* @param    i2c_done_t done : completion callback, NULL if not needed
+* @return   int
+*   - returns 1 if the transfer was queued, otherwise 0
+*/
+int i2c_read_async(struct i2c_xfer_ *xfer, uint8 addr, uint8 *data, uint8 len, i2c_done_t done)
+{
+    return i2c_write_read_async(xfer, addr, NULL, 0, data, len, done);
+}
+
+
+/**
+* @brief    Queueing a write followed by a read
+* @details  the read starts with a repeated start, so the register address written first stays selected
+* @param    struct i2c_xfer_ *xfer : transfer to fill in and queue
+* @param    uint8 addr : Slave Device address
+* @param    const uint8 *wr : bytes to write
+* @param    uint8 wr_len : number of bytes to write
+* @param    uint8 *rd : buffer for the bytes read
+* @param    uint8 rd_len : number of bytes to read
+* @param    i2c_done_t done : completion callback, NULL if not needed
+* @return   int
+*   - returns 1 if the transfer was queued, otherwise 0
+*/
+int i2c_write_read_async(struct i2c_xfer_ *xfer, uint8 addr, const uint8 *wr, uint8 wr_len,
+                         uint8 *rd, uint8 rd_len, i2c_done_t done)
+{
+    xfer->addr = addr;
+    xfer->wr = wr;
+    xfer->wr_len = wr_len;
+    xfer->rd = rd;
+    xfer->rd_len = rd_len;
+    xfer->done = done;
+    
+    return i2c_submit(xfer);
+}
+
+
+/**
+* @brief    Checking if a transfer has finished
+* @details  also retries starting the queue if the bus was busy
+* @param    struct i2c_xfer_ *xfer : transfer to check
+* @return   int
+*   - returns 1 when the transfer is done or has failed, otherwise 0
+*/
+int i2c_done(struct i2c_xfer_ *xfer)
+{
+    uint8 intr;
+    
+    if(xfer->status == I2C_XFER_QUEUED) {
+        intr = CyEnterCriticalSection();
+        start_next();
+        CyExitCriticalSection(intr);
+    }
+    
+    return xfer->status == I2C_XFER_DONE || xfer->status == I2C_XFER_ERROR;
+}
+
+
+/**
+* @brief    Waiting until a transfer has finished
+* @details  don't call from an interrupt with a higher priority than I2C_I2C_IRQ
+* @param    struct i2c_xfer_ *xfer : transfer to wait for
+* @return   int
+*   - returns 1 if the transfer succeeded, 0 if it failed
+*/
+int i2c_wait(struct i2c_xfer_ *xfer)
+{
+    while(!i2c_done(xfer));
+    
+    return xfer->status == I2C_XFER_DONE;
+}
+
+
+/**
+* @brief    Checking if transfers are queued or running
+* @details
+*/
+int i2c_busy()
+{
+    return q_tail != q_head;
+}
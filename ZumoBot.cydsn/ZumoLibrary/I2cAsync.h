@@ -0,0 +1,45 @@
+/**
+ * @file    I2cAsync.h
+ * @brief   Queued I2C transfer header file
+ * @details If you want to talk to I2C devices without waiting, include I2cAsync.h file. Transfers are queued and run
+ *          one after another from the I2C component interrupt. Completion is reported with a callback or can be polled.
+*/
+#ifndef I2CASYNC_H_
+#define I2CASYNC_H_
+#include <project.h>
+
+#define I2C_QUEUE_SIZE      16u         // must be a power of two
+#define I2C_ASYNC_PRIORITY  3u          // I2C interrupt, above the control tick so a step can wait for its transfers
+
+#define I2C_XFER_IDLE       0u
+#define I2C_XFER_QUEUED     1u
+#define I2C_XFER_BUSY       2u
+#define I2C_XFER_DONE       3u
+#define I2C_XFER_ERROR      4u
+
+struct i2c_xfer_;
+typedef void (*i2c_done_t)(struct i2c_xfer_ *xfer);
+
+/* One transfer. The write part is sent first, the read part follows after a repeated start. The struct and its
+   buffers are owned by the caller and must stay valid until the transfer is done. */
+struct i2c_xfer_ {
+    uint8 addr;                 // 7-bit slave address
+    const uint8 *wr;
+    uint8 wr_len;
+    uint8 *rd;
+    uint8 rd_len;
+    i2c_done_t done;            // called from the I2C interrupt, NULL if not needed
+    volatile uint8 status;      // I2C_XFER_xxx
+    uint8 error;                // I2C_MSTAT_ERR_xxx bits of a failed transfer
+};
+
+int i2c_submit(struct i2c_xfer_ *xfer);
+int i2c_write_async(struct i2c_xfer_ *xfer, uint8 addr, const uint8 *data, uint8 len, i2c_done_t done);
+int i2c_read_async(struct i2c_xfer_ *xfer, uint8 addr, uint8 *data, uint8 len, i2c_done_t done);
+int i2c_write_read_async(struct i2c_xfer_ *xfer, uint8 addr, const uint8 *wr, uint8 wr_len,
+                         uint8 *rd, uint8 rd_len, i2c_done_t done);
+int i2c_done(struct i2c_xfer_ *xfer);
+int i2c_wait(struct i2c_xfer_ *xfer);
+int i2c_busy(void);
+
+#endif
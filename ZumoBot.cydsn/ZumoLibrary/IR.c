@@ -2,8 +2,221 @@
  * @file IR.c
  * @brief Basic methods for operating IR receiver. For more details, please refer to IR.h file. 
  * @details part number: TSOP-2236
+ *          The receiver output is low during a burst (mark) and high between bursts (space). A SysTime service
+ *          samples it every IR_SAMPLE_US and measures each mark and space by counting the samples with the same level,
+ *          so the timing doesn't depend on what the main program is doing. The NEC frame is a 9 ms mark, a 4.5 ms space
+ *          and 32 bits (560 us mark, then 560 us space for 0 or 1690 us space for 1), lowest bit first: address,
+ *          inverted address, command, inverted command. A held button sends a 9 ms mark, a 2.25 ms space and a 560 us
+ *          mark instead. A measured width is up to one sample off either way, which the windows allow for.
 */
 #include "IR.h"
+#include "SysTime.h"
+
+#define IR_SAMPLE_US    SYSTIME_SERVICE_US
+#define WITHIN(w, t)    ((w) + IR_SAMPLE_US > (t) * 3u / 4u && (w) < (t) * 5u / 4u + IR_SAMPLE_US)  // +-25% and a sample
+#define IR_QUEUE_MASK   (IR_QUEUE_SIZE - 1u)
+#define MAX_RUN         0xFFFFu
+
+enum ir_state_ { IR_IDLE, IR_LEADER_SPACE, IR_BIT_MARK, IR_BIT_SPACE, IR_REPEAT_MARK };
+
+static struct ir_command_ queue[IR_QUEUE_SIZE];
+static volatile uint8 q_head = 0;           // next free slot, written by the ISR
+static volatile uint8 q_tail = 0;           // next command to read, written by ir_get_command
+static volatile uint32 errors = 0;
+static enum ir_state_ state = IR_IDLE;
+static uint32 bits;
+static uint8 count;
+static struct ir_command_ last;
+static uint8 have_last = 0;
+static uint8 last_level = 1;
+static uint16 run = 0;                      // samples since the level last changed
+
+
+/**
+* @brief    Adding a command to the queue
+* @details  dropped and counted as an error if the queue is full
+*/
+static void push(const struct ir_command_ *cmd)
+{
+    uint8 next = (q_head + 1u) & IR_QUEUE_MASK;
+    
+    if(next == q_tail) {
+        errors++;
+        return;
+    }
+    queue[q_head] = *cmd;
+    q_head = next;
+}
+
+
+/**
+* @brief    Checking a received frame
+* @details  the command inverse must match. An address without a valid inverse is taken as a 16-bit extended address.
+*/
+static void frame_done(void)
+{
+    uint8 address = bits & 0xFF, address_inv = (bits >> 8) & 0xFF;
+    uint8 command = (bits >> 16) & 0xFF, command_inv = (bits >> 24) & 0xFF;
+    
+    if((uint8)(command ^ command_inv) != 0xFF) {
+        errors++;
+        have_last = 0;
+        return;
+    }
+    last.address = (uint8)(address ^ address_inv) == 0xFF ? address : (uint16)(bits & 0xFFFF);
+    last.command = command;
+    last.repeat = 0;
+    last.raw = bits;
+    have_last = 1;
+    push(&last);
+}
+
+
+/**
+* @brief    Decoding one mark or space
+* @details  a 9 ms mark always starts a new frame, anything unexpected drops back to waiting for one
+* @param    uint32 width : length in microseconds
+* @param    uint8 mark : 1 for a mark (receiver output low), 0 for a space
+*/
+static void ir_edge(uint32 width, uint8 mark)
+{
+    if(mark && WITHIN(width, 9000)) {
+        state = IR_LEADER_SPACE;
+        return;
+    }
+    
+    switch(state) {
+    case IR_LEADER_SPACE:
+        if(!mark && WITHIN(width, 4500)) {
+            bits = 0;
+            count = 0;
+            state = IR_BIT_MARK;
+        }
+        else if(!mark && WITHIN(width, 2250)) {
+            state = IR_REPEAT_MARK;
+        }
+        else {
+            state = IR_IDLE;
+        }
+        break;
+        
+    case IR_BIT_MARK:
+        state = mark && WITHIN(width, 560) ? IR_BIT_SPACE : IR_IDLE;
+        break;
+        
+    case IR_BIT_SPACE:
+        if(!mark && WITHIN(width, 1690)) {
+            bits |= (uint32)1 << count;
+        }
+        else if(mark || !WITHIN(width, 560)) {
+            errors++;
+            state = IR_IDLE;
+            break;
+        }
+        if(++count == 32) {
+            frame_done();
+            state = IR_IDLE;
+        }
+        else {
+            state = IR_BIT_MARK;
+        }
+        break;
+        
+    case IR_REPEAT_MARK:
+        if(mark && WITHIN(width, 560) && have_last) {
+            last.repeat = 1;
+            push(&last);
+        }
+        state = IR_IDLE;
+        break;
+        
+    default:
+        break;
+    }
+}
+
+
+/**
+* @brief    Sampling the receiver
+* @details  runs from the SysTick interrupt. A change of level ends the mark or space before it.
+*/
+void ir_sample(uint8 level)
+{
+    if(level == last_level) {
+        if(run < MAX_RUN) {
+            run++;
+        }
+        return;
+    }
+    ir_edge((uint32)run * IR_SAMPLE_US, last_level == 0);
+    last_level = level;
+    run = 1;
+}
+
+
+/**
+* @brief    SysTime service
+* @details
+*/
+static void ir_service(void)
+{
+    ir_sample(IR_receiver_Read());
+}
+
+
+/**
+* @brief    Starting the NEC decoder
+* @details  SysTime must be started first
+*/
+void ir_start()
+{
+    static uint8 started = 0;
+    
+    if(!started) {
+        started = systime_add_service(ir_service);
+    }
+}
+
+
+/**
+* @brief    Reading a decoded remote button
+* @details  never waits
+* @param    struct ir_command_ *cmd : oldest decoded command
+* @return   int
+*   - returns 1 if there was a command, otherwise 0
+*/
+int ir_get_command(struct ir_command_ *cmd)
+{
+    uint8 tail = q_tail;
+    
+    if(tail == q_head) {
+        return 0;
+    }
+    *cmd = queue[tail];
+    q_tail = (tail + 1u) & IR_QUEUE_MASK;
+    
+    return 1;
+}
+
+
+/**
+* @brief    Forgetting the queued commands
+* @details
+*/
+void ir_flush()
+{
+    q_tail = q_head;
+}
+
+
+/**
+* @brief    Number of bad frames and commands dropped because the queue was full
+* @details
+*/
+uint32 ir_errors()
+{
+    return errors;
+}
 
 
 /**
@@ -12,7 +225,7 @@
 */
 void wait_going_up()
 {
-    while(!IR_receiver_Read()==1);
+    while(IR_receiver_Read() == 0);
 }    
 
 
@@ -30,15 +243,14 @@ void wait_going_down()
 * @brief Counting to signal down
 * @details Measuring the time until IR_receiver value goes up
 * @return int
-*   - returns count time
+*   - returns time in microseconds
 */
 int count_downtime()
 {
-    int cnt =0;
-    while(!IR_receiver_Read()==1)
-        cnt++;
+    uint32 start = micros();
+    while(IR_receiver_Read() == 0);
     
-    return cnt;
+    return micros() - start;
 }
 
 
@@ -46,58 +258,28 @@ int count_downtime()
 * @brief    Counting to signal up 
 * @details  Measuring the time until IR_receiver value goes down
 * @return   int
-*   - returns count time
+*   - returns time in microseconds
 */
 int count_uptime()
 {
-    int cnt =0;
-    while(IR_receiver_Read()==1)
-        cnt++;
+    uint32 start = micros();
+    while(IR_receiver_Read()==1);
     
-    return cnt;
+    return micros() - start;
 }
 
 
 /**
 * @brief    Getting remote controller value
-* @details  Getting each of the value sent by remote controller
+* @details  waits until the decoder has a button press. ir_start must be called first.
 * @return   int
-    - returns hex value
+    - returns the 32 data bits of the frame, first received bit in bit 0
 */
 int get_IR()
 {
-    uint8 bit[33]={0};
-    unsigned int val=0;
-    uint t1, t2, i;
+    struct ir_command_ cmd;
     
-    wait_going_down();
+    while(!ir_get_command(&cmd));
     
-    for(i = 0; i < 33; i++)     // loop 33times ( 1bit - Start bit, 32bits - Databit)
-    {
-        t1 = 0;
-        t2 = 0;
-        
-        t1 = count_downtime();
-        t2 = count_uptime();
-        
-        // If up time is longer than down time, value of the bit becomes 1
-        if(t2 > t1)
-            bit[i]=1;
-        else
-            bit[i]=0; 
-    } 
-   
-    /* // If you want to see binary value
-    int cnt;
-    for(cnt=0; cnt<33; cnt++)
-        printf("%d ",bit[cnt]);
-    printf("\r\n\n");
-    */
-   
-    // compress bits to single int, ignore start bit
-
-    for( i=0; i<32; i++)
-        val |= bit[i+1] << i;
-    
-    return val;
-}
\ No newline at end of file
+    return cmd.raw;
+}
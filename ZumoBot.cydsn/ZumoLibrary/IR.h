@@ -1,12 +1,35 @@
 /**
  * @file    IR.h
  * @brief   IR receiver header file
- * @details If you want to use IR methods, Include IR.h file.
+ * @details If you want to use IR methods, Include IR.h file. ir_start starts the background NEC decoder and
+ *          ir_get_command returns the decoded remote buttons without waiting. ir_sample is the decoder's input, the
+ *          receiver level once every SYSTIME_SERVICE_US; it is exported for testing the decoder on a recorded signal.
 */
+#ifndef IR_H_
+#define IR_H_
 #include <project.h>
 #include <stdio.h>
 #include <math.h>
 
+#define IR_QUEUE_SIZE       8u          // must be a power of two
+
+/**
+* @brief    Decoded NEC frame
+* @details  address is 8 bits when its inverse was valid, otherwise the 16-bit extended NEC address
+*/
+struct ir_command_ {
+    uint16 address;
+    uint8 command;
+    uint8 repeat;                   // 1 for the repeat code sent while a button is held
+    uint32 raw;                     // 32 data bits, first received bit in bit 0
+};
+
+void ir_start(void);
+void ir_sample(uint8 level);
+int ir_get_command(struct ir_command_ *cmd);
+void ir_flush(void);
+uint32 ir_errors(void);
+
 void wait_going_up();
 void wait_going_down();
 
@@ -15,3 +38,4 @@ int count_downtime();
 
 int get_IR();
 
+#endif
@@ -0,0 +1,190 @@
+/**
+ * @file    Imu.c
+ * @brief   Burst reads of the inertial sensors. For more details, please refer to Imu.h file.
+ * @details part numbers: LSM303D (accelerometer and magnetometer) and L3GD20H (gyroscope), both on the Zumo shield.
+ *          Both chips send the low byte first, same as the Cortex-M3, so the six output bytes are read straight into
+ *          struct imu_axes_. Block data update is enabled so the low and high bytes always belong to the same sample.
+*/
+#include "Imu.h"
+#include "I2C_made.h"
+
+static const uint8 accel_reg = OUT_X_L_A | IMU_AUTO_INCREMENT;
+static const uint8 mag_reg = OUT_X_L_M | IMU_AUTO_INCREMENT;
+static const uint8 gyro_reg = OUT_X_AXIS_L | IMU_AUTO_INCREMENT;
+
+
+/**
+* @brief    Starting the inertial sensors
+* @details  starts I2C with its interrupt at I2C_ASYNC_PRIORITY and turns on all axes: accelerometer 50 Hz +-2 g,
+*           magnetometer 25 Hz +-4 gauss continuous, gyroscope 200 Hz 2000 dps (the scale value_convert_gyro expects)
+* @return   int
+*   - returns 1 if both chips answered, otherwise 0
+*/
+int imu_start()
+{
+    I2C_Start();
+    CyIntSetPriority(I2C_ISR_NUMBER, I2C_ASYNC_PRIORITY);
+    
+    if(I2C_read(ACCEL_MAG_ADDR, WHO_AM_I_ACCEL) != 0x49 || I2C_read(GYRO_ADDR, WHO_AM_I_GYRO) != 0xD7) {
+        return 0;
+    }
+    
+    I2C_write(ACCEL_MAG_ADDR, ACCEL_CTRL1_REG, 0x5F);      // 50 Hz, block data update, XYZ enabled
+    I2C_write(ACCEL_MAG_ADDR, ACCEL_CTRL5_REG, 0x6C);      // magnetometer high resolution, 25 Hz
+    I2C_write(ACCEL_MAG_ADDR, ACCEL_CTRL6_REG, 0x20);      // +-4 gauss
+    I2C_write(ACCEL_MAG_ADDR, ACCEL_CTRL7_REG, 0x00);      // magnetometer continuous conversion
+    I2C_write(GYRO_ADDR, GYRO_CTRL4_REG, 0xA0);            // block data update, 2000 dps
+    I2C_write(GYRO_ADDR, GYRO_CTRL1_REG, 0x6F);            // 200 Hz, power on, XYZ enabled
+    
+    return 1;
+}
+
+
+/**
+* @brief    Queueing a burst read of six output registers
+* @details
+* @param    struct i2c_xfer_ *xfer : transfer to use, must stay valid until done
+* @param    uint8 addr : Slave Device address
+* @param    const uint8 *reg : first output register with the auto-increment bit
+* @param    struct imu_axes_ *axes : where the values are read
+* @param    i2c_done_t done : completion callback, NULL if not needed
+*/
+static int read_axes_async(struct i2c_xfer_ *xfer, uint8 addr, const uint8 *reg, struct imu_axes_ *axes,
+                           i2c_done_t done)
+{
+    return i2c_write_read_async(xfer, addr, reg, 1, (uint8 *)axes, sizeof(*axes), done);
+}
+
+
+/**
+* @brief    Queueing an accelerometer read
+* @details  never waits
+* @param    struct i2c_xfer_ *xfer : transfer to use, must stay valid until done
+* @param    struct imu_axes_ *accel : where the values are read
+* @param    i2c_done_t done : completion callback, NULL if not needed
+* @return   int
+*   - returns 1 if the read was queued, otherwise 0
+*/
+int imu_read_accel_async(struct i2c_xfer_ *xfer, struct imu_axes_ *accel, i2c_done_t done)
+{
+    return read_axes_async(xfer, ACCEL_MAG_ADDR, &accel_reg, accel, done);
+}
+
+
+/**
+* @brief    Queueing a magnetometer read
+* @details  never waits
+* @param    struct i2c_xfer_ *xfer : transfer to use, must stay valid until done
+* @param    struct imu_axes_ *mag : where the values are read
+* @param    i2c_done_t done : completion callback, NULL if not needed
+* @return   int
+*   - returns 1 if the read was queued, otherwise 0
+*/
+int imu_read_mag_async(struct i2c_xfer_ *xfer, struct imu_axes_ *mag, i2c_done_t done)
+{
+    return read_axes_async(xfer, ACCEL_MAG_ADDR, &mag_reg, mag, done);
+}
+
+
+/**
+* @brief    Queueing a gyroscope read
+* @details  never waits
+* @param    struct i2c_xfer_ *xfer : transfer to use, must stay valid until done
+* @param    struct imu_axes_ *gyro : where the values are read
+* @param    i2c_done_t done : completion callback, NULL if not needed
+* @return   int
+*   - returns 1 if the read was queued, otherwise 0
+*/
+int imu_read_gyro_async(struct i2c_xfer_ *xfer, struct imu_axes_ *gyro, i2c_done_t done)
+{
+    return read_axes_async(xfer, GYRO_ADDR, &gyro_reg, gyro, done);
+}
+
+
+/**
+* @brief    Reading the accelerometer
+* @details  waits for the burst read
+* @param    struct imu_axes_ *accel : where the values are read
+* @return   int
+*   - returns 1 if the read succeeded, otherwise 0
+*/
+int imu_read_accel(struct imu_axes_ *accel)
+{
+    struct i2c_xfer_ xfer;
+    
+    while(!imu_read_accel_async(&xfer, accel, NULL));
+    return i2c_wait(&xfer);
+}
+
+
+/**
+* @brief    Reading the magnetometer
+* @details  waits for the burst read
+* @param    struct imu_axes_ *mag : where the values are read
+* @return   int
+*   - returns 1 if the read succeeded, otherwise 0
+*/
+int imu_read_mag(struct imu_axes_ *mag)
+{
+    struct i2c_xfer_ xfer;
+    
+    while(!imu_read_mag_async(&xfer, mag, NULL));
+    return i2c_wait(&xfer);
+}
+
+
+/**
+* @brief    Reading the gyroscope
+* @details  waits for the burst read
+* @param    struct imu_axes_ *gyro : where the values are read
+* @return   int
+*   - returns 1 if the read succeeded, otherwise 0
+*/
+int imu_read_gyro(struct imu_axes_ *gyro)
+{
+    struct i2c_xfer_ xfer;
+    
+    while(!imu_read_gyro_async(&xfer, gyro, NULL));
+    return i2c_wait(&xfer);
+}
+
+
+/**
+* @brief    Reading the accelerometer and magnetometer
+* @details  both reads are queued back to back and run without a gap on the bus
+* @param    struct imu_axes_ *accel : where the accelerometer values are read
+* @param    struct imu_axes_ *mag : where the magnetometer values are read
+* @return   int
+*   - returns 1 if both reads succeeded, otherwise 0
+*/
+int imu_read_accel_mag(struct imu_axes_ *accel, struct imu_axes_ *mag)
+{
+    struct i2c_xfer_ xfer[2];
+    int ok;
+    
+    while(!imu_read_accel_async(&xfer[0], accel, NULL));
+    while(!imu_read_mag_async(&xfer[1], mag, NULL));
+    ok = i2c_wait(&xfer[0]);
+    return i2c_wait(&xfer[1]) && ok;
+}
+
+
+/**
+* @brief    Reading all nine axes
+* @details  the three reads are queued back to back
+* @param    struct imu_sample_ *sample : where the values are read
+* @return   int
+*   - returns 1 if all reads succeeded, otherwise 0
+*/
+int imu_read(struct imu_sample_ *sample)
+{
+    struct i2c_xfer_ xfer[3];
+    int ok;
+    
+    while(!imu_read_accel_async(&xfer[0], &sample->accel, NULL));
+    while(!imu_read_mag_async(&xfer[1], &sample->mag, NULL));
+    while(!imu_read_gyro_async(&xfer[2], &sample->gyro, NULL));
+    ok = i2c_wait(&xfer[0]);
+    ok = i2c_wait(&xfer[1]) && ok;
+    return i2c_wait(&xfer[2]) && ok;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file    Imu.h
+ * @brief   Inertial sensor header file
+ * @details If you want to read the accelerometer, magnetometer or gyroscope outputs, include Imu.h file. Each sensor's
+ *          six output registers are read in one auto-increment burst straight into signed 16-bit axes.
+*/
+#ifndef IMU_H_
+#define IMU_H_
+#include <project.h>
+#include "I2cAsync.h"
+#include "Accel_magnet.h"
+#include "Gyro.h"
+
+#define IMU_AUTO_INCREMENT  0x80        // register address bit for multi-byte reads, both chips
+
+/* raw sensor outputs. Field order matches the register order so a burst read fills the struct directly */
+struct imu_axes_ {
+    int16 x;
+    int16 y;
+    int16 z;
+};
+
+struct imu_sample_ {
+    struct imu_axes_ accel;
+    struct imu_axes_ mag;
+    struct imu_axes_ gyro;
+};
+
+int imu_start(void);
+int imu_read_accel(struct imu_axes_ *accel);
+int imu_read_mag(struct imu_axes_ *mag);
+int imu_read_gyro(struct imu_axes_ *gyro);
+int imu_read_accel_mag(struct imu_axes_ *accel, struct imu_axes_ *mag);
+int imu_read(struct imu_sample_ *sample);
+int imu_read_accel_async(struct i2c_xfer_ *xfer, struct imu_axes_ *accel, i2c_done_t done);
+int imu_read_mag_async(struct i2c_xfer_ *xfer, struct imu_axes_ *mag, i2c_done_t done);
+int imu_read_gyro_async(struct i2c_xfer_ *xfer, struct imu_axes_ *gyro, i2c_done_t done);
+
+#endif
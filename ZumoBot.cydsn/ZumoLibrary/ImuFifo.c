@@ -0,0 +1,268 @@
+/**
+ * @file    ImuFifo.c
+ * @brief   Inertial sensor FIFO streaming. For more details, please refer to ImuFifo.h file.
+ * @details The streamed chips run their FIFO in stream mode. imu_fifo_poll queues a read of each FIFO_SRC register; when the
+ *          watermark flag is set the I2C callback queues one burst read of every stored sample (the output address
+ *          wraps from OUT_Z_H back to OUT_X_L while the FIFO is enabled) and the next callback copies them to a ring
+ *          buffer. Everything after imu_fifo_poll runs from the I2C interrupt. The interrupt pins of the chips are not
+ *          wired on the shield, so the status register is polled instead, but only once per watermark's worth of
+ *          samples instead of once per sample.
+*/
+#include "ImuFifo.h"
+#include "I2C_made.h"
+
+#define FIFO_BUFFER_MASK    (IMU_FIFO_BUFFER_SIZE - 1u)
+
+#define FIFO_EN             0x40        // CTRL0 (accelerometer), CTRL5 (gyroscope)
+#define FIFO_MODE_BYPASS    0x00        // FIFO_CTRL FM bits
+#define FIFO_MODE_STREAM    0x40
+#define FIFO_SRC_FTH        0x80        // FIFO_SRC: level >= watermark
+#define FIFO_SRC_OVRN       0x40        // FIFO_SRC: an unread sample was overwritten
+#define FIFO_SRC_FSS        0x1F        // FIFO_SRC: number of stored samples
+
+/* one chip's FIFO. xfer must be the first member, the I2C callbacks get the chip back from it */
+struct fifo_chip_ {
+    struct i2c_xfer_ xfer;
+    uint8 addr;
+    uint8 src_reg;
+    uint8 out_reg;
+    uint8 src;
+    struct imu_axes_ burst[IMU_FIFO_DEPTH];
+    struct imu_axes_ buffer[IMU_FIFO_BUFFER_SIZE];
+    volatile uint8 head;            // written by the I2C callback
+    volatile uint8 tail;            // written by the reader
+    volatile uint8 busy;            // a status or burst read is queued
+    uint8 enabled;                  // streamed, polled by imu_fifo_poll
+};
+
+static struct fifo_chip_ accel = { .addr = ACCEL_MAG_ADDR, .src_reg = ACCEL_FIFO_SRC_REG,
+                                   .out_reg = OUT_X_L_A | IMU_AUTO_INCREMENT };
+static struct fifo_chip_ gyro = { .addr = GYRO_ADDR, .src_reg = GYRO_FIFO_SRC_REG,
+                                  .out_reg = OUT_X_AXIS_L | IMU_AUTO_INCREMENT };
+static volatile uint32 overruns = 0;
+static volatile uint32 dropped = 0;
+static int running = 0;
+
+
+/**
+* @brief    I2C callback of a burst read
+* @details  moves the samples to the ring buffer, samples that don't fit are dropped
+*/
+static void burst_done(struct i2c_xfer_ *xfer)
+{
+    struct fifo_chip_ *chip = (struct fifo_chip_ *)xfer;
+    uint8 count = xfer->rd_len / sizeof(struct imu_axes_);
+    uint8 head = chip->head;
+    uint8 i;
+    
+    if(xfer->status == I2C_XFER_DONE) {
+        for(i = 0; i < count; i++) {
+            if(((head + 1u) & FIFO_BUFFER_MASK) == chip->tail) {
+                dropped += count - i;
+                break;
+            }
+            chip->buffer[head] = chip->burst[i];
+            head = (head + 1u) & FIFO_BUFFER_MASK;
+        }
+        chip->head = head;
+    }
+    chip->busy = 0;
+}
+
+
+/**
+* @brief    I2C callback of a FIFO_SRC read
+* @details  queues a burst read of the stored samples when the watermark is reached
+*/
+static void src_done(struct i2c_xfer_ *xfer)
+{
+    struct fifo_chip_ *chip = (struct fifo_chip_ *)xfer;
+    uint8 level = chip->src & FIFO_SRC_FSS;
+    
+    if(xfer->status == I2C_XFER_DONE && (chip->src & FIFO_SRC_OVRN)) {
+        overruns++;
+        level = IMU_FIFO_DEPTH;
+    }
+    if(xfer->status != I2C_XFER_DONE || !(chip->src & FIFO_SRC_FTH) || level == 0) {
+        chip->busy = 0;
+        return;
+    }
+    
+    if(!i2c_write_read_async(xfer, chip->addr, &chip->out_reg, 1, (uint8 *)chip->burst,
+                             level * sizeof(struct imu_axes_), burst_done)) {
+        chip->busy = 0;
+    }
+}
+
+
+/**
+* @brief    Queueing a FIFO_SRC read of a chip
+* @details  does nothing if the chip isn't streamed or the previous status or burst read of it is still going on
+*/
+static void poll_chip(struct fifo_chip_ *chip)
+{
+    uint8 intr = CyEnterCriticalSection();
+    
+    if(chip->enabled && !chip->busy) {
+        chip->busy = 1;
+        if(!i2c_write_read_async(&chip->xfer, chip->addr, &chip->src_reg, 1, &chip->src, 1, src_done)) {
+            chip->busy = 0;
+        }
+    }
+    CyExitCriticalSection(intr);
+}
+
+
+/**
+* @brief    Starting FIFO streaming
+* @details  starts the sensors with imu_start, sets the output data rates and puts the FIFOs of the given sensors in
+*           stream mode. A sensor that isn't given keeps its FIFO in bypass, so nothing piles up that no one reads.
+*           imu_fifo_poll must then be called at least once per (IMU_FIFO_DEPTH - watermark) samples of the faster
+*           sensor, otherwise samples are overwritten in the chip.
+* @param    uint8 sensors : IMU_FIFO_ACCEL and/or IMU_FIFO_GYRO
+* @param    uint8 accel_odr : accelerometer rate, IMU_ACCEL_ODR_xxx, ignored without IMU_FIFO_ACCEL
+* @param    uint8 gyro_odr : gyroscope rate, IMU_GYRO_ODR_xxx, ignored without IMU_FIFO_GYRO
+* @param    uint8 watermark : number of samples (1..31) that triggers a burst read
+* @return   int
+*   - returns 1 if both chips answered, otherwise 0
+*/
+int imu_fifo_start(uint8 sensors, uint8 accel_odr, uint8 gyro_odr, uint8 watermark)
+{
+    if(watermark < 1) {
+        watermark = 1;
+    }
+    if(watermark >= IMU_FIFO_DEPTH) {
+        watermark = IMU_FIFO_DEPTH - 1;
+    }
+    if(!imu_start()) {
+        return 0;
+    }
+    
+    accel.enabled = (sensors & IMU_FIFO_ACCEL) != 0;
+    gyro.enabled = (sensors & IMU_FIFO_GYRO) != 0;
+    
+    I2C_write(ACCEL_MAG_ADDR, ACCEL_FIFO_CTRL_REG, FIFO_MODE_BYPASS);            // bypass empties the FIFO
+    if(accel.enabled) {
+        I2C_write(ACCEL_MAG_ADDR, ACCEL_CTRL1_REG, (uint8)(accel_odr << 4) | 0x0F);  // block data update, XYZ enabled
+        I2C_write(ACCEL_MAG_ADDR, ACCEL_CTRL0_REG, FIFO_EN);
+        I2C_write(ACCEL_MAG_ADDR, ACCEL_FIFO_CTRL_REG, FIFO_MODE_STREAM | watermark);
+    }
+    else {
+        I2C_write(ACCEL_MAG_ADDR, ACCEL_CTRL0_REG, 0x00);
+    }
+    
+    I2C_write(GYRO_ADDR, GYRO_FIFO_CTRL_REG, FIFO_MODE_BYPASS);
+    if(gyro.enabled) {
+        I2C_write(GYRO_ADDR, GYRO_LOW_ODR_REG, 0x00);
+        I2C_write(GYRO_ADDR, GYRO_CTRL1_REG, (uint8)(gyro_odr << 6) | 0x2F);      // power on, XYZ enabled
+        I2C_write(GYRO_ADDR, GYRO_CTRL5_REG, FIFO_EN);
+        I2C_write(GYRO_ADDR, GYRO_FIFO_CTRL_REG, FIFO_MODE_STREAM | watermark);
+    }
+    else {
+        I2C_write(GYRO_ADDR, GYRO_CTRL5_REG, 0x00);
+    }
+    
+    accel.head = accel.tail = 0;
+    gyro.head = gyro.tail = 0;
+    overruns = 0;
+    dropped = 0;
+    running = 1;
+    
+    return 1;
+}
+
+
+/**
+* @brief    Stopping FIFO streaming
+* @details  waits for reads in progress and puts both FIFOs back in bypass mode. The sensors keep running.
+*/
+void imu_fifo_stop()
+{
+    running = 0;
+    while(accel.busy || gyro.busy);
+    accel.enabled = 0;
+    gyro.enabled = 0;
+    
+    I2C_write(ACCEL_MAG_ADDR, ACCEL_FIFO_CTRL_REG, FIFO_MODE_BYPASS);
+    I2C_write(ACCEL_MAG_ADDR, ACCEL_CTRL0_REG, 0x00);
+    I2C_write(GYRO_ADDR, GYRO_FIFO_CTRL_REG, FIFO_MODE_BYPASS);
+    I2C_write(GYRO_ADDR, GYRO_CTRL5_REG, 0x00);
+}
+
+
+/**
+* @brief    Checking the FIFOs
+* @details  never waits, the reads are queued and finished from the I2C interrupt. Can be called from the control tick.
+*/
+void imu_fifo_poll()
+{
+    if(!running) {
+        return;
+    }
+    poll_chip(&accel);
+    poll_chip(&gyro);
+}
+
+
+/**
+* @brief    Taking the oldest sample from a chip's ring buffer
+* @details
+*/
+static int pop(struct fifo_chip_ *chip, struct imu_axes_ *axes)
+{
+    uint8 tail = chip->tail;
+    
+    if(tail == chip->head) {
+        return 0;
+    }
+    *axes = chip->buffer[tail];
+    chip->tail = (tail + 1u) & FIFO_BUFFER_MASK;
+    
+    return 1;
+}
+
+
+/**
+* @brief    Reading the oldest buffered accelerometer sample
+* @details
+* @param    struct imu_axes_ *accel_sample : where the sample is copied
+* @return   int
+*   - returns 1 if a sample was available, otherwise 0
+*/
+int imu_fifo_accel(struct imu_axes_ *accel_sample)
+{
+    return pop(&accel, accel_sample);
+}
+
+
+/**
+* @brief    Reading the oldest buffered gyroscope sample
+* @details
+* @param    struct imu_axes_ *gyro_sample : where the sample is copied
+* @return   int
+*   - returns 1 if a sample was available, otherwise 0
+*/
+int imu_fifo_gyro(struct imu_axes_ *gyro_sample)
+{
+    return pop(&gyro, gyro_sample);
+}
+
+
+/**
+* @brief    Number of times a chip's FIFO overflowed
+* @details  each overflow means lost samples, poll more often or lower the watermark
+*/
+uint32 imu_fifo_overruns()
+{
+    return overruns;
+}
+
+
+/**
+* @brief    Number of samples dropped because the ring buffer was full
+* @details
+*/
+uint32 imu_fifo_dropped()
+{
+    return dropped;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file    ImuFifo.h
+ * @brief   Inertial sensor FIFO streaming header file
+ * @details If you want every accelerometer and gyroscope sample at a high rate, include ImuFifo.h file. The chips
+ *          collect samples in their 32-level FIFOs, which are emptied in bursts when they reach the watermark. Only
+ *          the sensors passed to imu_fifo_start are streamed, the FIFO of the other one stays in bypass mode.
+*/
+#ifndef IMUFIFO_H_
+#define IMUFIFO_H_
+#include <project.h>
+#include "Imu.h"
+
+#define IMU_FIFO_DEPTH          32u         // samples in each chip's FIFO
+#define IMU_FIFO_BUFFER_SIZE    64u         // samples buffered per sensor, must be a power of two
+
+/* sensors to stream */
+#define IMU_FIFO_ACCEL          0x01u
+#define IMU_FIFO_GYRO           0x02u
+
+/* accelerometer output data rates (LSM303D CTRL1 AODR) */
+#define IMU_ACCEL_ODR_25HZ      0x4u
+#define IMU_ACCEL_ODR_50HZ      0x5u
+#define IMU_ACCEL_ODR_100HZ     0x6u
+#define IMU_ACCEL_ODR_200HZ     0x7u
+#define IMU_ACCEL_ODR_400HZ     0x8u
+#define IMU_ACCEL_ODR_800HZ     0x9u
+#define IMU_ACCEL_ODR_1600HZ    0xAu
+
+/* gyroscope output data rates (L3GD20H CTRL1 DR with LOW_ODR off) */
+#define IMU_GYRO_ODR_100HZ      0x0u
+#define IMU_GYRO_ODR_200HZ      0x1u
+#define IMU_GYRO_ODR_400HZ      0x2u
+#define IMU_GYRO_ODR_800HZ      0x3u
+
+int imu_fifo_start(uint8 sensors, uint8 accel_odr, uint8 gyro_odr, uint8 watermark);
+void imu_fifo_stop(void);
+void imu_fifo_poll(void);
+int imu_fifo_accel(struct imu_axes_ *accel_sample);
+int imu_fifo_gyro(struct imu_axes_ *gyro_sample);
+uint32 imu_fifo_overruns(void);
+uint32 imu_fifo_dropped(void);
+
+#endif
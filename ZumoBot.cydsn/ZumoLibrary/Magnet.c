@@ -1,9 +1,22 @@
 /**
  * @file    Magnet.c
- * @brief   Basic methods for operating magnetometer. For more details, please refer to Accel_magnet.h file. 
+ * @brief   Basic methods for operating magnetometer. For more details, please refer to Accel_magnet.h and Magnet.h files.
  * @details part number: LSM303D (simultaneously used with accelerometer and included in Zumo shield)
+ *          The calibration is fitted from a spin in place: the hard iron offset is the middle of each axis' range and
+ *          the soft iron scale makes the x and y ranges equally wide. A flat spin doesn't change z, so the z offset
+ *          stays 0.
 */
 #include "accel_magnet.h"
+#include "Magnet.h"
+#include "FixMath.h"
+
+static struct magnet_calibration_ calibration = { 0, 0, 0, MAGNET_SCALE_ONE, MAGNET_SCALE_ONE, MAGNET_SCALE_ONE };
+static struct imu_axes_ minimum, maximum;       // calibration spin range
+static struct imu_axes_ raw_sample;             // background read target
+static struct imu_axes_ latest;                 // last corrected sample
+static struct i2c_xfer_ xfer;
+static volatile uint8 busy = 0;
+static volatile uint8 valid = 0;
 
 
 /**
@@ -22,5 +35,151 @@ void heading(double X_AXIS, double Y_AXIS)          // defined as the angle betw
     
     //If you want to print out the value  
     //printf("heading: %7.3f \r\n", heading);
-    CyDelay(250);
+}
+
+
+/**
+* @brief    Taking a calibration into use
+* @details
+* @param    const struct magnet_calibration_ *cal : calibration to use
+*/
+void magnet_set_calibration(const struct magnet_calibration_ *cal)
+{
+    uint8 intr = CyEnterCriticalSection();
+    calibration = *cal;
+    CyExitCriticalSection(intr);
+}
+
+
+/**
+* @brief    Starting a calibration spin
+* @details  forgets the range seen so far
+*/
+void magnet_calibration_reset()
+{
+    minimum.x = minimum.y = minimum.z = INT16_MAX;
+    maximum.x = maximum.y = maximum.z = INT16_MIN;
+}
+
+
+/**
+* @brief    Adding a raw sample to the calibration range
+* @details  call for every sample while the robot spins in place
+* @param    const struct imu_axes_ *raw : raw magnetometer sample
+*/
+void magnet_calibration_update(const struct imu_axes_ *raw)
+{
+    if(raw->x < minimum.x) minimum.x = raw->x;
+    if(raw->y < minimum.y) minimum.y = raw->y;
+    if(raw->z < minimum.z) minimum.z = raw->z;
+    if(raw->x > maximum.x) maximum.x = raw->x;
+    if(raw->y > maximum.y) maximum.y = raw->y;
+    if(raw->z > maximum.z) maximum.z = raw->z;
+}
+
+
+/**
+* @brief    Fitting the calibration to the spin
+* @details  cal is left unchanged if the spin didn't see a wide enough range on x and y
+* @param    struct magnet_calibration_ *cal : fitted calibration
+* @return   int
+*   - returns 1 if the fit is usable, otherwise 0
+*/
+int magnet_calibration_result(struct magnet_calibration_ *cal)
+{
+    int32 rx = ((int32)maximum.x - minimum.x) / 2;
+    int32 ry = ((int32)maximum.y - minimum.y) / 2;
+    int32 r = (rx + ry) / 2;
+    
+    if(rx < MAGNET_MIN_RADIUS || ry < MAGNET_MIN_RADIUS) {
+        return 0;
+    }
+    
+    cal->offset_x = ((int32)maximum.x + minimum.x) / 2;
+    cal->offset_y = ((int32)maximum.y + minimum.y) / 2;
+    cal->offset_z = 0;
+    cal->scale_x = (r << MAGNET_SCALE_SHIFT) / rx;
+    cal->scale_y = (r << MAGNET_SCALE_SHIFT) / ry;
+    cal->scale_z = MAGNET_SCALE_ONE;
+    
+    return 1;
+}
+
+
+/**
+* @brief    Correcting a raw sample
+* @details
+* @param    const struct imu_axes_ *raw : raw magnetometer sample
+* @param    struct imu_axes_ *out : corrected sample
+*/
+void magnet_correct(const struct imu_axes_ *raw, struct imu_axes_ *out)
+{
+    int32 x = ((int32)raw->x - calibration.offset_x) * calibration.scale_x >> MAGNET_SCALE_SHIFT;
+    int32 y = ((int32)raw->y - calibration.offset_y) * calibration.scale_y >> MAGNET_SCALE_SHIFT;
+    int32 z = ((int32)raw->z - calibration.offset_z) * calibration.scale_z >> MAGNET_SCALE_SHIFT;
+    
+    out->x = x > INT16_MAX ? INT16_MAX : x < INT16_MIN ? INT16_MIN : x;
+    out->y = y > INT16_MAX ? INT16_MAX : y < INT16_MIN ? INT16_MIN : y;
+    out->z = z > INT16_MAX ? INT16_MAX : z < INT16_MIN ? INT16_MIN : z;
+}
+
+
+/**
+* @brief    I2C callback of a background read
+* @details
+*/
+static void read_done(struct i2c_xfer_ *x)
+{
+    if(x->status == I2C_XFER_DONE) {
+        magnet_correct(&raw_sample, &latest);
+        valid = 1;
+    }
+    busy = 0;
+}
+
+
+/**
+* @brief    Queueing a background magnetometer read
+* @details  never waits, does nothing if the previous read is still going on. Call at about the magnetometer data rate
+*           (25 Hz), for example from the control tick. I2C must be started with imu_start.
+*/
+void magnet_update()
+{
+    uint8 intr = CyEnterCriticalSection();
+    
+    if(!busy) {
+        busy = 1;
+        if(!imu_read_mag_async(&xfer, &raw_sample, read_done)) {
+            busy = 0;
+        }
+    }
+    CyExitCriticalSection(intr);
+}
+
+
+/**
+* @brief    Heading of the latest calibrated sample
+* @details  never waits. Same direction as heading(): atan2(x, y), 0..359 degrees. Not tilt compensated, use Fusion.h
+*           on slopes.
+* @return   int16
+*   - returns the heading in degrees, -1 if there is no sample yet
+*/
+int16 magnet_heading()
+{
+    uint8 intr;
+    struct imu_axes_ m;
+    int32 h;
+    
+    if(!valid) {
+        return -1;
+    }
+    intr = CyEnterCriticalSection();
+    m = latest;
+    CyExitCriticalSection(intr);
+    
+    h = fix_atan2_mdeg(m.x, m.y) / 1000;
+    if(h < 0) {
+        h += 360;
+    }
+    return h % 360;
 }
@@ -0,0 +1,37 @@
+/**
+ * @file    Magnet.h
+ * @brief   Magnetometer calibration and heading header file
+ * @details If you want a calibrated magnetometer or a compass heading inside a control loop, include Magnet.h file.
+ *          Samples are read in the background and magnet_heading returns the heading of the latest one at once.
+*/
+#ifndef MAGNET_H_
+#define MAGNET_H_
+#include <project.h>
+#include "Imu.h"
+
+#define MAGNET_SCALE_SHIFT  8
+#define MAGNET_SCALE_ONE    (1u << MAGNET_SCALE_SHIFT)
+#define MAGNET_MIN_RADIUS   300             // counts, smallest field a calibration spin must see (0.05 gauss)
+
+/**
+* @brief    Magnetometer calibration
+* @details  corrected = (raw - offset) * scale / MAGNET_SCALE_ONE
+*/
+struct magnet_calibration_ {
+    int16 offset_x;                 // hard iron, raw counts
+    int16 offset_y;
+    int16 offset_z;
+    uint16 scale_x;                 // soft iron, MAGNET_SCALE_ONE is 1.0
+    uint16 scale_y;
+    uint16 scale_z;
+};
+
+void magnet_set_calibration(const struct magnet_calibration_ *cal);
+void magnet_calibration_reset(void);
+void magnet_calibration_update(const struct imu_axes_ *raw);
+int magnet_calibration_result(struct magnet_calibration_ *cal);
+void magnet_correct(const struct imu_axes_ *raw, struct imu_axes_ *out);
+void magnet_update(void);
+int16 magnet_heading(void);
+
+#endif
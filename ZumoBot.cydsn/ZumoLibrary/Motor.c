@@ -5,6 +5,38 @@
 */
 #include "Motor.h"
 
+static int8 trim_left = 0;
+static int8 trim_right = 0;
+
+
+/**
+* @brief    Adding trim to speed
+* @details  result is limited to 0..255
+*/
+static uint8 trimmed(uint8 speed, int8 trim)
+{
+    int16 value = (int16)speed + trim;
+    
+    if(speed == 0 || value < 0)
+        return 0;
+    if(value > 255)
+        return 255;
+    return (uint8)value;
+}
+
+
+/**
+* @brief    Setting motor trim
+* @details  trim is added to every non-zero speed so that both motors run at the same speed
+* @param    int8 left : left motor trim
+* @param    int8 right : right motor trim
+*/
+void motor_set_trim(int8 left, int8 right)
+{
+    trim_left = left;
+    trim_right = right;
+}
+
 
 /**
 * @brief    Starting motor sensors
@@ -36,8 +68,8 @@ void motor_forward(uint8 speed,uint32 delay)
 {
     MotorDirLeft_Write(0);      // set LeftMotor forward mode
     MotorDirRight_Write(0);     // set RightMotor forward mode
-    PWM_WriteCompare1(speed); 
-    PWM_WriteCompare2(speed); 
+    PWM_WriteCompare1(trimmed(speed, trim_left)); 
+    PWM_WriteCompare2(trimmed(speed, trim_right)); 
     CyDelay(delay);
 }
 
@@ -51,8 +83,8 @@ void motor_forward(uint8 speed,uint32 delay)
 */
 void motor_turn(uint8 l_speed, uint8 r_speed, uint32 delay)
 {
-    PWM_WriteCompare1(l_speed); 
-    PWM_WriteCompare2(r_speed); 
+    PWM_WriteCompare1(trimmed(l_speed, trim_left)); 
+    PWM_WriteCompare2(trimmed(r_speed, trim_right)); 
     CyDelay(delay);
 }
 
@@ -67,15 +99,15 @@ void motor_backward(uint8 speed,uint32 delay)
 {
     MotorDirLeft_Write(1);      // set LeftMotor backward mode
     MotorDirRight_Write(1);     // set RightMotor backward mode
-    PWM_WriteCompare1(speed); 
-    PWM_WriteCompare2(speed); 
+    PWM_WriteCompare1(trimmed(speed, trim_left)); 
+    PWM_WriteCompare2(trimmed(speed, trim_right)); 
     CyDelay(delay);
 }
 
 void motor_drive(uint8 l_dir, uint8 r_dir, uint8 l_speed,uint8 r_speed, uint32 delay){
     MotorDirLeft_Write(l_dir);      // set LeftMotor forward mode
     MotorDirRight_Write(r_dir);     // set RightMotor back mode
-    PWM_WriteCompare1(l_speed); 
-    PWM_WriteCompare2(r_speed); 
+    PWM_WriteCompare1(trimmed(l_speed, trim_left)); 
+    PWM_WriteCompare2(trimmed(r_speed, trim_right)); 
     CyDelay(delay);
 }
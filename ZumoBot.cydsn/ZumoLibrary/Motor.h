@@ -21,4 +21,7 @@ void motor_turn(uint8 l_speed, uint8 r_speed, uint32 delay);
 void motor_backward(uint8 speed,uint32 delay);
 void motor_drive(uint8 l_dir, uint8 r_dir, uint8 l_speed,uint8 r_speed, uint32 delay);
 
+/* trim added to each motor's speed */
+void motor_set_trim(int8 left, int8 right);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,109 @@
+/**
+ * @file    PD.c
+ * @brief   Fixed-point PD controller. For more details, please refer to PD.h file.
+ * @details correction = kp * error + kd * (error - last error), computed in Q16.16 with 64 bit intermediates
+*/
+#include "PD.h"
+
+#define Q16_MAX     ((int64)0x7FFFFFFF)
+#define Q16_MIN     (-(int64)0x7FFFFFFF - 1)
+
+
+/**
+* @brief    Saturating 64 bit to Q16.16
+* @details
+*/
+static q16_t q16_saturate(int64 value)
+{
+    if(value > Q16_MAX)
+        return (q16_t)Q16_MAX;
+    if(value < Q16_MIN)
+        return (q16_t)Q16_MIN;
+    return (q16_t)value;
+}
+
+
+/**
+* @brief    Initializing PD controller
+* @details
+* @param    struct pd_ *pd : controller state
+* @param    q16_t kp : proportional gain, Q16.16
+* @param    q16_t kd : derivative gain (per tick), Q16.16
+* @param    int16 base : motor speed when error is zero
+* @param    int16 min : lowest motor speed
+* @param    int16 max : highest motor speed
+*/
+void pd_init(struct pd_ *pd, q16_t kp, q16_t kd, int16 base, int16 min, int16 max)
+{
+    pd->kp = kp;
+    pd->kd = kd;
+    pd->base = base;
+    pd->min = min;
+    pd->max = max;
+    pd_reset(pd);
+}
+
+
+/**
+* @brief    Clearing derivative history
+* @details
+*/
+void pd_reset(struct pd_ *pd)
+{
+    pd->last_error = 0;
+}
+
+
+/**
+* @brief    Dividing two integers to Q16.16
+* @details  a zero denominator is treated as 1 so the result saturates instead of faulting
+* @param    int32 num : numerator
+* @param    int32 den : denominator
+*/
+q16_t pd_ratio(int32 num, int32 den)
+{
+    if(den == 0)
+        den = 1;
+    return q16_saturate(((int64)num << Q16_SHIFT) / den);
+}
+
+
+/**
+* @brief    PD step
+* @details  returns kp * error + kd * (error - last error) and stores error for the next step
+* @param    struct pd_ *pd : controller state
+* @param    q16_t error : error, Q16.16
+*/
+q16_t pd_update(struct pd_ *pd, q16_t error)
+{
+    int64 derivative = (int64)error - pd->last_error;
+    int64 out = (int64)pd->kp * error + (int64)pd->kd * derivative;
+    
+    pd->last_error = error;
+    
+    return q16_saturate(out >> Q16_SHIFT);
+}
+
+
+/**
+* @brief    Converting PD correction to motor speeds
+* @details  left = base + correction, right = base - correction, both limited to min..max
+* @param    const struct pd_ *pd : controller state
+* @param    q16_t correction : output of pd_update
+* @param    uint8 *left : left motor speed
+* @param    uint8 *right : right motor speed
+*/
+void pd_motor_speeds(const struct pd_ *pd, q16_t correction, uint8 *left, uint8 *right)
+{
+    int64 base = (int64)pd->base << Q16_SHIFT;
+    int32 l = (int32)((base + correction) >> Q16_SHIFT);
+    int32 r = (int32)((base - correction) >> Q16_SHIFT);
+    
+    if(l < pd->min) l = pd->min;
+    if(l > pd->max) l = pd->max;
+    if(r < pd->min) r = pd->min;
+    if(r > pd->max) r = pd->max;
+    
+    *left = (uint8)l;
+    *right = (uint8)r;
+}
@@ -0,0 +1,35 @@
+/**
+ * @file    PD.h
+ * @brief   Fixed-point PD controller header file
+ * @details If you want to use PD controller methods, Include PD.h file. Values are Q16.16 fixed-point (1.0 == 65536) so the controller runs without the FPU the Cortex-M3 doesn't have.
+*/
+#ifndef PD_H_
+#define PD_H_
+#include <project.h>
+
+typedef int32 q16_t;
+
+#define Q16_SHIFT   16
+#define Q16_ONE     ((q16_t)1 << Q16_SHIFT)
+#define Q16(x)      ((q16_t)((x) * 65536.0))   // only for compile-time constants
+
+/**
+* @brief    PD controller state
+* @details  gains and previous error in Q16.16, speed limits in motor PWM units
+*/
+struct pd_ {
+    q16_t kp;
+    q16_t kd;
+    q16_t last_error;
+    int16 base;
+    int16 min;
+    int16 max;
+};
+
+void pd_init(struct pd_ *pd, q16_t kp, q16_t kd, int16 base, int16 min, int16 max);
+void pd_reset(struct pd_ *pd);
+q16_t pd_ratio(int32 num, int32 den);
+q16_t pd_update(struct pd_ *pd, q16_t error);
+void pd_motor_speeds(const struct pd_ *pd, q16_t correction, uint8 *left, uint8 *right);
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * @file    Profile.c
+ * @brief   Cycle count profiling. For more details, please refer to Profile.h file.
+ * @details The DWT cycle counter is enabled through the debug unit (TRCENA), it runs without a debugger attached.
+ *          The cost of the two counter reads of an empty scope is measured at start and taken off every run.
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "Profile.h"
+
+#define CYCLES_PER_US   (BCLK__BUS_CLK__HZ / 1000000u)
+
+static const char *const scope_name[PROFILE_SCOPES] = {
+    "pd_step",
+    "sensor_isr",
+    "ultra_isr",
+    "_write",
+};
+
+static struct profile_stats_ stats[PROFILE_SCOPES];
+static uint32 overhead = 0;
+
+
+/**
+* @brief    Starting profiling
+* @details  enables the cycle counter, clears the statistics and measures the cost of an empty scope
+*/
+void profile_start()
+{
+    uint32 start;
+    
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    profile_reset();
+    
+    start = profile_cycles();
+    overhead = profile_cycles() - start;
+}
+
+
+/**
+* @brief    Adding one run of a scope
+* @details  called by PROFILE_END, from any interrupt priority
+* @param    enum profile_scope_ scope : scope that ended
+* @param    uint32 cycles : cycles from PROFILE_BEGIN
+*/
+void profile_add(enum profile_scope_ scope, uint32 cycles)
+{
+    struct profile_stats_ *s = &stats[scope];
+    uint8 bin;
+    uint8 intr;
+    
+    cycles = cycles > overhead ? cycles - overhead : 0;
+    bin = cycles >> PROFILE_HIST_MIN_SHIFT ? (uint8)(32u - PROFILE_HIST_MIN_SHIFT - __builtin_clz(cycles)) : 0;
+    if(bin >= PROFILE_HIST_BINS) {
+        bin = PROFILE_HIST_BINS - 1u;
+    }
+    
+    intr = CyEnterCriticalSection();
+    if(s->count == 0 || cycles < s->min) {
+        s->min = cycles;
+    }
+    if(cycles > s->max) {
+        s->max = cycles;
+    }
+    s->count++;
+    s->total += cycles;
+    s->hist[bin]++;
+    CyExitCriticalSection(intr);
+}
+
+
+/**
+* @brief    Statistics of a scope
+* @details  consistent copy, taken with interrupts off
+* @param    enum profile_scope_ scope : scope to read
+* @param    struct profile_stats_ *copy : filled with the statistics
+*/
+void profile_get(enum profile_scope_ scope, struct profile_stats_ *copy)
+{
+    uint8 intr = CyEnterCriticalSection();
+    *copy = stats[scope];
+    CyExitCriticalSection(intr);
+}
+
+
+/**
+* @brief    Clearing the statistics
+* @details
+*/
+void profile_reset()
+{
+    uint8 intr = CyEnterCriticalSection();
+    memset(stats, 0, sizeof(stats));
+    CyExitCriticalSection(intr);
+}
+
+
+/**
+* @brief    Printing the statistics
+* @details  one line per scope with the count, min, mean and max cycles and the mean in microseconds, then the
+*           histogram bins that have runs in them. Goes to the UART through printf.
+*/
+void profile_dump()
+{
+    struct profile_stats_ s;
+    uint32 mean;
+    uint8 scope, bin;
+    
+    if(!PROFILE_ENABLED) {
+        printf("Profiling compiled out (PROFILE_ENABLED 0)\n");
+        return;
+    }
+    printf("scope           count      min     mean      max  cycles, mean us\n");
+    for(scope = 0; scope < PROFILE_SCOPES; scope++) {
+        profile_get((enum profile_scope_)scope, &s);
+        mean = s.count ? (uint32)(s.total / s.count) : 0;
+        printf("%-12s %8lu %8lu %8lu %8lu  %lu.%02lu\n", scope_name[scope], (unsigned long)s.count,
+               (unsigned long)s.min, (unsigned long)mean, (unsigned long)s.max, (unsigned long)(mean / CYCLES_PER_US),
+               (unsigned long)(mean * 100u / CYCLES_PER_US % 100u));
+        if(s.count == 0) {
+            continue;
+        }
+        printf("   ");
+        for(bin = 0; bin < PROFILE_HIST_BINS; bin++) {
+            if(s.hist[bin] == 0) {
+                continue;
+            }
+            if(bin + 1u < PROFILE_HIST_BINS) {
+                printf(" <%lu:%lu", 1ul << (bin + PROFILE_HIST_MIN_SHIFT), (unsigned long)s.hist[bin]);
+            }
+            else {
+                printf(" >=%lu:%lu", 1ul << (bin - 1u + PROFILE_HIST_MIN_SHIFT), (unsigned long)s.hist[bin]);
+            }
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,66 @@
+/**
+ * @file    Profile.h
+ * @brief   Cycle count profiling header file
+ * @details If you want to know how many CPU cycles a piece of code takes, include Profile.h file and put it between
+ *          PROFILE_BEGIN and PROFILE_END of one of the scopes below. The Cortex-M3 DWT cycle counter counts the bus
+ *          clock, so a scope costs two register reads and a short update with interrupts off. Times are inclusive:
+ *          interrupts taken inside a scope are counted in it too. The macros compile to nothing unless
+ *          PROFILE_ENABLED is 1, which the Debug configuration of the project defines (Build Settings > Compiler >
+ *          Preprocessor Definitions) and the host build does with make PROFILE=1.<br>
+ *          A new scope is added to enum profile_scope_ and its name to the table in Profile.c.
+*/
+#ifndef PROFILE_H_
+#define PROFILE_H_
+#include <project.h>
+
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED         0           // 1 from the compiler command line profiles the scopes
+#endif
+
+#define PROFILE_HIST_BINS       16u         // power of two bins
+#define PROFILE_HIST_MIN_SHIFT  5u          // first bin is under 32 cycles, the last one 2^19 (~22 ms) and over
+
+enum profile_scope_ {
+    PROFILE_PD_STEP,
+    PROFILE_SENSOR_ISR,
+    PROFILE_ULTRA_ISR,
+    PROFILE_WRITE,
+    PROFILE_SCOPES
+};
+
+/**
+* @brief    Statistics of one scope
+* @details  in cycles, bin i of hist counts runs under 2^(i + PROFILE_HIST_MIN_SHIFT) cycles and over the bin before
+*/
+struct profile_stats_ {
+    uint32 count;
+    uint32 min;
+    uint32 max;
+    uint64 total;
+    uint32 hist[PROFILE_HIST_BINS];
+};
+
+#if PROFILE_ENABLED
+#define PROFILE_BEGIN(scope)    uint32 profile_start_##scope = profile_cycles()
+#define PROFILE_END(scope)      profile_add(PROFILE_##scope, profile_cycles() - profile_start_##scope)
+#else
+#define PROFILE_BEGIN(scope)    do {} while(0)
+#define PROFILE_END(scope)      do {} while(0)
+#endif
+
+/**
+* @brief    Cycle counter
+* @details  DWT->CYCCNT, wraps every 2^32 cycles (~179 s at 24 MHz)
+*/
+static inline uint32 profile_cycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+void profile_start(void);
+void profile_add(enum profile_scope_ scope, uint32 cycles);
+void profile_get(enum profile_scope_ scope, struct profile_stats_ *stats);
+void profile_reset(void);
+void profile_dump(void);
+
+#endif
@@ -7,92 +7,196 @@
 #include <stdio.h>
 
 #include "Reflectance.h"
+#include "SysTime.h"
+#include "Profile.h"
 
-static volatile struct sensors_ sensors;
+static volatile struct reflectance_sample_ samples[2];   // ISR fills samples[front ^ 1] then flips front
+static volatile uint8_t front = 0;
 static volatile struct sensors_  digital_sensor_value;
-static struct sensors_ threshold = { 10000, 10000, 10000, 10000};
+static struct sensors_ threshold = { 10000, 0, 10000, 10000, 0, 10000};
+static struct sensors_ cal_white;
+static struct sensors_ cal_black;
+static uint16_t last_position = REFLECTANCE_POSITION_CENTER;
+
+#define LINE_ON_LEVEL       200     // calibrated value above which a channel sees the line
+#define LINE_NOISE_LEVEL    50      // calibrated values below this are left out of the average
+#define CHARGE_PERIOD       (REFLECTANCE_CHARGE_TICKS - 1u)
+#define MEASURE_PERIOD      REFLECTANCE_MAX_READING
 
 /**
 * @brief    Reflectance Sensor Interrupt Handler
-* @details  Measuring each sensors' time to recognition of white or black
+* @details  Two phase state machine on the sensor timers' terminal count. The timers alternate between a short charge
+*           period and a measure period, which add up to one sample. When a measure period ends the handler latches
+*           each sensor's discharge time, starts charging the sensor capacitors and publishes the sample. When the
+*           charge period ends it releases the pins, which starts the next discharge measurement. The period register
+*           written in each phase is loaded on the following terminal count.
 */
 CY_ISR(sensor_isr_handler)
 {
-    uint32_t statusR1 = Timer_R1_ReadStatusRegister();
-    uint32_t statusR3 = Timer_R3_ReadStatusRegister();
-    uint32_t statusL3 = Timer_L3_ReadStatusRegister();
-    uint32_t statusL1 = Timer_L1_ReadStatusRegister();
-
-    if(statusR1 & Timer_R1_STATUS_CAPTURE) {
-        sensors.r1 = Timer_R1_ReadPeriod() - Timer_R1_ReadCapture();
-    }
-    else {
-        sensors.r1 = Timer_R1_ReadPeriod();
-    }
+    static uint8_t charging = 1;
+    PROFILE_BEGIN(SENSOR_ISR);
     
-    if(statusR3 & Timer_R3_STATUS_CAPTURE) {
-        sensors.r3 = Timer_R3_ReadPeriod() - Timer_R3_ReadCapture();
-    }
-    else {
-        sensors.r3 = Timer_R3_ReadPeriod();
-    }
-    
-    if(statusL3 & Timer_L3_STATUS_CAPTURE) {
-        sensors.l3 = Timer_L3_ReadPeriod() - Timer_L3_ReadCapture();
-    }
-    else {
-        sensors.l3 = Timer_L3_ReadPeriod();
-    }
-    
-    if(statusL1 & Timer_L1_STATUS_CAPTURE) {
-        sensors.l1 = Timer_L1_ReadPeriod() - Timer_L1_ReadCapture();
+    if(!charging) {
+        struct sensors_ sensors = {0};
+        uint8_t back = front ^ 1u;
+        uint32_t statusR1, statusR3, statusL3, statusL1;
+        
+        // output latches are already 1, switching to strong drive starts charging
+        R1_SetDriveMode(PIN_DM_STRONG);
+        R3_SetDriveMode(PIN_DM_STRONG);
+        L3_SetDriveMode(PIN_DM_STRONG);
+        L1_SetDriveMode(PIN_DM_STRONG);
+        
+        Timer_R1_WritePeriod(MEASURE_PERIOD);
+        Timer_R3_WritePeriod(MEASURE_PERIOD);
+        Timer_L3_WritePeriod(MEASURE_PERIOD);
+        Timer_L1_WritePeriod(MEASURE_PERIOD);
+        
+        statusR1 = Timer_R1_ReadStatusRegister();
+        statusR3 = Timer_R3_ReadStatusRegister();
+        statusL3 = Timer_L3_ReadStatusRegister();
+        statusL1 = Timer_L1_ReadStatusRegister();
+
+        if(statusR1 & Timer_R1_STATUS_CAPTURE) {
+            sensors.r1 = MEASURE_PERIOD - Timer_R1_ReadCapture();
+        }
+        else {
+            sensors.r1 = MEASURE_PERIOD;
+        }
+        
+        if(statusR3 & Timer_R3_STATUS_CAPTURE) {
+            sensors.r3 = MEASURE_PERIOD - Timer_R3_ReadCapture();
+        }
+        else {
+            sensors.r3 = MEASURE_PERIOD;
+        }
+        
+        if(statusL3 & Timer_L3_STATUS_CAPTURE) {
+            sensors.l3 = MEASURE_PERIOD - Timer_L3_ReadCapture();
+        }
+        else {
+            sensors.l3 = MEASURE_PERIOD;
+        }
+        
+        if(statusL1 & Timer_L1_STATUS_CAPTURE) {
+            sensors.l1 = MEASURE_PERIOD - Timer_L1_ReadCapture();
+        }
+        else {
+            sensors.l1 = MEASURE_PERIOD;
+        }
+        
+        samples[back].values = sensors;
+        samples[back].time_ms = millis();
+        samples[back].seq = samples[front].seq + 1u;
+        front = back;
+        charging = 1;
     }
     else {
-        sensors.l1 = Timer_L1_ReadPeriod();
+        // release the charged pins, discharge time is measured from this terminal count
+        R1_SetDriveMode(PIN_DM_DIG_HIZ);
+        R3_SetDriveMode(PIN_DM_DIG_HIZ);
+        L3_SetDriveMode(PIN_DM_DIG_HIZ);
+        L1_SetDriveMode(PIN_DM_DIG_HIZ);
+        
+        Timer_R1_WritePeriod(CHARGE_PERIOD);
+        Timer_R3_WritePeriod(CHARGE_PERIOD);
+        Timer_L3_WritePeriod(CHARGE_PERIOD);
+        Timer_L1_WritePeriod(CHARGE_PERIOD);
+        
+        Timer_R1_ReadStatusRegister();
+        Timer_R3_ReadStatusRegister();
+        Timer_L3_ReadStatusRegister();
+        Timer_L1_ReadStatusRegister();
+        charging = 0;
     }
-    
-    R1_SetDriveMode(PIN_DM_STRONG);
-    R1_Write(1);
-    R3_SetDriveMode(PIN_DM_STRONG);
-    R3_Write(1);
-    L3_SetDriveMode(PIN_DM_STRONG);
-    L3_Write(1);
-    L1_SetDriveMode(PIN_DM_STRONG);
-    L1_Write(1);
-    CyDelayUs(10);
-    R1_SetDriveMode(PIN_DM_DIG_HIZ);
-    R3_SetDriveMode(PIN_DM_DIG_HIZ);
-    L3_SetDriveMode(PIN_DM_DIG_HIZ);
-    L1_SetDriveMode(PIN_DM_DIG_HIZ);
-
-    Timer_R1_ReadStatusRegister();
-    Timer_R3_ReadStatusRegister();
-    Timer_L3_ReadStatusRegister();
-    Timer_L1_ReadStatusRegister();
+    PROFILE_END(SENSOR_ISR);
 }
 
 
 /**
 * @brief    Starting Reflectance Sensor
-* @details 
+* @details  The timers start on a charge period with the pins driven, the first terminal count releases them.
 */
 void reflectance_start()
 {
+    R1_Write(1);
+    R3_Write(1);
+    L3_Write(1);
+    L1_Write(1);
+    R1_SetDriveMode(PIN_DM_STRONG);
+    R3_SetDriveMode(PIN_DM_STRONG);
+    L3_SetDriveMode(PIN_DM_STRONG);
+    L1_SetDriveMode(PIN_DM_STRONG);
     sensor_isr_StartEx(sensor_isr_handler);
+    sensor_isr_SetPriority(REFLECTANCE_ISR_PRIORITY);
     Timer_R1_Start();
     Timer_R3_Start();
     Timer_L3_Start();
     Timer_L1_Start();
+    Timer_R1_WritePeriod(MEASURE_PERIOD);
+    Timer_R3_WritePeriod(MEASURE_PERIOD);
+    Timer_L3_WritePeriod(MEASURE_PERIOD);
+    Timer_L1_WritePeriod(MEASURE_PERIOD);
+}
+
+
+/**
+* @brief    Copying the newest sample
+* @details  the ISR only writes the buffer that is not published, so a copy is torn only if two samples completed
+*           while copying. The sequence number changes in that case and the copy is retried.
+*/
+static void read_sample(struct reflectance_sample_ *sample)
+{
+    uint8_t idx;
+    uint32_t seq;
+    
+    do {
+        idx = front;
+        seq = samples[idx].seq;
+        sample->values = samples[idx].values;
+        sample->time_ms = samples[idx].time_ms;
+        sample->seq = seq;
+    } while(samples[idx].seq != seq || front != idx);
 }
 
 
 /**
 * @brief    Read reflectance sensor values
-* @details
+* @details  newest raw values, which may be the same ones as in the previous call
 */
 void reflectance_read(struct sensors_ *values)
 {
-    *values = sensors;
+    struct reflectance_sample_ sample;
+    
+    read_sample(&sample);
+    *values = sample.values;
+}
+
+
+/**
+* @brief    Read new reflectance sample without waiting
+* @details  sample->seq is the last sequence number the caller has seen (0 if none). If a newer sample exists it is
+*           copied to sample and 1 is returned, otherwise sample is left as it is and 0 is returned.
+* @param    struct reflectance_sample_ *sample : last sample seen, updated with the new one
+*/
+uint8_t reflectance_try_read(struct reflectance_sample_ *sample)
+{
+    if(samples[front].seq == sample->seq)
+        return 0;
+    
+    read_sample(sample);
+    return 1;
+}
+
+
+/**
+* @brief    Wait for new reflectance sample
+* @details  blocks until there is a sample newer than sample->seq and copies it to sample
+* @param    struct reflectance_sample_ *sample : last sample seen, updated with the new one
+*/
+void reflectance_wait_new(struct reflectance_sample_ *sample)
+{
+    while(!reflectance_try_read(sample));
 }
 
 
@@ -102,6 +206,10 @@ void reflectance_read(struct sensors_ *values)
 */
 void reflectance_digital(struct sensors_ *digital)
 {
+    struct sensors_ sensors;
+    
+    reflectance_read(&sensors);
+
     //if the results of reflectance_period function is over threshold, set digital_sensor_value to 0, which means it's black
     if(sensors.l3 > threshold.l3)
         digital->l3 = 0;
@@ -134,3 +242,148 @@ void reflectance_set_threshold(uint16_t l3, uint16_t l1, uint16_t r1, uint16_t r
 }
 
 
+/**
+* @brief    Setting calibration limits
+* @details  white is the raw value over background and black the raw value over the line for each channel.
+*           Channels where black is not above white are skipped. The line position starts again from the centre.
+* @param    const struct sensors_ *white : raw values on white
+* @param    const struct sensors_ *black : raw values on black
+*/
+void reflectance_set_calibration(const struct sensors_ *white, const struct sensors_ *black)
+{
+    cal_white = *white;
+    cal_black = *black;
+    last_position = REFLECTANCE_POSITION_CENTER;
+}
+
+
+/**
+* @brief    Getting calibration limits
+* @details
+* @param    struct sensors_ *white : raw values on white
+* @param    struct sensors_ *black : raw values on black
+*/
+void reflectance_get_calibration(struct sensors_ *white, struct sensors_ *black)
+{
+    *white = cal_white;
+    *black = cal_black;
+}
+
+
+/**
+* @brief    Starting min/max calibration
+* @details  clears the calibration limits so that reflectance_calibration_update can track them
+*/
+void reflectance_calibration_reset()
+{
+    struct sensors_ highest = { 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF };
+    struct sensors_ lowest = { 0, 0, 0, 0, 0, 0 };
+    
+    cal_white = highest;
+    cal_black = lowest;
+}
+
+
+/**
+* @brief    Tracking one channel's minimum and maximum
+* @details
+*/
+static void track_channel(uint16_t raw, uint16_t *white, uint16_t *black)
+{
+    if(raw < *white)
+        *white = raw;
+    if(raw > *black)
+        *black = raw;
+}
+
+
+/**
+* @brief    Updating min/max calibration
+* @details  widens each channel's white (minimum) and black (maximum) limit to include raw. Call for every sample
+*           while the sensors are moved over both the line and the background.
+* @param    const struct sensors_ *raw : raw values from reflectance_read
+*/
+void reflectance_calibration_update(const struct sensors_ *raw)
+{
+    track_channel(raw->l3, &cal_white.l3, &cal_black.l3);
+    track_channel(raw->l2, &cal_white.l2, &cal_black.l2);
+    track_channel(raw->l1, &cal_white.l1, &cal_black.l1);
+    track_channel(raw->r1, &cal_white.r1, &cal_black.r1);
+    track_channel(raw->r2, &cal_white.r2, &cal_black.r2);
+    track_channel(raw->r3, &cal_white.r3, &cal_black.r3);
+}
+
+
+/**
+* @brief    Scaling one channel between its calibration limits
+* @details  returns 0 for white and 1000 for black
+*/
+static uint16_t calibrate_channel(uint16_t raw, uint16_t white, uint16_t black)
+{
+    if(black <= white || raw <= white)
+        return 0;
+    if(raw >= black)
+        return 1000;
+    return (uint16_t)(((uint32_t)(raw - white) * 1000u) / (black - white));
+}
+
+
+/**
+* @brief    Calibrated reflectance values
+* @details  scaling raw values to 0 (white) .. 1000 (black) using the limits from reflectance_set_calibration
+* @param    const struct sensors_ *raw : raw values from reflectance_read
+* @param    struct sensors_ *calibrated : calibrated values
+*/
+void reflectance_calibrated(const struct sensors_ *raw, struct sensors_ *calibrated)
+{
+    calibrated->l3 = calibrate_channel(raw->l3, cal_white.l3, cal_black.l3);
+    calibrated->l2 = calibrate_channel(raw->l2, cal_white.l2, cal_black.l2);
+    calibrated->l1 = calibrate_channel(raw->l1, cal_white.l1, cal_black.l1);
+    calibrated->r1 = calibrate_channel(raw->r1, cal_white.r1, cal_black.r1);
+    calibrated->r2 = calibrate_channel(raw->r2, cal_white.r2, cal_black.r2);
+    calibrated->r3 = calibrate_channel(raw->r3, cal_white.r3, cal_black.r3);
+}
+
+
+/**
+* @brief    Line position
+* @details  weighted average of the calibrated channels, 0 when the line is under l3 and REFLECTANCE_POSITION_MAX
+*           when it is under r3. When no channel sees the line, returns the end on the side the line was last seen.
+* @param    const struct sensors_ *raw : raw values from reflectance_read
+*/
+uint16_t reflectance_line_position(const struct sensors_ *raw)
+{
+    struct sensors_ cal;
+    uint16_t value[REFLECTANCE_CHANNELS];
+    uint32_t weighted = 0;
+    uint32_t sum = 0;
+    uint8_t on_line = 0;
+    uint8_t i;
+    
+    reflectance_calibrated(raw, &cal);
+    value[0] = cal.l3;
+    value[1] = cal.l2;
+    value[2] = cal.l1;
+    value[3] = cal.r1;
+    value[4] = cal.r2;
+    value[5] = cal.r3;
+    
+    for(i = 0; i < REFLECTANCE_CHANNELS; i++) {
+        if(value[i] > LINE_ON_LEVEL)
+            on_line = 1;
+        if(value[i] > LINE_NOISE_LEVEL) {
+            weighted += (uint32_t)value[i] * (i * 1000u);
+            sum += value[i];
+        }
+    }
+    
+    if(!on_line) {
+        // line lost, report the side it was last seen on
+        if(last_position < REFLECTANCE_POSITION_CENTER)
+            return 0;
+        return REFLECTANCE_POSITION_MAX;
+    }
+    
+    last_position = (uint16_t)(weighted / sum);
+    return last_position;
+}
@@ -10,22 +10,51 @@
 
 CY_ISR_PROTO(sensor_isr_handler);
     
+#define REFLECTANCE_SAMPLE_HZ       1000    // one sample per charge and measure period of the sensor timers
+#define REFLECTANCE_CHARGE_US       50      // sensor capacitor charge period, longer than the handler's latency
+#define REFLECTANCE_CHARGE_TICKS    (REFLECTANCE_CHARGE_US * (BCLK__BUS_CLK__HZ / 1000000u))   // sensor timers count the bus clock
+#define REFLECTANCE_MAX_READING     (BCLK__BUS_CLK__HZ / REFLECTANCE_SAMPLE_HZ - REFLECTANCE_CHARGE_TICKS - 1u)    // not discharged within the measure period
+#define REFLECTANCE_CHANNELS        6
+#define REFLECTANCE_ISR_PRIORITY    1       // sensor_isr, above the control tick so a step never delays a measurement
+#define REFLECTANCE_POSITION_MAX    ((REFLECTANCE_CHANNELS - 1) * 1000)
+#define REFLECTANCE_POSITION_CENTER (REFLECTANCE_POSITION_MAX / 2)
+
 /**
 * @brief    Reflectance Sensor raw values
-* @details  raw value of Reflectance Sensor
+* @details  raw value of Reflectance Sensor, ordered from left to right. l2 and r2 are not wired on this shield,
+*           they stay 0 and are skipped by the line position estimator until they are calibrated.
 */
 struct sensors_ {
     uint16_t l3;
-    //uint16_t l2; // not used at the moment
+    uint16_t l2;
     uint16_t l1;
     uint16_t r1;
-    //uint16_t r2; // not used at the moment
+    uint16_t r2;
     uint16_t r3;
 };
 
+/**
+* @brief    Reflectance Sensor sample
+* @details  raw values with the sequence number of the measurement (starting from 1) and the time it completed,
+*           in millis()
+*/
+struct reflectance_sample_ {
+    struct sensors_ values;
+    uint32_t seq;
+    uint32_t time_ms;
+};
+
 void reflectance_start(void);
 void reflectance_read(struct sensors_ *values);
+uint8_t reflectance_try_read(struct reflectance_sample_ *sample);
+void reflectance_wait_new(struct reflectance_sample_ *sample);
 void reflectance_digital(struct sensors_ *digital);
 void reflectance_set_threshold(uint16_t l3, uint16_t l1, uint16_t r1, uint16_t r3);
+void reflectance_set_calibration(const struct sensors_ *white, const struct sensors_ *black);
+void reflectance_get_calibration(struct sensors_ *white, struct sensors_ *black);
+void reflectance_calibration_reset(void);
+void reflectance_calibration_update(const struct sensors_ *raw);
+void reflectance_calibrated(const struct sensors_ *raw, struct sensors_ *calibrated);
+uint16_t reflectance_line_position(const struct sensors_ *raw);
 
 #endif
@@ -0,0 +1,147 @@
+/**
+ * @file    SysTime.c
+ * @brief   Monotonic system time. For more details, please refer to SysTime.h file.
+ * @details SysTick counts down from SYSTIME_TICKS_PER_SERVICE - 1 at the bus clock and its callback counts the periods,
+ *          SYSTIME_SERVICE_HZ of them per second, then runs the services. The time within the current period is read
+ *          from the SysTick counter, so micros has the resolution of the bus clock without an interrupt per
+ *          microsecond. millis and micros wrap after 49 days and 71 minutes; compare them as (int32)(a - b). The 64
+ *          bit versions do not wrap.<br>
+ *          SysTick keeps the priority it has after reset, 0, above every isr component. The services run on each
+ *          interrupt, so each must be done in a few microseconds.
+*/
+#include "SysTime.h"
+
+static volatile uint64 period_count = 0;
+static systime_service_t services[SYSTIME_SERVICES];
+static volatile uint8 service_count = 0;
+
+
+/**
+* @brief    SysTick callback
+* @details  runs from the SysTick exception SYSTIME_SERVICE_HZ times a second
+*/
+static void systime_tick(void)
+{
+    uint8 i;
+    
+    period_count++;
+    for(i = 0; i < service_count; i++) {
+        services[i]();
+    }
+}
+
+
+/**
+* @brief    Reading the period count and the SysTick counter together
+* @details  With interrupts off a wrap that happened after period_count was read shows as a pending SysTick exception.
+*           The counter is read again in that case, as the first read may be from either side of the wrap. This keeps
+*           the time monotonic also when called from an interrupt handler or a critical section.
+* @param    uint32 *elapsed : bus clock ticks since the start of the current period
+* @return   uint64
+*   - returns SysTick periods since systime_start
+*/
+static uint64 read_time(uint32 *elapsed)
+{
+    uint64 periods;
+    uint32 count;
+    uint8 interrupts;
+    
+    interrupts = CyEnterCriticalSection();
+    periods = period_count;
+    count = CySysTickGetValue();
+    if(SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+        count = CySysTickGetValue();
+        periods++;
+    }
+    CyExitCriticalSection(interrupts);
+    
+    *elapsed = (SYSTIME_TICKS_PER_SERVICE - 1u) - count;
+    return periods;
+}
+
+
+/**
+* @brief    Starting system time
+* @details  Call first in main, before starting the modules that take timestamps or add services. SysTick is free
+*           otherwise: nothing else in the project uses it.
+*/
+void systime_start()
+{
+    CySysTickStart();
+    CySysTickSetClockSource(CY_SYS_SYST_CSR_CLK_SRC_SYSCLK);
+    CySysTickSetReload(SYSTIME_TICKS_PER_SERVICE - 1u);
+    CySysTickClear();
+    CySysTickSetCallback(0, systime_tick);
+}
+
+
+/**
+* @brief    Adding a service
+* @details  service is called from the SysTick interrupt SYSTIME_SERVICE_HZ times a second from the next interrupt on,
+*           after the time has been updated. Services can't be removed, one that is not needed any more just returns.
+* @param    systime_service_t service : function to call
+* @return   int
+*   - returns 1 if the service was added, 0 if there are already SYSTIME_SERVICES of them
+*/
+int systime_add_service(systime_service_t service)
+{
+    uint8 interrupts;
+    int added = 0;
+    
+    interrupts = CyEnterCriticalSection();
+    if(service_count < SYSTIME_SERVICES) {
+        services[service_count] = service;
+        service_count++;
+        added = 1;
+    }
+    CyExitCriticalSection(interrupts);
+    
+    return added;
+}
+
+
+/**
+* @brief    Milliseconds since systime_start
+* @details  wraps after 49 days
+*/
+uint32 millis()
+{
+    uint32 elapsed;
+    
+    return (uint32)(read_time(&elapsed) / (SYSTIME_SERVICE_HZ / 1000u));
+}
+
+
+/**
+* @brief    Microseconds since systime_start
+* @details  wraps after 71 minutes
+*/
+uint32 micros()
+{
+    return (uint32)micros64();
+}
+
+
+/**
+* @brief    Milliseconds since systime_start
+* @details
+*/
+uint64 millis64()
+{
+    uint32 elapsed;
+    
+    return read_time(&elapsed) / (SYSTIME_SERVICE_HZ / 1000u);
+}
+
+
+/**
+* @brief    Microseconds since systime_start
+* @details
+*/
+uint64 micros64()
+{
+    uint32 elapsed;
+    uint64 periods = read_time(&elapsed);
+    
+    return periods * SYSTIME_SERVICE_US + elapsed / SYSTIME_TICKS_PER_US;
+}
@@ -0,0 +1,28 @@
+/**
+ * @file    SysTime.h
+ * @brief   System time header file
+ * @details If you want timestamps or timeouts, include SysTime.h file. SysTick counts the bus clock and its interrupt extends it to a monotonic 64 bit time since systime_start.
+ *          The SysTick interrupt also runs the services added with systime_add_service, for modules that need to do a little work at a fixed rate without a timer of their own.
+*/
+#ifndef SYSTIME_H_
+#define SYSTIME_H_
+#include <project.h>
+
+#define SYSTIME_CLOCK_HZ        BCLK__BUS_CLK__HZ               // SysTick input clock (bus clock)
+#define SYSTIME_TICKS_PER_MS    (SYSTIME_CLOCK_HZ / 1000u)
+#define SYSTIME_TICKS_PER_US    (SYSTIME_CLOCK_HZ / 1000000u)
+#define SYSTIME_SERVICE_HZ      4000u                           // SysTick interrupt rate, a multiple of 1 kHz
+#define SYSTIME_SERVICE_US      (1000000u / SYSTIME_SERVICE_HZ)
+#define SYSTIME_TICKS_PER_SERVICE (SYSTIME_CLOCK_HZ / SYSTIME_SERVICE_HZ)
+#define SYSTIME_SERVICES        6u                              // most services that can be added
+
+typedef void (*systime_service_t)(void);
+
+void systime_start(void);
+int systime_add_service(systime_service_t service);
+uint32 millis(void);
+uint32 micros(void);
+uint64 millis64(void);
+uint64 micros64(void);
+
+#endif
@@ -0,0 +1,278 @@
+/**
+ * @file    Telemetry.c
+ * @brief   Binary telemetry. For more details, please refer to Telemetry.h and TelemetryFormat.h files.
+ * @details Records are built in a small stack buffer, COBS encoded and queued whole to the UART ring buffer.
+ *          A record that doesn't fit in the ring buffer is dropped and shows up as a sequence gap on the host.
+*/
+#include <string.h>
+#include "Telemetry.h"
+#include "UartTx.h"
+#include "Crc.h"
+#include "SysTime.h"
+
+static uint8 enabled = 0;
+static uint8 sequence = 0;
+
+
+/**
+* @brief    COBS encoding
+* @details  encodes len bytes from src to dst and appends the 0x00 delimiter. len must be under 254.
+* @return   number of bytes written to dst
+*/
+static uint8 cobs_encode(const uint8 *src, uint8 len, uint8 *dst)
+{
+    uint8 code_pos = 0;
+    uint8 code = 1;
+    uint8 out = 1;
+    uint8 i;
+    
+    for(i = 0; i < len; i++) {
+        if(src[i] == 0) {
+            dst[code_pos] = code;
+            code_pos = out++;
+            code = 1;
+        }
+        else {
+            dst[out++] = src[i];
+            code++;
+        }
+    }
+    dst[code_pos] = code;
+    dst[out++] = 0;
+    
+    return out;
+}
+
+
+/**
+* @brief    Sending one record
+* @details  adds type, sequence number and CRC, encodes and queues the frame
+*/
+static void send_record(uint8 type, const uint8 *payload, uint8 len)
+{
+    uint8 frame[TELEMETRY_MAX_FRAME];
+    uint8 encoded[TELEMETRY_MAX_ENCODED];
+    uint16 crc;
+    uint8 n;
+    uint8 intr;
+    
+    if(!enabled)
+        return;
+    
+    intr = CyEnterCriticalSection();
+    frame[1] = sequence++;
+    CyExitCriticalSection(intr);
+    
+    frame[0] = type;
+    memcpy(&frame[2], payload, len);
+    crc = crc16_ccitt(frame, len + 2u);
+    frame[len + 2u] = (uint8)crc;
+    frame[len + 3u] = (uint8)(crc >> 8);
+    
+    n = cobs_encode(frame, len + 4u, encoded);
+    uart_tx_write(encoded, n);
+}
+
+
+/**
+* @brief    Storing 16 bits little endian
+* @details
+*/
+static uint8 *put16(uint8 *p, uint16 value)
+{
+    p[0] = (uint8)value;
+    p[1] = (uint8)(value >> 8);
+    return p + 2;
+}
+
+
+/**
+* @brief    Storing 32 bits little endian
+* @details
+*/
+static uint8 *put32(uint8 *p, uint32 value)
+{
+    p = put16(p, (uint16)value);
+    return put16(p, (uint16)(value >> 16));
+}
+
+
+/**
+* @brief    Enabling telemetry
+* @details  records are not sent until telemetry is enabled
+* @param    uint8 enable : 1 to send records, 0 to stop
+*/
+void telemetry_enable(uint8 enable)
+{
+    enabled = enable;
+}
+
+
+/**
+* @brief    Sending reflectance sample
+* @details
+* @param    const struct reflectance_sample_ *sample : sample from reflectance_try_read or reflectance_wait_new
+*/
+void telemetry_reflectance(const struct reflectance_sample_ *sample)
+{
+    uint8 payload[TELEMETRY_REFLECTANCE_LEN];
+    uint8 *p = payload;
+    
+    p = put32(p, sample->time_ms);
+    p = put16(p, sample->values.l3);
+    p = put16(p, sample->values.l2);
+    p = put16(p, sample->values.l1);
+    p = put16(p, sample->values.r1);
+    p = put16(p, sample->values.r2);
+    put16(p, sample->values.r3);
+    send_record(TELEMETRY_REFLECTANCE, payload, sizeof(payload));
+}
+
+
+/**
+* @brief    Sending PD controller state
+* @details
+* @param    q16_t error : controller input
+* @param    q16_t correction : controller output
+*/
+void telemetry_pd(q16_t error, q16_t correction)
+{
+    uint8 payload[TELEMETRY_PD_LEN];
+    
+    put32(put32(payload, (uint32)error), (uint32)correction);
+    send_record(TELEMETRY_PD, payload, sizeof(payload));
+}
+
+
+/**
+* @brief    Sending motor command
+* @details  same arguments as motor_drive
+*/
+void telemetry_motor(uint8 l_dir, uint8 r_dir, uint8 l_speed, uint8 r_speed)
+{
+    uint8 payload[TELEMETRY_MOTOR_LEN];
+    
+    payload[0] = (uint8)((l_dir ? 0x01u : 0u) | (r_dir ? 0x02u : 0u));
+    payload[1] = l_speed;
+    payload[2] = r_speed;
+    send_record(TELEMETRY_MOTOR, payload, sizeof(payload));
+}
+
+
+/**
+* @brief    Sending battery voltage
+* @details
+* @param    uint16 millivolts : battery voltage
+*/
+void telemetry_battery(uint16 millivolts)
+{
+    uint8 payload[TELEMETRY_BATTERY_LEN];
+    
+    put16(payload, millivolts);
+    send_record(TELEMETRY_BATTERY, payload, sizeof(payload));
+}
+
+
+/**
+* @brief    Sending a sample as the race controller read it
+* @details  the four sensors pd_step uses and the low bits of seq and time_ms, 12 bytes to fit every sample in the link
+* @param    const struct reflectance_sample_ *sample : sample from reflectance_try_read or reflectance_wait_new
+*/
+void telemetry_input(const struct reflectance_sample_ *sample)
+{
+    uint8 payload[TELEMETRY_INPUT_LEN];
+    uint8 *p = payload;
+    
+    p = put16(p, (uint16)sample->seq);
+    p = put16(p, (uint16)sample->time_ms);
+    p = put16(p, sample->values.l3);
+    p = put16(p, sample->values.l1);
+    p = put16(p, sample->values.r1);
+    put16(p, sample->values.r3);
+    send_record(TELEMETRY_INPUT, payload, sizeof(payload));
+}
+
+
+/**
+* @brief    Sending gyro heading
+* @details
+* @param    uint32 seq : seq of the sample the heading was updated on
+* @param    int32 mdeg : heading from gyro_heading_mdeg
+*/
+void telemetry_heading(uint32 seq, int32 mdeg)
+{
+    uint8 payload[TELEMETRY_HEADING_LEN];
+    
+    put32(put32(payload, seq), (uint32)mdeg);
+    send_record(TELEMETRY_HEADING, payload, sizeof(payload));
+}
+
+
+/**
+* @brief    Sending race settings
+* @details  sent when the race starts
+* @param    uint32 start_ms : millis() at the start
+* @param    q16_t kp : proportional gain
+* @param    q16_t kd : derivative gain
+* @param    uint8 base : PD base speed
+* @param    uint8 flags : TELEMETRY_RACE_GYRO when sharp turns are measured by the gyro
+* @param    int8 trim_left : left motor trim
+* @param    int8 trim_right : right motor trim
+*/
+void telemetry_race(uint32 start_ms, q16_t kp, q16_t kd, uint8 base, uint8 flags, int8 trim_left, int8 trim_right)
+{
+    uint8 payload[TELEMETRY_RACE_LEN];
+    uint8 *p = payload;
+    
+    p = put32(p, start_ms);
+    p = put32(p, (uint32)kp);
+    p = put32(p, (uint32)kd);
+    p[0] = base;
+    p[1] = flags;
+    p[2] = (uint8)trim_left;
+    p[3] = (uint8)trim_right;
+    send_record(TELEMETRY_RACE, payload, sizeof(payload));
+}
+
+
+/**
+* @brief    Sending sensor calibration
+* @details  only l3, l1, r1 and r3 of both
+* @param    const struct sensors_ *white : values on white
+* @param    const struct sensors_ *black : values on black
+*/
+void telemetry_calibration(const struct sensors_ *white, const struct sensors_ *black)
+{
+    uint8 payload[TELEMETRY_CALIBRATION_LEN];
+    uint8 *p = payload;
+    
+    p = put16(p, white->l3);
+    p = put16(p, white->l1);
+    p = put16(p, white->r1);
+    p = put16(p, white->r3);
+    p = put16(p, black->l3);
+    p = put16(p, black->l1);
+    p = put16(p, black->r1);
+    put16(p, black->r3);
+    send_record(TELEMETRY_CALIBRATION, payload, sizeof(payload));
+}
+
+
+/**
+* @brief    Sending an event
+* @details  stamped with millis()
+* @param    uint8 kind : TELEMETRY_EVENT_BUTTON, TELEMETRY_EVENT_IR, TELEMETRY_EVENT_IR_REPEAT or TELEMETRY_EVENT_FINISH
+* @param    uint8 value : meaning depends on kind, see TelemetryFormat.h
+* @param    uint16 data : meaning depends on kind, see TelemetryFormat.h
+*/
+void telemetry_event(uint8 kind, uint8 value, uint16 data)
+{
+    uint8 payload[TELEMETRY_EVENT_LEN];
+    uint8 *p = payload;
+    
+    p = put32(p, millis());
+    p[0] = kind;
+    p[1] = value;
+    put16(p + 2, data);
+    send_record(TELEMETRY_EVENT, payload, sizeof(payload));
+}
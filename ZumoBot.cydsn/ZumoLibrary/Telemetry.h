@@ -0,0 +1,25 @@
+/**
+ * @file    Telemetry.h
+ * @brief   Binary telemetry header file
+ * @details If you want to stream control loop data to a PC, include Telemetry.h file. Frames are queued with uart_tx_write,
+ *          the format is described in TelemetryFormat.h and decoded by Host/telemetry_decode.
+*/
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+#include <project.h>
+#include "TelemetryFormat.h"
+#include "Reflectance.h"
+#include "PD.h"
+
+void telemetry_enable(uint8 enable);
+void telemetry_reflectance(const struct reflectance_sample_ *sample);
+void telemetry_pd(q16_t error, q16_t correction);
+void telemetry_motor(uint8 l_dir, uint8 r_dir, uint8 l_speed, uint8 r_speed);
+void telemetry_battery(uint16 millivolts);
+void telemetry_input(const struct reflectance_sample_ *sample);
+void telemetry_heading(uint32 seq, int32 mdeg);
+void telemetry_race(uint32 start_ms, q16_t kp, q16_t kd, uint8 base, uint8 flags, int8 trim_left, int8 trim_right);
+void telemetry_calibration(const struct sensors_ *white, const struct sensors_ *black);
+void telemetry_event(uint8 kind, uint8 value, uint16 data);
+
+#endif
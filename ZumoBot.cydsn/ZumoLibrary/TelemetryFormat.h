@@ -0,0 +1,48 @@
+/**
+ * @file    TelemetryFormat.h
+ * @brief   Binary telemetry frame format
+ * @details Shared by the firmware and the host decoder, so it only depends on stdint.h.<br>
+ *          A frame is: type (1), seq (1), payload, CRC-16-CCITT of type..payload (2, little endian).
+ *          The frame is COBS encoded and ends with a 0x00 delimiter, so a receiver can resynchronize on any zero byte
+ *          and text printed on the same UART is rejected by the CRC. seq increases by one for every frame the
+ *          firmware tries to send, a gap means frames were dropped. Multi-byte fields are little endian.<br>
+ *          INPUT, HEADING, RACE, CALIBRATION and EVENT are everything the race controller reads, so a recording of
+ *          them can be fed back through it on the host (Host/replay). INPUT carries the low 16 bits of the sample seq
+ *          and time to fit 500 samples/s in the link, the receiver extends them from the previous values.
+*/
+#ifndef TELEMETRYFORMAT_H_
+#define TELEMETRYFORMAT_H_
+#include <stdint.h>
+
+#define TELEMETRY_REFLECTANCE       0x01u   // u32 time_ms, u16 l3, l2, l1, r1, r2, r3
+#define TELEMETRY_PD                0x02u   // i32 error, i32 correction (both Q16.16)
+#define TELEMETRY_MOTOR             0x03u   // u8 dirs (bit 0 left, bit 1 right, 1 = backward), u8 left speed, u8 right speed
+#define TELEMETRY_BATTERY           0x04u   // u16 battery voltage in millivolts
+#define TELEMETRY_INPUT             0x05u   // u16 seq, u16 time_ms, u16 l3, l1, r1, r3 (low bits of seq and time_ms)
+#define TELEMETRY_HEADING           0x06u   // u32 seq, i32 heading in millidegrees
+#define TELEMETRY_RACE              0x07u   // u32 start time_ms, i32 kp, i32 kd (Q16.16), u8 base speed, u8 flags, i8 left trim, i8 right trim
+#define TELEMETRY_CALIBRATION       0x08u   // u16 white l3, l1, r1, r3, u16 black l3, l1, r1, r3
+#define TELEMETRY_EVENT             0x09u   // u32 time_ms, u8 kind, u8 value, u16 data
+
+#define TELEMETRY_REFLECTANCE_LEN   16u
+#define TELEMETRY_PD_LEN            8u
+#define TELEMETRY_MOTOR_LEN         3u
+#define TELEMETRY_BATTERY_LEN       2u
+#define TELEMETRY_INPUT_LEN         12u
+#define TELEMETRY_HEADING_LEN       8u
+#define TELEMETRY_RACE_LEN          16u
+#define TELEMETRY_CALIBRATION_LEN   16u
+#define TELEMETRY_EVENT_LEN         8u
+
+#define TELEMETRY_RACE_GYRO         0x01u   // flags: sharp turns measured by the gyro
+
+#define TELEMETRY_EVENT_BUTTON      0x01u   // value 1 pressed, 0 released
+#define TELEMETRY_EVENT_IR          0x02u   // value command, data address
+#define TELEMETRY_EVENT_IR_REPEAT   0x03u   // value command, data address
+#define TELEMETRY_EVENT_FINISH      0x04u   // data low bits of the seq of the sample that saw the finish line
+
+#define TELEMETRY_MAX_PAYLOAD       16u
+#define TELEMETRY_MAX_FRAME         (TELEMETRY_MAX_PAYLOAD + 4u)                // type, seq, payload, crc
+#define TELEMETRY_MAX_ENCODED       (TELEMETRY_MAX_FRAME + 2u)                  // COBS overhead and delimiter
+
+#endif
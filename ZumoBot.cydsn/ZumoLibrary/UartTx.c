@@ -0,0 +1,126 @@
+/**
+ * @file    UartTx.c
+ * @brief   Buffered UART transmit. For more details, please refer to UartTx.h file.
+ * @details The ring buffer is filled by uart_tx_write and drained into the 4 byte UART_1 TX FIFO by a SysTime service.
+ *          A byte takes 87 us at 115200 baud, so a full FIFO lasts longer than the 250 us between services and the
+ *          line stays busy. uart_tx_write also fills the FIFO right away when it has room.
+*/
+#include "UartTx.h"
+#include "SysTime.h"
+
+#define UART_TX_MASK    (UART_TX_BUFFER_SIZE - 1u)
+
+static volatile uint8 tx_buffer[UART_TX_BUFFER_SIZE];
+static volatile uint16 tx_head = 0;          // next free slot, written by uart_tx_write
+static volatile uint16 tx_tail = 0;          // next byte to send, written by drain
+static volatile uint32 tx_dropped = 0;
+
+
+/**
+* @brief    Moving bytes to the UART
+* @details  fills the UART TX FIFO from the ring buffer. Called from the SysTick interrupt or with interrupts disabled.
+*/
+static void drain(void)
+{
+    uint16 tail = tx_tail;
+    
+    while(tail != tx_head && (UART_1_ReadTxStatus() & UART_1_TX_STS_FIFO_NOT_FULL)) {
+        UART_1_WriteTxData(tx_buffer[tail]);
+        tail = (tail + 1u) & UART_TX_MASK;
+    }
+    tx_tail = tail;
+}
+
+
+/**
+* @brief    SysTime service
+* @details  runs drain while the buffer has data
+*/
+static void uart_tx_service(void)
+{
+    if(tx_tail != tx_head) {
+        drain();
+    }
+}
+
+
+/**
+* @brief    Starting buffered UART transmit
+* @details  UART_1 and SysTime must be started before calling
+*/
+void uart_tx_start()
+{
+    static uint8 started = 0;
+    
+    if(!started) {
+        started = systime_add_service(uart_tx_service);
+    }
+}
+
+
+/**
+* @brief    Free space in the transmit buffer
+* @details
+*/
+uint16 uart_tx_free()
+{
+    return (uint16)((tx_tail - tx_head - 1u) & UART_TX_MASK);
+}
+
+
+/**
+* @brief    Queueing bytes for sending
+* @details  never waits. If all len bytes don't fit, none of them are queued and they are added to the dropped count,
+*           so a message is either sent whole or not at all. Can be called from interrupts.
+* @param    const uint8 *data : bytes to send
+* @param    int len : number of bytes
+* @return   int
+*   - returns len if the bytes were queued, otherwise 0
+*/
+int uart_tx_write(const uint8 *data, int len)
+{
+    uint8 intr = CyEnterCriticalSection();
+    uint16 head = tx_head;
+    int i;
+    
+    if(len <= 0) {
+        CyExitCriticalSection(intr);
+        return 0;
+    }
+    if((uint16)len > uart_tx_free()) {
+        tx_dropped += (uint32)len;
+        CyExitCriticalSection(intr);
+        return 0;
+    }
+    
+    for(i = 0; i < len; i++) {
+        tx_buffer[head] = data[i];
+        head = (head + 1u) & UART_TX_MASK;
+    }
+    tx_head = head;
+    drain();
+    CyExitCriticalSection(intr);
+    
+    return len;
+}
+
+
+/**
+* @brief    Number of bytes dropped because the buffer was full
+* @details
+*/
+uint32 uart_tx_dropped()
+{
+    return tx_dropped;
+}
+
+
+/**
+* @brief    Waiting until the transmit buffer is empty
+* @details  use before stopping the UART or going to sleep
+*/
+void uart_tx_flush()
+{
+    while(tx_tail != tx_head);
+    while(!(UART_1_ReadTxStatus() & UART_1_TX_STS_FIFO_EMPTY));
+}
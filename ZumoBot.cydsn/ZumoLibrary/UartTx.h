@@ -0,0 +1,18 @@
+/**
+ * @file    UartTx.h
+ * @brief   Buffered UART transmit header file
+ * @details If you want to send data over UART_1 without waiting, include UartTx.h file. Bytes are queued in a ring buffer and a SysTime service moves them to the UART FIFO.
+*/
+#ifndef UARTTX_H_
+#define UARTTX_H_
+#include <project.h>
+
+#define UART_TX_BUFFER_SIZE     1024u       // must be a power of two
+
+void uart_tx_start(void);
+int uart_tx_write(const uint8 *data, int len);
+uint16 uart_tx_free(void);
+uint32 uart_tx_dropped(void);
+void uart_tx_flush(void);
+
+#endif
@@ -2,82 +2,177 @@
  * @file    Ultra.c
  * @brief   Basic methods for operating ultrasonic sensor. For more details, please refer to Ultra.h file. 
  * @details part number: HC-SR04
+ *          A SysTime service raises Trig for one SysTick period (250 us) every ULTRA_TRIGGER_MS. Timer captures both
+ *          edges of Echo and ultra_isr runs once per echo pulse; the pulse width is the difference of the two
+ *          captures, converted to millimetres in integer math. Timer runs over the full 16 bits so the difference is
+ *          right across a reload. The last ULTRA_MEDIAN_N distances are kept with the time of the newest one, so
+ *          ultra_read can drop single spurious echoes and tell when the sensor has gone quiet.
 */
-
-#include <project.h>
-#include <stdio.h>
-#include <Timer.h>
-
-#define NUMBER_OF_TICKS		 2400
-
 #include "Ultra.h"
+#include "SysTime.h"
+#include "Profile.h"
 
+#define CAPTURE_FIFO    4
+#define TRIGGER_PERIODS (ULTRA_TRIGGER_MS * (SYSTIME_SERVICE_HZ / 1000u))
+#define MAX_ECHO_TICKS  ((uint32)ULTRA_MAX_ECHO_US * (ULTRA_TIMER_CLOCK_HZ / 1000u) / 1000u)
 
-static volatile float distance = 0;
-static volatile float cent = 0;
+#define NO_ECHO         0xFFFFu     // out of range echo in the median window, sorts above every distance
+
+static volatile uint16 distance_mm = 0;
+static volatile uint16 window[ULTRA_MEDIAN_N];
+static volatile uint8 window_idx = 0;
+static volatile uint8 window_count = 0;
+static volatile uint32 echo_time_ms = 0;
+static uint16 rise = 0;
+static uint8 have_rise = 0;
+static uint16 trigger_count = 0;
 
 
 /**
-* @brief    Systick Interrupt Handler
-* @details  Counting system ticks to occur trigger
+* @brief    Converting echo time to distance
+* @details  343 m/s there and back: mm = us * 343 / 2000, us = ticks * 1000000 / ULTRA_TIMER_CLOCK_HZ
+* @param    uint32 ticks : echo pulse width in Timer counts
 */
-CY_ISR(SYS_ISR)
+static uint16 ticks_to_mm(uint32 ticks)
 {
-    static int cnt=0;
-    cnt++;
-  
-    if(cnt==1)
-       Trig_Write(1);           // Trigger High
-    else if(cnt==100)
-        Trig_Write(0);           // Trigger Low
-    else if(cnt==1100)
-        cnt=0;  
+    return (uint16)(ticks * 343u * (1000000u / 2000u) / ULTRA_TIMER_CLOCK_HZ);
 }
 
 
 /**
 * @brief    Ultra Sonic Sensor Interrupt Handler
-* @details  Measuring reflecting time to decide distance between Zumobot and obstacle
+* @details  Measuring reflecting time to decide distance between Zumobot and obstacle. Timer counts down, so the width
+*           is the rising edge capture minus the falling edge capture. The Echo level now tells which edge the last
+*           capture was; the earlier ones alternate from it.
 */
 CY_ISR(ultra_isr_handler)
 {
-    uint16_t time = 0;
-    Timer_Stop();
+    uint16 capture[CAPTURE_FIFO];
+    uint8 n = 0, i, level;
+    uint16 width;
+    PROFILE_BEGIN(ULTRA_ISR);
     
-    Timer_ReadStatusRegister();
+    while(n < CAPTURE_FIFO && (Timer_ReadStatusRegister() & Timer_STATUS_FIFONEMP)) {
+        capture[n++] = Timer_ReadCapture();
+    }
+    level = Echo_Read();
     
-    if(!Echo_Read()) {
-        time = Timer_ReadCounter();             // Read counter value of Timer
-        
-        distance = (float)time / 58;            // us / 58 = centimeters
-        cent = 5 * (distance - 16) / 4;         // calibration for this Timer(800 kHz)
-        
-        Timer_WriteCounter(0xFFFF);             // Counter initialization
+    for(i = 0; i < n; i++) {
+        uint8 rising = ((n - 1u - i) & 1u) ? !level : level;
+        if(rising) {
+            rise = capture[i];
+            have_rise = 1;
+        }
+        else if(have_rise) {
+            width = rise - capture[i];
+            distance_mm = width < MAX_ECHO_TICKS ? ticks_to_mm(width) : 0;
+            have_rise = 0;
+            
+            window[window_idx] = distance_mm ? distance_mm : NO_ECHO;
+            window_idx = window_idx + 1u < ULTRA_MEDIAN_N ? window_idx + 1u : 0;
+            if(window_count < ULTRA_MEDIAN_N) window_count++;
+            echo_time_ms = millis();
+        }
+    }
+    PROFILE_END(ULTRA_ISR);
+}
+
+
+/**
+* @brief    SysTime service
+* @details  Trig is high for the first SysTick period of every TRIGGER_PERIODS, the sensor measures on its falling edge
+*/
+static void ultra_service(void)
+{
+    if(trigger_count == 0) {
+        Trig_Write(1);
     }
-    else {
-         Timer_WriteCounter(0xFFFF);            // Counter initialization
+    else if(trigger_count == 1) {
+        Trig_Write(0);
+    }
+    if(++trigger_count >= TRIGGER_PERIODS) {
+        trigger_count = 0;
     }
-    Timer_Start();
 }
 
 
 /**
 * @brief    Starting Ultra Sonic Sensor
-* @details  
+* @details  SysTime must be started first
 */
 void Ultra_Start()
 {
-    CyIntSetSysVector((SysTick_IRQn + 16), SYS_ISR);    // Map systick ISR to SYS_ISR
-    SysTick_Config(NUMBER_OF_TICKS);                    // Enable Systick Timer
+    static uint8 started = 0;
+    
     ultra_isr_StartEx(ultra_isr_handler);               // Start ultra sonic interrupt
-    Timer_Start();                                      // Start Timer
+    ultra_isr_SetPriority(ULTRA_ISR_PRIORITY);
+    Timer_Start();                                      // Start echo capture
+    Timer_WritePeriod(0xFFFFu);                         // TopDesign period is 23319, widths need the full 16 bits
+    Timer_WriteCounter(0xFFFFu);
+    if(!started) {
+        started = systime_add_service(ultra_service);   // Start trigger pulses
+    }
 }
 
-float Ultra_GetDistance(void)
+
+/**
+* @brief    Distance to the obstacle in millimetres
+* @details  from the latest echo, 0 when there is no obstacle in range
+*/
+uint16 ultra_distance_mm()
 {
-    return cent;       
-}    
+    return distance_mm;
+}
 
 
+/**
+* @brief    Filtered distance to the obstacle
+* @details  Median of the echoes received so far, up to ULTRA_MEDIAN_N, so a single echo off the floor or a missed one
+*           does not move the result. The window is copied with interrupts off and sorted by insertion.
+* @param    struct ultra_range_ *range : filled with the median distance, its validity and age
+* @return   validity of the range
+*           - returns 1 if there is an obstacle within ULTRA_MAX_RANGE_MM and the newest echo is fresh, otherwise 0
+*/
+uint8 ultra_read(struct ultra_range_ *range)
+{
+    uint16 sorted[ULTRA_MEDIAN_N];
+    uint8 n, i, j;
+    uint16 median;
+    uint8 interrupts;
+    
+    interrupts = CyEnterCriticalSection();
+    n = window_count;
+    for(i = 0; i < n; i++) {
+        sorted[i] = window[i];
+    }
+    range->time_ms = echo_time_ms;
+    CyExitCriticalSection(interrupts);
+    
+    for(i = 1; i < n; i++) {
+        uint16 v = sorted[i];
+        for(j = i; j > 0 && sorted[j - 1u] > v; j--) {
+            sorted[j] = sorted[j - 1u];
+        }
+        sorted[j] = v;
+    }
+    
+    median = n ? sorted[n / 2u] : NO_ECHO;
+    range->mm = median <= ULTRA_MAX_RANGE_MM ? median : 0;
+    range->age_ms = millis() - range->time_ms;
+    range->valid = n && range->mm && range->age_ms <= ULTRA_TIMEOUT_MS;
+    
+    return range->valid;
+}
 
 
+/**
+* @brief    Distance to the obstacle in centimetres
+* @details  median filtered, 0 when there is no obstacle in range or the sensor has not answered for ULTRA_TIMEOUT_MS
+*/
+float Ultra_GetDistance(void)
+{
+    struct ultra_range_ range;
+    
+    ultra_read(&range);
+    return range.valid ? range.mm / 10.0f : 0.0f;
+}
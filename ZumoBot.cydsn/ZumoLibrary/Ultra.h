@@ -5,8 +5,34 @@
 */
 #ifndef ULTRA_H_
 #define ULTRA_H_
-    
+#include <project.h>
+
+#define ULTRA_TIMER_CLOCK_HZ    800000u     // Timer input clock (timer_clock_4)
+#define ULTRA_MAX_ECHO_US       25000u      // longer echoes are taken as no obstacle (about 4.3 m)
+#define ULTRA_MEDIAN_N          5u          // echoes in the rolling median, odd
+#define ULTRA_MAX_RANGE_MM      2000u       // median distances beyond this are taken as no obstacle
+#define ULTRA_TIMEOUT_MS        250u        // a range is stale when no echo has arrived for this long
+#define ULTRA_TRIGGER_MS        60u         // measurement interval, the HC-SR04 needs at least 60 ms
+#define ULTRA_ISR_PRIORITY      2u          // ultra_isr, above the control tick so the capture FIFO is emptied in time
+
+/**
+* @brief    Filtered ultrasonic range
+* @details  mm is the median of the last ULTRA_MEDIAN_N echoes, 0 when the median has no obstacle in range. valid is 1
+*           when mm is an obstacle and the newest echo is not older than ULTRA_TIMEOUT_MS. time_ms is when the newest
+*           echo completed and age_ms how long ago that was, both in millis().
+*/
+struct ultra_range_ {
+    uint16 mm;
+    uint8 valid;
+    uint32 time_ms;
+    uint32 age_ms;
+};
+
+CY_ISR_PROTO(ultra_isr_handler);
+
 void Ultra_Start();
 float Ultra_GetDistance(void);
+uint16 ultra_distance_mm(void);
+uint8 ultra_read(struct ultra_range_ *range);
 
 #endif
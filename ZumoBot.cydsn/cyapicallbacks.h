@@ -15,5 +15,9 @@
     /*Define your macro callbacks here */
     /*For more information, refer to the Macro Callbacks topic in the PSoC Creator Help.*/
     
+    /* I2cAsync.c runs its transfer queue at the end of every I2C interrupt */
+    #define I2C_ISR_EXIT_CALLBACK
+    void I2C_ISR_ExitCallback(void);
+    
 #endif /* CYAPICALLBACKS_H */   
 /* [] */
@@ -33,6 +33,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <math.h>
 #include "Motor.h"
 #include "Ultra.h"
@@ -44,25 +45,66 @@
 #include "IR.h"
 #include "Ambient.h"
 #include "Beep.h"
+#include "ControlTick.h"
+#include "SysTime.h"
+#include "PD.h"
+#include "Calibration.h"
+#include "UartTx.h"
+#include "Telemetry.h"
+#include "Heading.h"
+#include "Magnet.h"
+#include "Profile.h"
 
 #define MAX_SPEED 255
 #define BASE_SPEED 255
 #define MIN_SPEED 0
-#define Kp 85
-#define Kd 600
+#define Kp Q16(255)
+#define Kd Q16(312.5)
+#define LINE_POSITION_UNIT 500 //Line position from the centre to l1 or r1, the PD error is 1.0 there
+#define CONTROL_RATE_HZ (2 * REFLECTANCE_SAMPLE_HZ) //Tick twice per sample so a new sample waits at most half a period
+#define LINE_DELAY_MS 100 //Time after the start before the finish line is looked for
+#define VOLTAGE_CHECK_MS 5000 //Battery voltage check interval
+#define TELEMETRY 1 //Stream binary telemetry frames, decode with Host/telemetry_decode
+#define TELEMETRY_DIVIDER 4 //Send every 4th sample, all three records take 45 bytes & 115200 baud carries ~11.5 kB/s
+#define TELEMETRY_RECORD 0 //1: send every sample pd_step reads instead, 18 bytes each (9 kB/s, 10.4 kB/s with the gyro headings), for Host/replay
+#define RECORD_DIVIDER 2 //With TELEMETRY_RECORD pd_step only reads every 2nd sample, all of them would not fit in the UART
+#define CALIBRATION_SPEED 120 //Motor speed while sweeping over the line
+#define CALIBRATION_SWEEP_MS 200 //Time to turn from the line to one side
+#define CALIBRATION_CONTRAST 2000 //Smallest black - white difference a used sensor must have
+#define HEADING_DIVIDER 10 //Update the gyro heading every 10th sample (100 Hz), the FIFO fills in 40 ms
+#define SHARP_TURN_MAX_DEG 100 //A sharp turn never goes further than this
+#define MAG_CALIBRATION_SPEED 80 //Motor speed while spinning for the magnetometer calibration
+#define MAG_CALIBRATION_TURNS 2 //Full turns measured by the gyro
+#define MAG_CALIBRATION_PERIOD_MS 40 //Magnetometer sample period while spinning (25 Hz)
+#define MAG_CALIBRATION_TIMEOUT_MS 10000 //Gives up spinning if the turns take longer
 
 struct sensors_ ref;
 int rread(void);
 
+static uint16 l1B,l3W,l3B,r1B,r3W,r3B; //Reflectance sensor black and white values
+static struct pd_ pd;
+static struct calibration_ cal; //Sensor calibration, gains & motor trim, kept in EEPROM
+static struct reflectance_sample_ sample; //Last sample used by pd_step
+static uint32 raceStart = 0; //millis() when the race started
+static volatile bool lineCrossed = false; //Set by pd_step when the finish line is reached
+static bool gyroOk = false; //Sharp turns are measured by the gyro when it works, by the outer sensors if not
+static int8 turnDir = 0; //Sharp turn in progress, 1:right -1:left
+static int32 turnStart = 0; //Heading in millidegrees when the sharp turn started
+
 void motor_hard_turn_left(uint32 delay);
 void motor_hard_turn_right(uint32 delay);
 bool checkVoltage();
 void flashLED();
-void calibrate(struct sensors_ ref, float * result);
+bool calibrate();
+bool calibrateMagnet();
 bool isOnBlackLine();
 void rick_roll();
 void stop();
-float limitSpeed(float speed,int min,int max);
+static void race_begin(q16_t kp, q16_t kd, uint8 base, uint32 start);
+static void pd_step(void);
+static int8 sharpTurn(void);
+static void apply_calibration(void);
+static int remoteCommand(struct ir_command_ *ir);
 
 /**
  * @file    main.c
@@ -74,36 +116,55 @@ int main()
 {
     //Time 00:13:00. Somewhat reliable
     CyGlobalIntEnable; 
+    systime_start();
+    profile_start();
     UART_1_Start();
+    uart_tx_start();
+    telemetry_enable(TELEMETRY);
     ADC_Battery_Start();         
     printf("\nBoot\n");
     BatteryLed_Write(0); // Switch led off 
     uint8 button; //Button state
-    uint8 leftMotor = 20; //LeftMotor Speed
-    uint8 rightMotor = 20; //RightMotor Speed
+    uint8 lastButton = 1; //Button state in the previous round, changes are sent as telemetry events
+    char key; //Command from the serial terminal
 
-    uint16 checkVoltageDelay = 5000; //Delay to check voltage every 5 seconds
-    uint8 lineDelay = 0; //Delay to start checking if on black line
-    uint16 l1W,l1B,l3W,l3B,r1W,r1B,r3W,r3B; //Reflectance sensor black and white values
-    float result[5]; //Calibration results
+    uint32 voltageChecked = millis() - VOLTAGE_CHECK_MS; //Time of the last voltage check, the first one is right away
     bool calibrated = false; //Calibration status
-    uint8 leftDir = 0;//Direction of Left Motor, 0:forward 1:backward.
-    uint8 rightDir = 0;//Direction of Right Motor, 0:forward 1:backward.
-    unsigned int IR_val; //IR value
-    
-    l3B = 23999; //Black line sensor value
-    l1B = 23999;
-    r1B = 23999;
-    r3B = 23999;
+    bool atStart = false; //On the start line waiting for the remote
+    struct ir_command_ ir; //Remote button
     
     CyGlobalIntEnable; 
     sensor_isr_StartEx(sensor_isr_handler);
     
     reflectance_start();
     IR_led_Write(1);
+    ir_start();
+    
+    //Measures the gyro bias, the robot must stay still for half a second
+    gyroOk = gyro_heading_start();
+    if(!gyroOk){
+        printf("Gyro not found\n");
+    }
+    
+    //Uses the stored calibration unless the button is held down during reset
+    if(!calibration_load(&cal)){
+        memset(&cal, 0, sizeof(cal));
+        cal.black.l3 = REFLECTANCE_MAX_READING; //Black line sensor value
+        cal.black.l1 = REFLECTANCE_MAX_READING;
+        cal.black.r1 = REFLECTANCE_MAX_READING;
+        cal.black.r3 = REFLECTANCE_MAX_READING;
+        cal.mag.scale_x = MAGNET_SCALE_ONE;
+        cal.mag.scale_y = MAGNET_SCALE_ONE;
+        cal.mag.scale_z = MAGNET_SCALE_ONE;
+    }
+    else if(SW1_Read() != 0){
+        apply_calibration();
+        calibrated = true;
+        printf("Calibration loaded\n");
+    }
+    //Stored gains tuned from other defaults than this build's Kp & Kd are replaced with them
+    calibration_gains(&cal, Kp, Kd);
     
-    float error = 0;
-    float lastError = 0;
     /*
     Main loop
     
@@ -112,14 +173,22 @@ int main()
     for(;;)
     {
         button = SW1_Read();
+        if(button != lastButton){
+            telemetry_event(TELEMETRY_EVENT_BUTTON, !button, 0);
+            lastButton = button;
+        }
         if(button == 0){
             if(!calibrated){
-                calibrate(ref, result);
-                l1W = result[0];
-                r1W = result[1];
-                l3W = result[3];
-                r3W = result[4];
-                calibrated = true;
+                if(calibrate()){
+                    if(gyroOk){
+                        calibrateMagnet();
+                    }
+                    apply_calibration();
+                    if(calibration_save(&cal) != CYRET_SUCCESS){
+                        printf("Calibration not saved\n");
+                    }
+                    calibrated = true;
+                }
                 button = 1;
             }
             //Robot placed on track & if calibrated, moves forward untill a perpendicular black line.
@@ -138,95 +207,201 @@ int main()
                         }
                     }
                 }
-                IR_val = get_IR();
-                if(IR_val != 1){
-                    /*
-                    Secondary Loop
-                    PD Drive
-                    
-                    Using calibrated sensor values it Determines if it turns left or right.
-                    If outer sensors detect a black line it changes the direction of one of the motors.
-                    If values are either above 255 or below 0 they are set at 255 & 0 respectively.
-                    Calls isOnBlackLine() to check if all sensors are on the line and stops it accordingly.
-                    */
-                    for(;;){
-                        reflectance_read(&ref);
-                        float r1Scale = (float)r1B/(ref.l1 - l1W);
-                        float l1Scale = (float)l1B/(ref.r1 - r1W);
-                        
-                        error = (r1Scale) - (l1Scale);
-                        float motorSpeed = Kp * error + Kd * (error - lastError);
-                        lastError = error;
-                        
-                        float leftMotorSpeed = BASE_SPEED + motorSpeed;
-                        float rightMotorSpeed = BASE_SPEED - motorSpeed;
-                        
-                        leftMotorSpeed = limitSpeed(leftMotorSpeed,MIN_SPEED,MAX_SPEED);
-                        rightMotorSpeed = limitSpeed(rightMotorSpeed,MIN_SPEED,MAX_SPEED);
-                        
-                        if (rightMotorSpeed < leftMotorSpeed) leftMotorSpeed = MAX_SPEED; 
-                        if (leftMotorSpeed < rightMotorSpeed) rightMotorSpeed = MAX_SPEED;
-                        
-                        rightMotor = rightMotorSpeed;
-                        leftMotor = leftMotorSpeed;
-                        
-                        if(ref.r3 >= r3B-5000 && !isOnBlackLine()){
-                            rightDir = 1;
-                            leftDir= 0;
-                            rightMotor = 255;
-                            leftMotor= 255;
-                        }
-                        else if(ref.l3 >= l3B-5000 && !isOnBlackLine()){
-                            leftDir = 1; 
-                            rightDir = 0;
-                            leftMotor = 255;
-                            rightMotor = 255;
-                        }
-                        else{
-                          leftDir = 0;
-                          rightDir = 0;
-                        }
-                        
-                        motor_drive(leftDir,rightDir,leftMotor,rightMotor,1);
-                        
-                        // Starting delay to begin to check for horizontal line.
-                        if(lineDelay <= 100){
-                            lineDelay++;
-                        }
-                     
-                        //checks if passed black line every starting 100ms after starting
-                        if(isOnBlackLine() && lineDelay > 100){
-                            stop();
-                        }
-                    }
-                }
+                //Presses before reaching the line don't count
+                ir_flush();
+                atStart = true;
             }
         }
+        //Any remote button starts the race, holding one down doesn't
+        if(atStart && remoteCommand(&ir) && !ir.repeat){
+            /*
+            Secondary Loop
+            PD Drive
+            
+            pd_step() runs from the control tick at CONTROL_RATE_HZ, once for each new sensor sample, until it sees the finish line.
+            */
+            race_begin(cal.kp, cal.kd, BASE_SPEED, millis());
+            control_tick_start(CONTROL_RATE_HZ, pd_step);
+            while(!lineCrossed);
+            control_tick_stop();
+            printf("ticks: %lu overruns: %lu jitter: %u us uart dropped: %lu\n", control_tick_count(), control_tick_overruns(), control_tick_max_jitter_us(), uart_tx_dropped());
+            profile_dump();
+            stop();
+        }
+        //'p' from the serial terminal prints the cycle counts of the profiled code, 'r' clears them
+        key = UART_1_GetChar();
+        if(key == 'p'){
+            profile_dump();
+        }
+        else if(key == 'r'){
+            profile_reset();
+        }
         /*
         Checks voltage & if < 4.0 stops motors & flashes LED.
         */
-        if(checkVoltageDelay >= 5000){
+        if(millis() - voltageChecked >= VOLTAGE_CHECK_MS){
             if(checkVoltage()){
                 break;
             }
-            checkVoltageDelay = 0;
+            voltageChecked = millis();
         }
         CyDelay(20);
-        checkVoltageDelay +=20;
     }
     flashLED();
     motor_stop();
+    return 0;
+}
+/*
+Takes the values in cal into use
+*/
+static void apply_calibration(void)
+{
+    l3W = cal.white.l3;
+    r3W = cal.white.r3;
+    l1B = cal.black.l1;
+    r1B = cal.black.r1;
+    l3B = cal.black.l3;
+    r3B = cal.black.r3;
+    reflectance_set_calibration(&cal.white, &cal.black);
+    reflectance_set_threshold(cal.threshold.l3, cal.threshold.l1, cal.threshold.r1, cal.threshold.r3);
+    motor_set_trim(cal.trim_left, cal.trim_right);
+    magnet_set_calibration(&cal.mag);
+}
+/*
+Resets the race state for a new race starting at start (millis()) & sends the calibration & race settings.
+Every race starts through here, Host/track_sim & Host/replay included, so they run pd_step from the same state.
+*/
+static void race_begin(q16_t kp, q16_t kd, uint8 base, uint32 start)
+{
+    pd_init(&pd, kp, kd, base, MIN_SPEED, MAX_SPEED);
+    memset(&sample, 0, sizeof(sample));
+    turnDir = 0;
+    turnStart = 0;
+    lineCrossed = false;
+    raceStart = start;
+    telemetry_calibration(&cal.white, &cal.black);
+    telemetry_race(raceStart, kp, kd, base, gyroOk ? TELEMETRY_RACE_GYRO : 0, cal.trim_left, cal.trim_right);
 }
 /*
-Limits speed to min or max value
+Gets a command from the remote like ir_get_command & sends it as a telemetry event
 */
-float limitSpeed(float speed, int min, int max){
-    int limitedSpeed = speed;
-    if (limitedSpeed < min) limitedSpeed = min; 
-    if(limitedSpeed > max) limitedSpeed = max;
-    return limitedSpeed;
+static int remoteCommand(struct ir_command_ *ir)
+{
+    if(!ir_get_command(ir)){
+        return 0;
+    }
+    telemetry_event(ir->repeat ? TELEMETRY_EVENT_IR_REPEAT : TELEMETRY_EVENT_IR, ir->command, ir->address);
+    return 1;
+}
+/*
+PD step, called from the control tick. Returns without doing anything when there is no new sensor sample.
+
+Using calibrated sensor values it Determines if it turns left or right.
+If outer sensors detect a black line it changes the direction of one of the motors.
+If values are either above 255 or below 0 they are set at 255 & 0 respectively.
+Calls isOnBlackLine() to check if all sensors are on the line and flags it accordingly.
+With TELEMETRY_RECORD it sends everything it reads (sample & heading) so Host/replay can run it again.
+*/
+static void pd_step(void)
+{
+    uint8 leftMotor; //LeftMotor Speed
+    uint8 rightMotor; //RightMotor Speed
+    uint8 leftDir = 0;//Direction of Left Motor, 0:forward 1:backward.
+    uint8 rightDir = 0;//Direction of Right Motor, 0:forward 1:backward.
+    int8 turn;
+    PROFILE_BEGIN(PD_STEP); //Ticks without a new sample return before the end & aren't counted
+    
+    if(!reflectance_try_read(&sample) || (TELEMETRY_RECORD && sample.seq % RECORD_DIVIDER != 0)){
+        return;
+    }
+    if(TELEMETRY_RECORD){
+        telemetry_input(&sample);
+    }
+    ref = sample.values;
+    if(gyroOk && sample.seq % HEADING_DIVIDER == 0){
+        gyro_heading_update();
+        if(TELEMETRY_RECORD){
+            telemetry_heading(sample.seq, gyro_heading_mdeg());
+        }
+    }
+    //Positive when the line is right of the centre, 1.0 when it is under r1
+    q16_t error = pd_ratio((int32)reflectance_line_position(&ref) - REFLECTANCE_POSITION_CENTER, LINE_POSITION_UNIT);
+    q16_t correction = pd_update(&pd, error);
+    pd_motor_speeds(&pd, correction, &leftMotor, &rightMotor);
+    
+    if (rightMotor < leftMotor) leftMotor = MAX_SPEED; 
+    if (leftMotor < rightMotor) rightMotor = MAX_SPEED;
+    
+    turn = sharpTurn();
+    if(turn > 0){
+        rightDir = 1;
+        leftDir= 0;
+        rightMotor = 255;
+        leftMotor= 255;
+    }
+    else if(turn < 0){
+        leftDir = 1; 
+        rightDir = 0;
+        leftMotor = 255;
+        rightMotor = 255;
+    }
+    
+    motor_drive(leftDir,rightDir,leftMotor,rightMotor,0);
+    
+    if(!TELEMETRY_RECORD && sample.seq % TELEMETRY_DIVIDER == 0){
+        telemetry_reflectance(&sample);
+        telemetry_pd(error, correction);
+        telemetry_motor(leftDir,rightDir,leftMotor,rightMotor);
+    }
+    
+    //checks if passed black line every starting 100ms after starting
+    if(isOnBlackLine() && (int32)(sample.time_ms - raceStart) > LINE_DELAY_MS){
+        lineCrossed = true;
+        telemetry_event(TELEMETRY_EVENT_FINISH, 0, (uint16)sample.seq);
+    }
+    PROFILE_END(PD_STEP);
 }
+/*
+Decides if pd_step spins in place. Returns 1 to spin right, -1 to spin left & 0 to follow the line.
 
+An outer sensor on the line starts a sharp turn. With the gyro the turn goes on until that outer sensor has left
+the line & a middle sensor is on it, or the robot has turned SHARP_TURN_MAX_DEG. Without it the robot spins
+only while the outer sensor sees the line.
+*/
+static int8 sharpTurn(void)
+{
+    int8 dir = 0;
+    int32 turned;
+    
+    if(isOnBlackLine()){
+        turnDir = 0;
+        return 0;
+    }
+    if(ref.r3 >= r3B-5000){
+        dir = 1;
+    }
+    else if(ref.l3 >= l3B-5000){
+        dir = -1;
+    }
+    if(!gyroOk){
+        return dir;
+    }
+    
+    if(turnDir == 0){
+        if(dir != 0){
+            turnDir = dir;
+            turnStart = gyro_heading_mdeg();
+        }
+        return turnDir;
+    }
+    
+    turned = abs(gyro_heading_mdeg() - turnStart);
+    if(turned >= SHARP_TURN_MAX_DEG * 1000 ||
+       (dir != turnDir && (ref.l1 >= l1B-5000 || ref.r1 >= r1B-5000))){
+        turnDir = 0;
+    }
+    return turnDir;
+}
 /*
 Detects black line & stops on the second line and plays a tune
 */
@@ -241,75 +416,32 @@ void stop(){
             if(isOnBlackLine()){
                 motor_forward(0,0);
                 motor_stop();
-                rick_roll();
+                if(!beep_busy()){
+                    rick_roll();
+                }
             }
         }
     }
 }
 }
+static const struct note_ rickRoll[] = {
+    {140, 153}, {10, BEEP_REST}, {140, 136}, {10, BEEP_REST}, {140, 114}, {10, BEEP_REST},
+    {140, 136}, {10, BEEP_REST}, {340, 91}, {10, BEEP_REST}, {100, 91}, {290, 91},
+    {10, BEEP_REST}, {300, 102}, {590, 102}, {10, BEEP_REST}, {140, 153}, {10, BEEP_REST},
+    {140, 136}, {10, BEEP_REST}, {140, 121}, {10, BEEP_REST}, {140, 153}, {10, BEEP_REST},
+    {340, 102}, {10, BEEP_REST}, {100, 102}, {290, 102}, {10, BEEP_REST}, {300, 114},
+    {150, 114}, {150, 121}, {290, 136}, {10, BEEP_REST}, {140, 153}, {10, BEEP_REST},
+    {140, 136}, {10, BEEP_REST}, {140, 114}, {10, BEEP_REST}, {140, 136}, {10, BEEP_REST},
+    {590, 114}, {10, BEEP_REST}, {290, 102}, {10, BEEP_REST}, {300, 121}, {140, 136},
+    {10, BEEP_REST}, {290, 153}, {10, BEEP_REST}, {140, 153}, {10, BEEP_REST}, {590, 102},
+    {10, BEEP_REST}, {590, 114}, {10, BEEP_REST}
+};
 /*
-Plays a fun tune
+Queues a fun tune & returns at once
 */
 void rick_roll(){
-        Beep(140,153);
-        CyDelay(10);
-        Beep(140,136);
-        CyDelay(10);
-        Beep(140,114);
-        CyDelay(10);
-        Beep(140,136);
-        CyDelay(10);
-        Beep(340,91);
-        CyDelay(10);
-        Beep(100,91);
-        Beep(290,91);
-        CyDelay(10);
-        Beep(300,102);
-        Beep(590,102);
-        CyDelay(10);
-        Beep(140,153);
-        CyDelay(10);
-        Beep(140,136);
-        CyDelay(10);
-        Beep(140,121);
-        CyDelay(10);
-        Beep(140,153);
-        CyDelay(10);
-        Beep(340,102);
-        CyDelay(10);
-        Beep(100,102);
-        Beep(290,102);
-        CyDelay(10);
-        Beep(300,114);
-        Beep(150,114);
-        Beep(150,121);
-        Beep(290,136);
-        CyDelay(10);
-        Beep(140,153);
-        CyDelay(10);
-        Beep(140,136);
-        CyDelay(10);
-        Beep(140,114);
-        CyDelay(10);
-        Beep(140,136);
-        CyDelay(10);
-        Beep(590,114);
-        CyDelay(10);
-        Beep(290,102);
-        CyDelay(10);
-        Beep(300,121);
-        Beep(140,136);
-        CyDelay(10);
-        Beep(290,153);
-        CyDelay(10);
-        Beep(140,153);
-        CyDelay(10);
-        Beep(590,102);
-        CyDelay(10);
-        Beep(590,114);
-        CyDelay(10);
-        
-        }
+    beep_play(rickRoll, sizeof(rickRoll) / sizeof(rickRoll[0]), NULL);
+}
 /*
  If all 4 sensors are mostly on black line, returns true
 */
@@ -331,6 +463,7 @@ bool checkVoltage(){
         vbat = (float)adcresult/(float)819;
         vbat *=1.5;
         printf("Vbat: %.6f\n", vbat);
+        telemetry_battery((uint32)adcresult * 1500 / 819);
     }
     return vbat < 4.00;
  }   
@@ -372,49 +505,89 @@ void flashLED(){
         CyDelay(delay);
     }  
 }
+static const struct note_ calibrationDone[] = {
+    {25, 200}, {25, 255}, {25, 10}, {25, 50}, {25, 100}, {25, 150}
+};
 /*
-Gets reflectance value from all 4 sensors over 1 second & returns the average.
+Sweeps the sensors over the line by turning in place left, right & back to the start heading
+while tracking every sensor's minimum (white) & maximum (black) on each new sample.
+Returns false & restores the previous calibration if a sensor didn't see enough contrast.
 */
-void calibrate(struct sensors_ ref, float *result)
+bool calibrate()
 {
-    float l1[10]={};
-    float r1[10]={};
-    float l3[10]={};
-    float r3[10]={};
-    int timer = 0;
-    int i = 0;
+    struct reflectance_sample_ s = {0};
+    //Turn direction of each phase, 0:left 1:right, & its length in sweeps
+    const uint8 phaseDir[3] = {0, 1, 0};
+    const uint8 phaseLength[3] = {1, 2, 1};
+    uint8 i;
     
-    while(timer <= 1100)
-    {
-        if(i < 10){
-        reflectance_read(&ref);
-        l1[i] += ref.l1;
-        r1[i] += ref.r1;
-        l3[i] += ref.l3;
-        r3[i] += ref.r3;
-        result[0] += l1[i];
-        result[1] += r1[i];
-        result[2] += l3[i];
-        result[3] += r3[i];
-        //printf("line: %i    ", i);
-        printf("l:%f r:%f\n",l3[i],r3[i]);
-        i++;
+    reflectance_calibration_reset();
+    motor_start();
+    reflectance_wait_new(&s);
+    for(i = 0; i < 3; i++){
+        uint32 end = s.time_ms + phaseLength[i] * CALIBRATION_SWEEP_MS;
+        motor_drive(!phaseDir[i], phaseDir[i], CALIBRATION_SPEED, CALIBRATION_SPEED, 0);
+        while((int32)(end - s.time_ms) > 0){
+            reflectance_wait_new(&s);
+            reflectance_calibration_update(&s.values);
         }
-        
-        timer += 100;
-        CyDelay(100);
-        
     }
-    result[0] /= 10;
-    result[1] /= 10;
-    result[2] /= 10;
-    result[3] /= 10;
-    Beep(25,200);
-    Beep(25,255);
-    Beep(25,10);
-    Beep(25,50);
-    Beep(25,100);
-    Beep(25,150);
+    motor_forward(0,0);
+    
+    struct sensors_ white, black;
+    reflectance_get_calibration(&white, &black);
+    if(black.l3 - white.l3 < CALIBRATION_CONTRAST || black.l1 - white.l1 < CALIBRATION_CONTRAST ||
+       black.r1 - white.r1 < CALIBRATION_CONTRAST || black.r3 - white.r3 < CALIBRATION_CONTRAST){
+        printf("Calibration failed\n");
+        reflectance_set_calibration(&cal.white, &cal.black);
+        beep_note(300,255);
+        return false;
+    }
+    cal.white = white;
+    cal.black = black;
+    cal.threshold.l3 = (white.l3 + black.l3) / 2;
+    cal.threshold.l1 = (white.l1 + black.l1) / 2;
+    cal.threshold.r1 = (white.r1 + black.r1) / 2;
+    cal.threshold.r3 = (white.r3 + black.r3) / 2;
+    printf("white l3:%u l1:%u r1:%u r3:%u\n", white.l3, white.l1, white.r1, white.r3);
+    printf("black l3:%u l1:%u r1:%u r3:%u\n", black.l3, black.l1, black.r1, black.r3);
+    beep_play(calibrationDone, sizeof(calibrationDone) / sizeof(calibrationDone[0]), NULL);
+    return true;
+}
+/*
+Spins left in place MAG_CALIBRATION_TURNS full turns, measured by the gyro, while tracking the magnetometer range.
+Stores the fitted hard & soft iron correction in cal.mag.
+Returns false & keeps the previous correction if the field range was too small.
+*/
+bool calibrateMagnet()
+{
+    struct imu_axes_ m;
+    struct magnet_calibration_ fit;
+    int32 start;
+    uint32 began;
+    
+    magnet_calibration_reset();
+    gyro_heading_update();
+    start = gyro_heading_mdeg();
+    motor_start();
+    motor_drive(1, 0, MAG_CALIBRATION_SPEED, MAG_CALIBRATION_SPEED, 0);
+    began = millis();
+    while(abs(gyro_heading_mdeg() - start) < MAG_CALIBRATION_TURNS * 360000 && millis() - began < MAG_CALIBRATION_TIMEOUT_MS){
+        if(imu_read_mag(&m)){
+            magnet_calibration_update(&m);
+        }
+        gyro_heading_update();
+        CyDelay(MAG_CALIBRATION_PERIOD_MS);
+    }
+    motor_forward(0,0);
+    
+    if(!magnet_calibration_result(&fit)){
+        printf("Magnet calibration failed\n");
+        return false;
+    }
+    cal.mag = fit;
+    printf("magnet offset x:%d y:%d scale x:%u y:%u\n", fit.offset_x, fit.offset_y, fit.scale_x, fit.scale_y);
+    return true;
 }
 
 #if 0
@@ -439,14 +612,24 @@ int rread(void)
 #endif
 
 /* Don't remove the functions below */
+/* Queues output to the UART ring buffer without waiting, output that doesn't fit is dropped & counted */
 int _write(int file, char *ptr, int len)
 {
     (void)file; /* Parameter is not used, suppress unused argument warning */
-	int n;
-	for(n = 0; n < len; n++) {
-        if(*ptr == '\n') UART_1_PutChar('\r');
-		UART_1_PutChar(*ptr++);
+	uint8 buf[64];
+	int n = 0;
+	int i;
+	PROFILE_BEGIN(WRITE);
+	for(i = 0; i < len; i++) {
+        if(ptr[i] == '\n') buf[n++] = '\r';
+		buf[n++] = ptr[i];
+		if(n >= (int)sizeof(buf) - 1) {
+			uart_tx_write(buf, n);
+			n = 0;
+		}
 	}
+	uart_tx_write(buf, n);
+	PROFILE_END(WRITE);
 	return len;
 }
 